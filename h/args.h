@@ -2,21 +2,35 @@
 
 #include <argtable3.h>
 
+#include "format.h"
+
 struct versioninfo_t {
 	int major, minor, patch;
 	const char *note;
 };
 
-extern const char progname[];
 extern const char helpstr[];
 extern const struct versioninfo_t versioninfo;
 
 struct cmdargs_t {
 	struct arg_lit *help, *version;
 	struct arg_lit *verbose;
+	struct arg_lit *stats;
+	struct arg_int *jobs;
+	struct arg_str *format;
+	struct arg_lit *compress;
+	struct arg_str *server, *connect;
+	struct arg_str *cachedir;
+	struct arg_int *cachesize;
 	struct arg_file *inputfile, *outputfile;
 	struct arg_end *end;
+	/* parsed from --format */
+	enum output_format outputformat;
 };
 extern struct cmdargs_t cmdargs;
 
-void parse_cmdargs(int argc, char *argv[]);
+/*
+ * Returns -1 when there is an assembly to go on with, otherwise the status to
+ * exit with, as after --help or a bad argument.
+ */
+int parse_cmdargs(int argc, char *argv[]);
@@ -13,22 +13,29 @@ struct instruction {
 };
 
 struct rawdata {
+	/* allocated from the assembly arena */
 	void *data;
 	size_t size;
 	struct sectionpos position;
 	size_t line;
 };
 
-int add_instruction(struct instruction);
-int add_data(struct rawdata);
+struct wrasm_ctx;
 
-int write_all(void);
+void reserve_instructions(struct wrasm_ctx *, size_t);
+/* size the instruction queue up front from the length of the source */
+void reserve_source(struct wrasm_ctx *, size_t);
 
-int write_all_instructions(void);
-int write_instruction(struct instruction);
+int add_instruction(struct wrasm_ctx *, struct instruction);
+int add_data(struct wrasm_ctx *, struct rawdata);
 
-int write_all_data(void);
-int write_data(struct rawdata);
+int write_all(struct wrasm_ctx *);
 
-void free_instructions(void);
-void free_data(void);
+int write_all_instructions(struct wrasm_ctx *);
+int write_instruction(struct wrasm_ctx *, struct instruction);
+
+int write_all_data(struct wrasm_ctx *);
+int write_data(struct wrasm_ctx *, struct rawdata);
+
+void free_instructions(struct wrasm_ctx *);
+void free_data(struct wrasm_ctx *);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "format.h"
+
+struct input;
+
+/* a SHA-256 digest, in hex */
+#define CACHE_KEY_LENGTH 64
+
+/*
+ * A directory of previously assembled objects, named by a hash of everything
+ * that went into them. Entries are spread over subdirectories named by the
+ * first digit of their key, and each subdirectory is kept to its share of
+ * `limit` bytes by removing the entries used least recently.
+ */
+struct cache {
+	const char *dir;
+	size_t limit;
+};
+
+struct cache_key {
+	/* kept to hash the source the same way again */
+	enum output_format format;
+	bool compress;
+	char hex[CACHE_KEY_LENGTH + 1];
+};
+
+/*
+ * Hashes the source held in `input` together with the version of the assembler
+ * and the options which change its output. The key covers exactly the bytes
+ * that are then assembled, so only input mapped whole into memory is hashed,
+ * returns 1 for anything streamed.
+ */
+int cache_key(struct cache_key *, const struct input *, enum output_format,
+	      bool compress);
+/*
+ * Whether the file the key was made from, read again through `stream`, still
+ * holds the same source. A file written to in place while it was assembled
+ * would otherwise have an object stored under a key for different content.
+ */
+bool source_unchanged(const struct cache_key *, FILE *stream);
+
+/* copies a cached object to `output`, returns 1 if there was none */
+int fetch_cached(const struct cache *, const struct cache_key *,
+		 const char *output);
+/* adds the freshly assembled `output`, making room for it if needed */
+void store_cached(const struct cache *, const struct cache_key *,
+		  const char *output);
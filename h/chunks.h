@@ -0,0 +1,18 @@
+#pragma once
+
+struct input;
+struct wrasm_ctx;
+
+/*
+ * The number of pieces worth splitting the input into to parse at once. Only
+ * input held entirely in memory can be split, streamed input is always parsed
+ * line by line.
+ */
+unsigned count_chunks(const struct wrasm_ctx *, const struct input *);
+
+/*
+ * Parses the input in `count` pieces split at line boundaries, each into its
+ * own context on its own thread. The pieces are then merged back in order, so
+ * the context ends up exactly as if the input had been parsed line by line.
+ */
+int parse_chunks(struct wrasm_ctx *, struct input *, unsigned count);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include "bytecode.h"
+#include "debug.h"
+#include "elf/output.h"
+#include "elf/reloc.h"
+#include "stats.h"
+#include "symbols.h"
+#include "xmalloc.h"
+
+/*
+ * Everything that belongs to a single assembly. Contexts share nothing, so any
+ * number of them may be in use at once, as long as each is only used by one
+ * thread at a time.
+ */
+struct wrasm_ctx {
+	struct symboltable symbols;
+
+	struct instruction *instructions;
+	size_t instructions_size;
+	size_t instructions_capacity;
+	struct rawdata *dataitems;
+	size_t dataitems_size;
+	size_t dataitems_capacity;
+
+	enum sections outputsection;
+	struct section sections[SECTION_COUNT];
+
+	/* leave symbols to the linker where needed, only ELF output can */
+	bool relocatable;
+	struct relocation *relocations;
+	size_t relocations_size;
+	size_t relocations_capacity;
+	/* numbers the labels added for pc relative relocations */
+	size_t pcrel_labels;
+
+	/* replace instructions with compressed ones where they fit */
+	bool compress;
+	/* whether any compressed instructions were emitted */
+	bool rvc;
+	/* the most threads encoding may be split across */
+	unsigned threads;
+
+	/* data payloads and section contents */
+	struct arena arena;
+
+	struct diagnostics diagnostics;
+	struct stats stats;
+	struct phasetimer timer;
+};
+
+void init_context(struct wrasm_ctx *);
+void free_context(struct wrasm_ctx *);
+/*
+ * Empties the context of everything assembled into it, ready for another
+ * source, but keeps the memory it has grown. Options, diagnostics and stats
+ * are left alone.
+ */
+void reset_context(struct wrasm_ctx *);
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 
-extern size_t linenumber;
+#include "macros.h"
+
 
 /* ERROR IDs
  *
@@ -36,7 +38,74 @@ enum loglvl_t {
 	NODEBUG,
 };
 
+/*
+ * Log levels below WRASM_LOG_LEVEL are compiled out entirely, see the
+ * log_level meson option. It defaults to keeping everything.
+ */
+#ifndef WRASM_LOG_LEVEL
+#define WRASM_LOG_LEVEL 0
+#endif
+
+/* a message kept back to be reported later, see replay_messages() */
+struct held_message {
+	enum loglvl_t level;
+	enum error_t id;
+	size_t line;
+	char *text;
+};
+
+struct message_log {
+	struct held_message *messages;
+	size_t size;
+	size_t capacity;
+};
+
+/* where messages are reported from and how many have been reported */
+struct diagnostics {
+	size_t line;
+	/* only shown when several files are being assembled */
+	const char *source;
+	size_t counts[NODEBUG + 1];
+	/* never exit on errors, the caller checks get_clean_exit() instead */
+	bool keep_going;
+	/*
+	 * When set, messages are formatted into the log instead of being
+	 * printed, counted or exiting, until they are replayed.
+	 */
+	struct message_log *held;
+};
+
+/*
+ * Messages are counted against the diagnostics in use on the current thread.
+ * Each thread starts with its own, assemblies swap in their context's own for
+ * as long as they run. Returns the diagnostics that were previously in use,
+ * passing NULL goes back to the thread's own.
+ */
+struct diagnostics *use_diagnostics(struct diagnostics *);
+
+extern const char progname[];
+extern enum loglvl_t minloglevel;
+
 void set_min_loglevel(enum loglvl_t);
 void set_exit_loglevel(enum loglvl_t);
-void logger(enum loglvl_t, enum error_t, const char *, ...);
+void log_message(enum loglvl_t, enum error_t, const char *, ...);
 int get_clean_exit(enum loglvl_t);
+
+/*
+ * Reports held messages against the current diagnostics, in the order they
+ * were logged and on the lines they were logged from.
+ */
+void replay_messages(const struct message_log *);
+void free_messages(struct message_log *);
+
+/*
+ * Messages below the minimum log level are dropped before any of the
+ * arguments are evaluated. Warnings and above always reach log_message(), as
+ * they are counted for get_clean_exit() even when they are not printed.
+ */
+#define logger(level, ...)                                       \
+	do {                                                     \
+		if ((level) >= WRASM_LOG_LEVEL &&                \
+		    ((level) >= WARN || (level) >= minloglevel)) \
+			log_message((level), __VA_ARGS__);       \
+	} while (0)
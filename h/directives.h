@@ -1,11 +1,24 @@
 #pragma once
 
+#include "elf/output.h"
+#include "lexer.h"
+
+struct wrasm_ctx;
+
 /* TODO: implement assembler directives */
-int parse_directive(char *);
+int parse_directive(struct wrasm_ctx *, const struct token *, size_t);
 
 int get_section_by_name(const char *);
 
-int parse_asciz(const char *);
-int parse_ascii(const char *);
-int parse_section(const char *);
-int parse_global(const char *);
+/*
+ * The section left selected after a line, given the one selected before it.
+ * Only .section is looked at, so this can be run over lines without parsing
+ * them.
+ */
+enum sections scan_section(const struct token *, size_t,
+			   enum sections current);
+
+int parse_asciz(struct wrasm_ctx *, const struct operands *);
+int parse_ascii(struct wrasm_ctx *, const struct operands *);
+int parse_section(struct wrasm_ctx *, const struct operands *);
+int parse_global(struct wrasm_ctx *, const struct operands *);
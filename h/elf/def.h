@@ -4,6 +4,9 @@
 
 #define ELF_IDENTSIZE 16
 
+/* the object contains compressed instructions */
+#define EF_RISCV_RVC 0x0001
+
 struct elf64header {
 	unsigned char ident[ELF_IDENTSIZE];
 	uint16_t type;
@@ -37,6 +40,10 @@ struct elf64sectionheader {
 struct elf64header new_elf64header(void);
 struct elf64sectionheader new_elf64sectionheader(void);
 
+/* the binding of a symbol is held in the upper four bits of its info */
+#define ELF_SYM_LOCAL 0x00
+#define ELF_SYM_GLOBAL 0x10
+
 struct elf64sym {
 	uint32_t name;
 	unsigned char info;
@@ -45,3 +52,10 @@ struct elf64sym {
 	uint64_t value;
 	uint64_t size;
 };
+
+/* the symbol table index is held in the upper half of info, the type below */
+struct elf64rela {
+	uint64_t offset;
+	uint64_t info;
+	int64_t addend;
+};
@@ -9,6 +9,8 @@ enum sections {
 	SECTION_TEXT,
 	SECTION_DATA,
 	SECTION_SYMTAB,
+	SECTION_RELA_TEXT,
+	SECTION_RELA_DATA,
 	SECTION_COUNT
 };
 
@@ -22,27 +24,42 @@ struct section {
 	size_t size;
 	char *contents;
 	uint32_t nameoffset;
+	uint32_t info;
 };
 
-extern enum sections outputsection;
+struct wrasm_ctx;
 
-void change_output(enum sections);
+void change_output(struct wrasm_ctx *, enum sections);
 
-struct sectionpos get_outputpos(void);
-void inc_outputsize(enum sections, size_t);
-void set_section(enum sections);
+struct sectionpos get_outputpos(const struct wrasm_ctx *);
+void inc_outputsize(struct wrasm_ctx *, enum sections, size_t);
+void set_section(struct wrasm_ctx *, enum sections);
 
-size_t calc_fileoffset(struct sectionpos);
+size_t calc_fileoffset(const struct wrasm_ctx *, struct sectionpos);
 
-void calc_strtab(void);
-int fill_strtab(void);
+const char *get_section_name(enum sections);
+size_t get_section_size(const struct wrasm_ctx *, enum sections);
 
-void calc_symtab(void);
-int fill_symtab(void);
+void calc_strtab(struct wrasm_ctx *);
+int fill_strtab(struct wrasm_ctx *);
 
-int alloc_output(void);
+void calc_symtab(struct wrasm_ctx *);
+int fill_symtab(struct wrasm_ctx *);
 
-size_t write_sectiondata(const void *, size_t, struct sectionpos);
+/*
+ * Sections are allocated in two steps. The contents of .text and .data are
+ * sized while parsing, so are allocated before anything is encoded. The symbol,
+ * string and relocation tables can still grow while encoding, so are only
+ * allocated once everything else is done.
+ */
+int alloc_output(struct wrasm_ctx *);
+int alloc_tables(struct wrasm_ctx *);
 
-int flush_output(FILE *);
-void free_output(void);
+/* returns a pointer to count bytes of section contents to write in place */
+unsigned char *get_sectiondata(struct wrasm_ctx *, struct sectionpos, size_t);
+size_t write_sectiondata(struct wrasm_ctx *, const void *, size_t,
+			 struct sectionpos);
+
+int flush_output(struct wrasm_ctx *, FILE *);
+/* the same output in a newly allocated buffer, which the caller frees */
+int copy_output(struct wrasm_ctx *, unsigned char **, size_t *);
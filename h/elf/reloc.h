@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "elf/output.h"
+
+/* the RISC-V relocation types emitted by wrasm */
+enum reloc_type {
+	R_RISCV_BRANCH = 16,
+	R_RISCV_JAL = 17,
+	R_RISCV_CALL_PLT = 19,
+	R_RISCV_PCREL_HI20 = 23,
+	R_RISCV_PCREL_LO12_I = 24,
+	R_RISCV_RVC_BRANCH = 44,
+	R_RISCV_RVC_JUMP = 45,
+};
+
+/* a reference to a symbol which is left for the linker to fill in */
+struct relocation {
+	struct sectionpos position;
+	size_t sym;
+	enum reloc_type type;
+	/*
+	 * Until it is labelled, the low half of a pc relative address has no
+	 * symbol and holds the offset of its high half in the section instead.
+	 */
+	size_t hioffset;
+};
+
+struct symbol;
+struct wrasm_ctx;
+
+/*
+ * Only ELF output can hold relocations. Everything else resolves every symbol
+ * itself, which fails for symbols that are never defined.
+ */
+bool needs_relocation(const struct wrasm_ctx *, const struct symbol *);
+
+/*
+ * Relocations are added while encoding, at the file position of the encoded
+ * instruction in the current output section.
+ */
+void add_relocation(struct wrasm_ctx *, enum reloc_type, size_t sym,
+		    size_t position);
+/*
+ * The low half of a pc relative address refers to the instruction holding the
+ * high half rather than the symbol itself, so that instruction is labelled.
+ * The labels are only added by label_pcrel_relocations() once encoding is
+ * done, so that encoding never adds symbols.
+ */
+void add_pcrel_lo_relocation(struct wrasm_ctx *, size_t hiposition,
+			     size_t loposition);
+int label_pcrel_relocations(struct wrasm_ctx *);
+/* moves relocations added to another view of the same assembly onto the end */
+void append_relocations(struct wrasm_ctx *, struct wrasm_ctx *from);
+
+void calc_relocations(struct wrasm_ctx *);
+int fill_relocations(struct wrasm_ctx *);
+
+void free_relocations(struct wrasm_ctx *);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdio.h>
+
+int open_file(FILE **, const char *filename, const char *flags);
+
+/*
+ * Outputs are written to a temporary file next to their destination and only
+ * renamed over it once complete, so a failed assembly never leaves a partial
+ * object behind. The temporary name is returned through the second argument
+ * and must be passed to either commit_temp_output() or discard_temp_output().
+ */
+FILE *open_temp_output(const char *filename, char **tempname);
+int commit_temp_output(FILE *, char *tempname, const char *filename);
+void discard_temp_output(char *tempname);
@@ -8,6 +8,10 @@ enum load_pseudo {
 	LOAD_IMM,
 	LOAD_ADDR,
 };
+enum call_pseudo {
+	CALL_CALL,
+	CALL_TAIL,
+};
 enum math_pseudo {
 	MATH_MV,
 	MATH_NOT,
@@ -44,6 +48,7 @@ enum jump_pseudo {
 /* shortcut instructions bytecode generation */
 form_handler form_nop;
 form_handler form_load_pseudo;
+form_handler form_call;
 form_handler form_math;
 form_handler form_setif;
 form_handler form_branchifz;
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdbool.h>
+
+#include "form/instructions.h"
+
+/* the integer instructions of the C extension (Zca) for RV64 */
+extern const struct formation rv64c[];
+
+struct instruction;
+
+/*
+ * Replaces an instruction with its compressed equivalent if its operands
+ * allow one, returning whether it did. Branches and jumps are never replaced,
+ * as whether they fit depends on how far away their target ends up, instead
+ * see compressible_branch().
+ */
+bool compress_instruction(struct instruction *);
+/*
+ * Whether a branch or jump could be encoded in 2 bytes given a near enough
+ * target. form_btype() and form_jtype() emit c.beqz, c.bnez and c.j for
+ * instructions of size 2.
+ */
+bool compressible_branch(const struct instruction *);
+
+/* compressed instruction bytecode generation, named after their formats */
+form_handler form_cr;
+form_handler form_cjr;
+form_handler form_ci;
+form_handler form_cshift;
+form_handler form_candi;
+form_handler form_clui;
+form_handler form_caddi16sp;
+form_handler form_caddi4spn;
+form_handler form_cloadsp;
+form_handler form_cstoresp;
+form_handler form_cload;
+form_handler form_cstore;
+form_handler form_ca;
+form_handler form_cbranch;
+form_handler form_cjump;
+form_handler form_cfixed;
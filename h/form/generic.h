@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 
+#include "elf/reloc.h"
 #include "symbols.h"
 #include "form/instructions.h"
 
@@ -19,6 +20,11 @@
 #define OP_AUIPC 0x17
 #define OP_AMO 0x2F
 
+/* the quadrants of the compressed instructions */
+#define OP_C0 0x0
+#define OP_C1 0x1
+#define OP_C2 0x2
+
 #define END_FORMATION              \
 	{                          \
 		NULL, NULL, NULL,  \
@@ -27,17 +33,41 @@
 		}                  \
 	}
 
-struct bytecode {
-	size_t size;
-	unsigned char *data;
-};
-
-extern const struct bytecode error_bytecode;
+#define FORM_ERROR ((size_t)-1)
 
 /* helper functions */
-struct bytecode form_empty_bytecode(void);
+static inline void put_u32(unsigned char *out, uint32_t value)
+{
+	out[0] = (unsigned char)value;
+	out[1] = (unsigned char)(value >> 8);
+	out[2] = (unsigned char)(value >> 16);
+	out[3] = (unsigned char)(value >> 24);
+}
+
+static inline void put_u16(unsigned char *out, uint16_t value)
+{
+	out[0] = (unsigned char)value;
+	out[1] = (unsigned char)(value >> 8);
+}
+
+static inline uint16_t get_u16(const unsigned char *in)
+{
+	return (uint16_t)(in[0] | in[1] << 8);
+}
+
+static inline uint32_t get_u32(const unsigned char *in)
+{
+	return (uint32_t)in[0] | (uint32_t)in[1] << 8 |
+	       (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
 
-int32_t calc_symbol_offset(const struct symbol *, size_t);
+int32_t calc_symbol_offset(const struct wrasm_ctx *, const struct symbol *,
+			   size_t);
+/*
+ * The pc relative offset from position to a symbol. When the symbol has to be
+ * resolved by the linker a relocation is added instead, and the offset is 0.
+ */
+int32_t symbol_offset(struct wrasm_ctx *, size_t, size_t, enum reloc_type);
 
 form_handler form_rtype;
 form_handler form_itype;
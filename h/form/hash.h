@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "form/instructions.h"
+
+/*
+ * The formation hash table is generated at build time from the formation
+ * tables by scripts/formation_hash.py, these values must match the script.
+ */
+#define FORMATION_HASH_BUCKET_BITS 6
+#define FORMATION_HASH_SLOT_BITS 8
+#define FORMATION_HASH_BUCKETS (1 << FORMATION_HASH_BUCKET_BITS)
+#define FORMATION_HASH_SLOTS (1 << FORMATION_HASH_SLOT_BITS)
+
+extern const uint32_t formation_hash_seed;
+extern const uint8_t formation_hash_displacements[FORMATION_HASH_BUCKETS];
+extern const struct formation *const formation_hash_slots[FORMATION_HASH_SLOTS];
+
+/* 32 bit FNV-1a */
+static inline uint32_t hash_mnemonic(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u ^ formation_hash_seed;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static inline size_t formation_hash_slot(uint32_t hash)
+{
+	const size_t bucket = hash >> (32 - FORMATION_HASH_BUCKET_BITS);
+	return (hash ^ formation_hash_displacements[bucket]) &
+	       (FORMATION_HASH_SLOTS - 1);
+}
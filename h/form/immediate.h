@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* the longest sequence any 64 bit constant needs */
+#define IMM_MAX_STEPS 8
+
+enum imm_op {
+	IMM_LUI,
+	/* from x0 when it is the first step, so it never needs a lui */
+	IMM_ADDI,
+	IMM_ADDIW,
+	IMM_SLLI,
+	IMM_SRLI,
+};
+
+/* one instruction of a sequence, each one modifies the destination register */
+struct imm_step {
+	enum imm_op op;
+	int32_t imm;
+};
+
+struct imm_sequence {
+	struct imm_step steps[IMM_MAX_STEPS];
+	size_t count;
+};
+
+/*
+ * Finds the shortest sequence of instructions which loads a constant into a
+ * register. Constants fitting 12 bits take a single addi, and ones fitting
+ * 32 bits a lui and addiw. Wider constants are built from their upper bits
+ * with a chain of shifts and adds, or by shifting out the bits either side of
+ * a narrower constant.
+ */
+void build_imm_sequence(int64_t value, struct imm_sequence *);
+/* the number of bytes li takes to load a constant */
+size_t load_imm_size(int64_t value);
@@ -6,9 +6,15 @@
 struct formation;
 struct args;
 struct idata;
-typedef struct bytecode(form_handler)(const char *, struct idata, struct args,
-				      size_t);
-typedef struct args arg_parser(char *);
+struct operands;
+struct wrasm_ctx;
+/*
+ * Encodes an instruction at the given file position into out, which must have
+ * room for idata.sz bytes. Returns the number of bytes written, or FORM_ERROR.
+ */
+typedef size_t(form_handler)(struct wrasm_ctx *, const char *, struct idata,
+			     struct args, size_t, unsigned char *);
+typedef struct args arg_parser(struct wrasm_ctx *, const struct operands *);
 
 struct formation {
 	const char *name;
@@ -26,10 +32,12 @@ struct args {
 	uint8_t rd;
 	uint8_t rs1;
 	uint8_t rs2;
-	int32_t imm;
-	struct symbol *sym;
+	int64_t imm;
+	size_t sym;
 };
 
 extern const struct args empty_args;
 
-struct formation parse_form(const char *instruction);
+/* looks up an instruction mnemonic, returning NULL if it does not exist */
+const struct formation *find_formation(const char *instruction, size_t len);
+struct formation parse_form(const char *instruction, size_t len);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum output_format {
+	FORMAT_ELF,
+	/* a flat image of .text followed by .data */
+	FORMAT_BIN,
+	/* the same image as Intel HEX records */
+	FORMAT_IHEX,
+};
+
+struct wrasm_ctx;
+
+int parse_output_format(const char *, enum output_format *);
+/* the extension given to outputs named after their input, such as ".o" */
+const char *get_format_extension(enum output_format);
+
+int write_output_format(struct wrasm_ctx *, enum output_format, FILE *);
+/* the same output in a newly allocated buffer, which the caller frees */
+int copy_output_format(struct wrasm_ctx *, enum output_format,
+		       unsigned char **, size_t *);
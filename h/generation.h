@@ -1,9 +1,31 @@
 #pragma once
 
 #include "elf/output.h"
+#include "format.h"
+#include "lexer.h"
 
-/* general instruction generation */
-void parse_file(FILE *, FILE *);
-int parse_line(char *, struct sectionpos);
+struct input;
+struct wrasm_ctx;
 
-int parse_label(char *, struct sectionpos);
+/*
+ * Parse and encode everything in the input, leaving the output sections of
+ * the context ready to be written. The input is closed once it has been read.
+ */
+int assemble_input(struct wrasm_ctx *, struct input *);
+/*
+ * Parse every line of the input, numbering them on from the current line of
+ * the context's diagnostics. Stops at the first line which fails to parse.
+ */
+int parse_input(struct wrasm_ctx *, struct input *);
+
+/*
+ * Assembles the input and writes it out in the given format, then empties the
+ * context with reset_context(), so it can go on to the next source. The input
+ * is closed once it has been read.
+ */
+void parse_file(struct wrasm_ctx *, struct input *, FILE *,
+		enum output_format);
+int parse_line(struct wrasm_ctx *, const char *, struct sectionpos);
+
+int parse_label(struct wrasm_ctx *, const struct token *, size_t,
+		struct sectionpos);
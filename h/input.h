@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A view of a single line of the input source. The line is not copied and is
+ * not null terminated, however the byte directly after the line is always
+ * either a newline or a null character, so the view may be passed straight to
+ * tokenize().
+ */
+struct lineview {
+	const char *str;
+	size_t len;
+};
+
+enum input_source {
+	INPUT_STREAM,
+	INPUT_MAPPED,
+	/* source text owned by the caller, see open_input_buffer() */
+	INPUT_BUFFER,
+};
+
+struct input {
+	FILE *stream;
+	char *data;
+	size_t size;
+	size_t pos;
+	size_t capacity;
+	enum input_source source;
+	bool eof;
+	char *tail;
+	/* total length of the input if known ahead of time, otherwise 0 */
+	size_t size_hint;
+};
+
+int open_input(struct input *, FILE *);
+int open_input_buffer(struct input *, const char *, size_t);
+bool next_line(struct input *, struct lineview *);
+void close_input(struct input *);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "format.h"
+#include "stats.h"
+
+/* a single input file and the object it is assembled into */
+struct job {
+	const char *input;
+	char *output;
+	enum output_format format;
+	bool compress;
+	/* NULL when objects are always assembled afresh */
+	const struct cache *cache;
+	bool failed;
+};
+
+/*
+ * Assembles every job, with up to `threads` running at once. Each job gets its
+ * own assembler context and runs start to finish on one thread. The stats of
+ * all the jobs are added to `totals`. Returns the number of jobs that failed.
+ */
+size_t run_jobs(struct job *, size_t count, unsigned threads,
+		struct stats *totals);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+enum token_type {
+	TOKEN_IDENTIFIER,
+	TOKEN_NUMBER,
+	TOKEN_STRING,
+	TOKEN_COMMA,
+	TOKEN_COLON,
+	TOKEN_OPEN_PAREN,
+	TOKEN_CLOSE_PAREN,
+	TOKEN_OTHER,
+};
+
+/* a slice of the original line, tokens are never copied or null terminated */
+struct token {
+	const char *str;
+	size_t len;
+	enum token_type type;
+};
+
+#define MAX_LINE_TOKENS 64
+struct tokenline {
+	size_t count;
+	struct token tokens[MAX_LINE_TOKENS];
+};
+
+/* a comma separated instruction or directive argument */
+struct operand {
+	const char *str;
+	size_t len;
+	const struct token *tokens;
+	size_t count;
+};
+
+#define MAX_OPERANDS 8
+struct operands {
+	size_t count;
+	struct operand operands[MAX_OPERANDS];
+};
+
+int tokenize(const char *, struct tokenline *);
+int split_operands(const struct token *, size_t, struct operands *);
+
+bool token_equals(const struct token *, const char *);
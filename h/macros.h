@@ -10,3 +10,10 @@
 #define UNREACHABLE()
 #define NO_UNREACHABLE
 #endif
+
+/* state that each thread keeps its own copy of */
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdlib.h>
+
+/* the most threads worth running at once, given the processors online */
+unsigned usable_threads(unsigned requested);
+
+/*
+ * Makes usable_threads() act as if `count` processors were online, so that
+ * tests split their work the same way on any machine. Without threads the
+ * pieces then run one after another. 0 goes back to asking the system.
+ */
+void set_processors(unsigned count);
+
+/*
+ * Calls fn on each of `count` items, `size` bytes apart, each on a thread of
+ * its own. The calling thread takes the first item, and any whose thread could
+ * not be started. Returns once every call has finished.
+ */
+void run_parallel(void (*fn)(void *), void *items, size_t size,
+		  unsigned count);
@@ -2,6 +2,7 @@
 
 #include "elf/output.h"
 #include "form/instructions.h"
+#include "lexer.h"
 
 extern const struct args empty_args;
 
@@ -15,6 +16,8 @@ arg_parser parse_ltype;
 arg_parser parse_pseudo;
 arg_parser parse_fence;
 arg_parser parse_none;
+arg_parser parse_ci;
+arg_parser parse_cr;
 
 arg_parser parse_jal;
 arg_parser parse_jalr;
@@ -29,4 +32,5 @@ arg_parser parse_as;
 arg_parser parse_csr;
 arg_parser parse_csri;
 
-int parse_asm(const char *, struct sectionpos);
+int parse_asm(struct wrasm_ctx *, const struct token *, size_t,
+	      struct sectionpos);
@@ -6,8 +6,8 @@
 extern const char *reg_abi_map[];
 extern const char *float_reg_abi_map[];
 
-size_t get_register_id(const char *);
-size_t get_float_register_id(const char *);
+size_t get_register_id(const char *, size_t);
+size_t get_float_register_id(const char *, size_t);
 
-int get_immediate(const char *, size_t *);
-uint16_t get_csr(const char *);
+int get_immediate(const char *, size_t, size_t *);
+uint16_t get_csr(const char *, size_t);
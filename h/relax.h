@@ -0,0 +1,38 @@
+#pragma once
+
+struct wrasm_ctx;
+
+/*
+ * Branches and jumps are parsed at their shortest size. Any whose target
+ * turns out to be out of range is grown into a longer sequence, moving
+ * everything after it, until every target is in range. Sizes only ever grow,
+ * so this always finishes, and branches that are never out of range keep
+ * their shortest form.
+ *
+ *   b<cond> rs1, rs2, target       4 bytes, +-4KiB
+ *   b<!cond> rs1, rs2, 8           8 bytes, +-1MiB
+ *   jal zero, target
+ *   b<!cond> rs1, rs2, 12          12 bytes, +-2GiB
+ *   auipc t1, %pcrel_hi(target)
+ *   jalr zero, %pcrel_lo(target)(t1)
+ *
+ *   jal rd, target                 4 bytes, +-1MiB
+ *   auipc rd, %pcrel_hi(target)    8 bytes, +-2GiB, t1 is used when rd is zero
+ *   jalr rd, %pcrel_lo(target)(rd)
+ *
+ * The longest forms of conditional branches and of jumps which do not link
+ * overwrite t1, the same as tail does, and a warning is given for each, as
+ * code keeping a live value in t1 would otherwise break silently.
+ *
+ * Only targets in the same section which the assembler resolves itself can be
+ * relaxed, anything else keeps its shortest form and is left to the linker.
+ * With compression, c.beqz, c.bnez and c.j are the shortest forms of beqz,
+ * bnez and j, reaching +-256B and +-2KiB.
+ */
+void relax_branches(struct wrasm_ctx *);
+/*
+ * Replaces every instruction which has a compressed equivalent with it,
+ * moving everything after it, and shrinks branches and jumps which could be
+ * compressed so that relax_branches() only grows the ones that do not fit.
+ */
+void compress_instructions(struct wrasm_ctx *);
@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+ * Assembles a forwarded invocation, returning its exit status. It runs in the
+ * server itself, so it must report errors rather than exit.
+ */
+typedef int request_handler(int argc, char *argv[]);
+
+/*
+ * Listens on the unix socket at `path` for invocations handed over by
+ * forward_request(), until interrupted or terminated. Requests are run one at
+ * a time in the server, so each starts out with whatever the ones before it
+ * left warm. The request gets the client's standard streams and working
+ * directory for as long as it runs, and its exit status is sent back.
+ */
+int run_server(const char *path, request_handler *);
+
+/*
+ * Hands this invocation over to the server listening at `path`, along with the
+ * standard streams and working directory. Returns the exit status of the
+ * request, or -1 when there is no server to take it.
+ */
+int forward_request(const char *path, int argc, char *argv[]);
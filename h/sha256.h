@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SHA256_LENGTH 32
+#define SHA256_BLOCK_SIZE 64
+
+/* SHA-256 as specified in FIPS 180-4, fed any number of bytes at a time */
+struct sha256 {
+	uint32_t state[8];
+	uint64_t length;
+	unsigned char block[SHA256_BLOCK_SIZE];
+	size_t used;
+};
+
+void init_sha256(struct sha256 *);
+void update_sha256(struct sha256 *, const void *, size_t);
+void finish_sha256(struct sha256 *, unsigned char digest[SHA256_LENGTH]);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "elf/output.h"
+
+enum stats_phase {
+	PHASE_PARSE,
+	PHASE_RELAX,
+	PHASE_LAYOUT,
+	PHASE_ENCODE,
+	PHASE_TABLES,
+	PHASE_WRITE,
+	PHASE_CLEANUP,
+	PHASE_COUNT,
+	PHASE_NONE = PHASE_COUNT,
+};
+
+enum stats_counter {
+	STAT_LINES,
+	STAT_INSTRUCTIONS,
+	STAT_DATA,
+	STAT_SYMBOLS,
+	STAT_SYMBOL_LOOKUPS,
+	STAT_SYMBOL_PROBES,
+	STAT_RELOCATIONS,
+	STAT_RELAXED,
+	STAT_RELAX_PASSES,
+	STAT_COMPRESSED,
+	STAT_CACHE_HITS,
+	STAT_CACHE_MISSES,
+	STAT_COUNT,
+};
+
+struct stats {
+	double phase_times[PHASE_COUNT];
+	size_t counters[STAT_COUNT];
+	size_t section_sizes[SECTION_COUNT];
+};
+
+struct phasetimer {
+	enum stats_phase phase;
+	struct timespec start;
+};
+
+struct wrasm_ctx;
+
+/*
+ * Counters are always collected, they are only plain increments and so are
+ * cheap enough to never need turning off. Only printing them is optional.
+ */
+static inline void count_stat(struct stats *stats, enum stats_counter counter,
+			      size_t amount)
+{
+	stats->counters[counter] += amount;
+}
+
+/* ends the current phase, if any, and starts timing the next one */
+void start_phase(struct wrasm_ctx *, enum stats_phase);
+/* adds the output section sizes of the assembly that just finished */
+void record_section_sizes(struct wrasm_ctx *);
+/* adds the context's stats to the totals and clears them */
+void collect_stats(struct wrasm_ctx *, struct stats *);
+
+void print_stats(FILE *, const struct stats *);
@@ -1,4 +0,0 @@
-#pragma once
-
-int is_terminating(char);
-char *trim_whitespace(const char *);
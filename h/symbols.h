@@ -1,12 +1,18 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "elf/def.h"
 #include "elf/output.h"
 
 struct symbol {
-	size_t name_sz;
-	char *name;
+	/* offset of the name in the symbol string table */
+	uint32_t name;
+	uint32_t hash;
 	enum sections section;
+	/* position in the ELF symbol table, which lists local symbols first */
+	uint32_t symtab_index;
 	long value;
 	unsigned char binding;
 	enum symbol_types {
@@ -17,20 +23,40 @@ struct symbol {
 	} type;
 };
 
-#define SYMBOLMAP_ENTRIES 256
-struct symbolmap {
+/*
+ * Symbols are stored densely in creation order and referred to by their index,
+ * which, unlike a pointer, stays valid when the table grows. The names are
+ * interned into a single buffer laid out exactly as the .strtab payload.
+ */
+#define NO_SYMBOL ((size_t)-1)
+struct symboltable {
 	size_t count;
+	size_t capacity;
 	struct symbol *data;
+
+	/* open addressing index, holds symbol index + 1 or 0 if empty */
+	size_t slot_count;
+	uint32_t *slots;
+
+	size_t strings_size;
+	size_t strings_capacity;
+	char *strings;
 };
-extern struct symbolmap symbols[SYMBOLMAP_ENTRIES];
+struct wrasm_ctx;
 
-struct symbol *get_symbol(const char *);
-struct symbol *create_symbol(const char *, enum symbol_types);
-struct symbol *get_or_create_symbol(const char *, enum symbol_types);
+struct symbol *get_symbol_at(struct wrasm_ctx *, size_t index);
+size_t get_symbol_index(const struct wrasm_ctx *, const struct symbol *);
+const char *get_symbol_name(const struct wrasm_ctx *, const struct symbol *);
 
-struct elf64sym create_symtab_entry(const char *);
+struct symbol *get_symbol(struct wrasm_ctx *, const char *, size_t);
+struct symbol *create_symbol(struct wrasm_ctx *, const char *, size_t,
+			     enum symbol_types);
+struct symbol *get_or_create_symbol(struct wrasm_ctx *, const char *, size_t,
+				    enum symbol_types);
 
-size_t calc_symtab_str_buf_size(void);
-char *create_symtab_str_buf(size_t);
+size_t get_symbol_strings_size(const struct wrasm_ctx *);
+const char *get_symbol_strings(const struct wrasm_ctx *);
 
-void free_symbols(void);
+void free_symbols(struct wrasm_ctx *);
+/* removes every symbol, keeping the memory the table has grown */
+void clear_symbols(struct wrasm_ctx *);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * The wrasm library interface. Source text is assembled straight from memory
+ * into a newly allocated buffer, without touching the filesystem.
+ */
+
+#if defined(_WIN32) && defined(WRASM_BUILDING_LIBRARY)
+#define WRASM_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define WRASM_API __attribute__((visibility("default")))
+#else
+#define WRASM_API
+#endif
+
+enum wrasm_format {
+	/* a relocatable object, exactly as written by the wrasm executable */
+	WRASM_FORMAT_ELF,
+	/* the contents of .text followed by .data, ready to be loaded */
+	WRASM_FORMAT_RAW,
+	/* the same image as WRASM_FORMAT_RAW, as Intel HEX text */
+	WRASM_FORMAT_IHEX,
+};
+
+struct wrasm_options {
+	enum wrasm_format format;
+	/* shown in diagnostics in place of a file name, may be NULL */
+	const char *source_name;
+	/* non-zero to use compressed instructions wherever possible */
+	int compress;
+	/* the most threads to encode with, 0 or 1 encodes on the calling one */
+	unsigned threads;
+};
+
+struct wrasm_buffer {
+	unsigned char *data;
+	size_t size;
+};
+
+/*
+ * Assemble len bytes of source, which need not be null terminated. Passing
+ * NULL options produces an ELF object. Diagnostics are printed to stderr, but
+ * unlike the executable an error never exits the process, instead non-zero is
+ * returned and the buffer is left empty. Any number of assemblies may run at
+ * once on different threads.
+ */
+WRASM_API int wrasm_assemble(const char *src, size_t len,
+			     const struct wrasm_options *opts,
+			     struct wrasm_buffer *out);
+WRASM_API void wrasm_free_buffer(struct wrasm_buffer *);
@@ -9,3 +9,27 @@
 void *xmalloc(size_t);
 void *xcalloc(size_t, size_t);
 void *xrealloc(void *, size_t);
+
+/*
+ * A bump pointer allocator for objects that live until the end of assembly.
+ * Individual allocations are never freed, instead everything allocated after a
+ * checkpoint can be discarded at once, or the whole arena released.
+ */
+struct arenablock;
+struct arena {
+	struct arenablock *block;
+};
+
+struct arenacheckpoint {
+	struct arenablock *block;
+	size_t used;
+};
+
+void *arena_alloc(struct arena *, size_t);
+struct arenacheckpoint arena_checkpoint(const struct arena *);
+void arena_restore(struct arena *, struct arenacheckpoint);
+void arena_release(struct arena *);
+/* discards everything allocated, keeping the largest block for reuse */
+void arena_reset(struct arena *);
+/* moves every allocation of `from` into the arena, leaving `from` empty */
+void arena_adopt(struct arena *, struct arena *from);
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+"""Perfect Hash Generator for Wrasm Instruction Formations
+
+Usage: formation_hash.py <output.c> <formation sources...>
+
+Reads every formation table (`const struct formation name[] = { ... }`) out
+of the given C sources and writes a C file containing a minimal collision free
+hash table pointing at each entry, which is used by parse_form() to look up an
+instruction mnemonic with a single string comparison.
+
+The hash function and table sizes must be kept in sync with h/form/hash.h.
+Each mnemonic is hashed with 32 bit FNV-1a, the top bits of the
+hash select a bucket and the low bits, xored with the displacement stored for
+that bucket, select the slot."""
+
+from pathlib import Path
+from re import DOTALL, compile
+from sys import argv, exit
+
+BUCKET_BITS = 6
+SLOT_BITS = 8
+
+table_pattern = compile(
+    r'const struct formation (\w+)\[\] = \{(.*?)END_FORMATION', DOTALL
+)
+name_pattern = compile(r'\{\s*"([^"]*)"')
+
+
+def fnv1a(name: str, seed: int) -> int:
+    h = (2166136261 ^ seed) & 0xFFFFFFFF
+    for c in name.encode():
+        h ^= c
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def read_tables(sources: list[Path]):
+    headers = []
+    entries = []
+    for source in sources:
+        text = source.read_text()
+        tables = table_pattern.findall(text)
+        if not tables:
+            continue
+        headers.append(f'{source.parent.name}/{source.stem}.h')
+        for table, body in tables:
+            for index, name in enumerate(name_pattern.findall(body)):
+                entries.append((name, table, index))
+    return headers, entries
+
+
+def displace(entries, seed: int):
+    buckets = [[] for _ in range(1 << BUCKET_BITS)]
+    for entry in entries:
+        h = fnv1a(entry[0], seed)
+        buckets[h >> (32 - BUCKET_BITS)].append((h, entry))
+
+    slots = [None] * (1 << SLOT_BITS)
+    mask = (1 << SLOT_BITS) - 1
+    displacements = [0] * len(buckets)
+
+    order = sorted(range(len(buckets)), key=lambda b: -len(buckets[b]))
+    for b in order:
+        if not buckets[b]:
+            continue
+        # xoring with the displacement never separates two hashes whose low
+        # bits already collide, so those need a different seed
+        low = {h & mask for h, _ in buckets[b]}
+        if len(low) != len(buckets[b]):
+            return None
+        for d in range(1 << SLOT_BITS):
+            wanted = [(h ^ d) & mask for h, _ in buckets[b]]
+            if all(slots[s] is None for s in wanted):
+                for s, (_, entry) in zip(wanted, buckets[b]):
+                    slots[s] = entry
+                displacements[b] = d
+                break
+        else:
+            return None
+    return displacements, slots
+
+
+def generate(output: Path, sources: list[Path]) -> int:
+    headers, entries = read_tables(sources)
+
+    names = [e[0] for e in entries]
+    duplicates = {n for n in names if names.count(n) > 1}
+    if duplicates:
+        print(f"Duplicate instruction mnemonics: {', '.join(duplicates)}")
+        return 1
+    if len(entries) > (1 << SLOT_BITS):
+        print("Too many instructions for the formation hash table")
+        return 1
+
+    for seed in range(1 << 16):
+        result = displace(entries, seed)
+        if result is not None:
+            break
+    else:
+        print("Unable to find a perfect hash for the formation tables")
+        return 1
+    displacements, slots = result
+    assert sum(s is not None for s in slots) == len(entries)
+
+    lines = [
+        f'/* Generated by {Path(__file__).name}, do not edit */',
+        '',
+        '#include "form/hash.h"',
+        '',
+        *(f'#include "{h}"' for h in headers),
+        '',
+        f'const uint32_t formation_hash_seed = {seed};',
+        '',
+        'const uint8_t formation_hash_displacements[FORMATION_HASH_BUCKETS] = {',
+        *(f'\t{d},' for d in displacements),
+        '};',
+        '',
+        'const struct formation *const formation_hash_slots[FORMATION_HASH_SLOTS] = {',
+        *(
+            f'\t[{i}] = &{e[1]}[{e[2]}], /* {e[0]} */'
+            for i, e in enumerate(slots) if e is not None
+        ),
+        '};',
+    ]
+    output.write_text('\n'.join(lines) + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    if len(argv) < 3:
+        print(__doc__)
+        exit(1)
+    exit(generate(Path(argv[1]), [Path(p) for p in argv[2:]]))
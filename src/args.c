@@ -2,12 +2,12 @@
 #include "debug.h"
 #include "macros.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <argtable3.h>
 
-const char progname[] = "wrasm";
 const struct versioninfo_t versioninfo = { 0, 0, 1, "alpha" };
 const char helpstr[] =
 	"The wrasm assembler\n"
@@ -15,28 +15,61 @@ const char helpstr[] =
 	"A risc-V macro assembler based on nasm (see https://nasm.us/)\n"
 	"Currently still being built\n";
 
+/* upper bound on inputs per invocation, argtable3 preallocates this many */
+#define MAX_INPUT_FILES 16384
+
 struct cmdargs_t cmdargs;
 
-void *argtable[6];
+void *argtable[14];
 static void free_argtable(void);
 
-void parse_cmdargs(int argc, char *argv[])
+int parse_cmdargs(int argc, char *argv[])
 {
 	const char *progcall = argv[0];
 
+	/* a server parses the arguments of every request it is sent */
+	static bool registered = false;
+	if (!registered) {
+		atexit(&free_argtable);
+		registered = true;
+	}
+	free_argtable();
+
 	argtable[0] = cmdargs.help =
 		arg_litn("h", "help", 0, 1, "display this help and exit");
 	argtable[1] = cmdargs.version =
 		arg_litn("V", "version", 0, 1, "display version info and exit");
 	argtable[2] = cmdargs.verbose =
 		arg_litn("v", "verbose", 0, 1, "verbose output");
-	argtable[3] = cmdargs.inputfile =
-		arg_filen(NULL, NULL, "<input>", 1, 3, "input file");
-	argtable[4] = cmdargs.outputfile =
-		arg_filen("o", "output", "<filename>", 1, 3, "output file");
-	argtable[5] = cmdargs.end = arg_end(20);
-
-	atexit(&free_argtable);
+	argtable[3] = cmdargs.stats = arg_litn(
+		NULL, "stats", 0, 1, "print phase timings and counters to stderr");
+	argtable[4] = cmdargs.jobs = arg_intn(
+		"j", "jobs", "<n>", 0, 1,
+		"use up to n threads, across files or within one (default 1)");
+	argtable[5] = cmdargs.format = arg_strn(
+		NULL, "format", "elf|bin|ihex", 0, 1,
+		"output an ELF object, flat binary or Intel HEX (default elf)");
+	argtable[6] = cmdargs.compress = arg_litn(
+		NULL, "compress", 0, 1,
+		"use compressed instructions wherever possible");
+	argtable[7] = cmdargs.server = arg_strn(
+		NULL, "server", "<socket>", 0, 1,
+		"serve assemblies for --connect on a unix socket");
+	argtable[8] = cmdargs.connect = arg_strn(
+		NULL, "connect", "<socket>", 0, 1,
+		"hand the assembly to a server, if one is running");
+	argtable[9] = cmdargs.cachedir = arg_strn(
+		NULL, "cache-dir", "<dir>", 0, 1,
+		"reuse objects assembled before from identical sources");
+	argtable[10] = cmdargs.cachesize = arg_intn(
+		NULL, "cache-size", "<MiB>", 0, 1,
+		"drop the least recently used objects past this (default 256)");
+	argtable[11] = cmdargs.inputfile = arg_filen(
+		NULL, NULL, "<input>", 0, MAX_INPUT_FILES, "input file(s)");
+	argtable[12] = cmdargs.outputfile = arg_filen(
+		"o", "output", "<filename>", 0, 1,
+		"output file, or directory when given several inputs");
+	argtable[13] = cmdargs.end = arg_end(20);
 
 	int nerrors = arg_parse(argc, argv, argtable);
 
@@ -45,27 +78,53 @@ void parse_cmdargs(int argc, char *argv[])
 		arg_print_syntax(stdout, argtable, "\n");
 		puts(helpstr);
 		arg_print_glossary(stdout, argtable, "  %-25s %s\n");
-		exit(EXIT_SUCCESS);
+		return EXIT_SUCCESS;
 	}
 
 	if (cmdargs.version->count) {
 		printf("%s version %d.%d.%d %s\n", progname, versioninfo.major,
 		       versioninfo.minor, versioninfo.patch, versioninfo.note);
-		exit(EXIT_SUCCESS);
+		return EXIT_SUCCESS;
 	}
 
-	if (cmdargs.inputfile->count > 1 || cmdargs.outputfile->count > 1)
-		nerrors++;
-
 	if (nerrors) {
 		arg_print_errors(stdout, cmdargs.end, progname);
 		printf("Try '%s --help' for more information\n", progcall);
-		exit(EXIT_FAILURE);
+		return EXIT_FAILURE;
 	}
 
+	if (cmdargs.server->count && cmdargs.connect->count)
+		logger(ERROR, error_invalid_syntax,
+		       "A server cannot connect to another server");
+	/* a server is only told what to assemble by its requests */
+	if (!cmdargs.server->count && !cmdargs.inputfile->count)
+		logger(ERROR, error_invalid_syntax, "No input file given");
+	if (!cmdargs.server->count && !cmdargs.outputfile->count)
+		logger(ERROR, error_invalid_syntax,
+		       "No output file given, see --output");
+	if (cmdargs.jobs->count && *cmdargs.jobs->ival < 1)
+		logger(ERROR, error_invalid_syntax,
+		       "The number of jobs must be at least 1");
+	if (cmdargs.cachesize->count && *cmdargs.cachesize->ival < 1)
+		logger(ERROR, error_invalid_syntax,
+		       "The cache size must be at least 1 MiB");
+	cmdargs.outputformat = FORMAT_ELF;
+	if (cmdargs.format->count &&
+	    parse_output_format(*cmdargs.format->sval, &cmdargs.outputformat))
+		logger(ERROR, error_invalid_syntax,
+		       "Unknown output format %s (expected elf, bin or ihex)",
+		       *cmdargs.format->sval);
+	if (cmdargs.inputfile->count > 1 && !**cmdargs.outputfile->filename)
+		logger(ERROR, error_invalid_syntax,
+		       "An output directory is needed for several input files");
+
 	if (cmdargs.verbose->count) {
+		if (WRASM_LOG_LEVEL > DEBUG)
+			logger(WARN, no_error,
+			       "Debug messages are disabled in this build");
 		set_min_loglevel(DEBUG);
 	}
+	return get_clean_exit(ERROR) ? EXIT_FAILURE : -1;
 }
 
 static void free_argtable(void)
@@ -1,124 +1,243 @@
-
 #include "bytecode.h"
 
 #include <stddef.h>
 #include <stdlib.h>
 
+#include "context.h"
 #include "debug.h"
 #include "elf/output.h"
+#include "elf/reloc.h"
 #include "form/generic.h"
+#include "parallel.h"
+#include "stats.h"
 #include "symbols.h"
 #include "xmalloc.h"
 
-static struct instruction *instructions = NULL;
-static size_t instructions_size = 0;
-static struct rawdata *dataitems = NULL;
-static size_t dataitems_size = 0;
+#define QUEUE_MIN_CAPACITY 64
+/* rough number of source bytes per instruction, used to size the queue */
+#define SOURCE_BYTES_PER_INSTRUCTION 16
+/* fewer instructions than this aren't worth starting another thread for */
+#define ENCODE_MIN_PER_THREAD 4096
 
-int add_instruction(struct instruction instruction)
+/* grows an array geometrically so that it can hold at least `needed` items */
+static void *reserve_array(void *arr, size_t *capacity, size_t needed,
+			   size_t itemsize)
 {
-	const size_t sz = instructions_size + 1;
-	instructions = xrealloc(instructions, sz * sizeof(*instructions));
-	instructions[instructions_size] = instruction;
-	instructions_size = sz;
+	if (needed <= *capacity)
+		return arr;
 
-	return 0;
+	size_t newcapacity = *capacity ? *capacity : QUEUE_MIN_CAPACITY;
+	while (newcapacity < needed)
+		newcapacity *= 2;
+
+	arr = xrealloc(arr, newcapacity * itemsize);
+	*capacity = newcapacity;
+	return arr;
 }
 
-int add_data(struct rawdata dataitem)
+void reserve_instructions(struct wrasm_ctx *ctx, size_t count)
 {
-	const size_t sz = dataitems_size + 1;
-	struct rawdata *newdataarr =
-		xrealloc(dataitems, sz * sizeof(*dataitems));
+	ctx->instructions = reserve_array(ctx->instructions,
+					  &ctx->instructions_capacity, count,
+					  sizeof(*ctx->instructions));
+}
 
-	if (newdataarr == NULL) {
-		logger(ERROR, error_internal, 0,
-		       "Unable to allocate memory for label instruction");
-		return 1;
-	}
+void reserve_source(struct wrasm_ctx *ctx, size_t size)
+{
+	reserve_instructions(ctx, size / SOURCE_BYTES_PER_INSTRUCTION);
+}
+
+int add_instruction(struct wrasm_ctx *ctx, struct instruction instruction)
+{
+	if (ctx->instructions_size == ctx->instructions_capacity)
+		reserve_instructions(ctx, ctx->instructions_size + 1);
+	ctx->instructions[ctx->instructions_size++] = instruction;
+	count_stat(&ctx->stats, STAT_INSTRUCTIONS, 1);
+	if (instruction.formation.idata.sz == 2)
+		ctx->rvc = true;
+
+	return 0;
+}
 
-	dataitems = newdataarr;
-	dataitems[dataitems_size] = dataitem;
-	dataitems_size = sz;
+int add_data(struct wrasm_ctx *ctx, struct rawdata dataitem)
+{
+	if (ctx->dataitems_size == ctx->dataitems_capacity)
+		ctx->dataitems = reserve_array(ctx->dataitems,
+					       &ctx->dataitems_capacity,
+					       ctx->dataitems_size + 1,
+					       sizeof(*ctx->dataitems));
+	ctx->dataitems[ctx->dataitems_size++] = dataitem;
+	count_stat(&ctx->stats, STAT_DATA, 1);
 
 	return 0;
 }
 
-int write_all(void)
+int write_all(struct wrasm_ctx *ctx)
 {
-	if (write_all_instructions())
+	if (write_all_instructions(ctx))
 		return 1;
-	if (write_all_data())
+	if (write_all_data(ctx))
 		return 1;
 	return 0;
 }
 
-int write_all_instructions(void)
+static int write_instructions(struct wrasm_ctx *ctx, size_t begin, size_t end)
 {
-	linenumber = 0;
-	logger(DEBUG, no_error, "Generating all instruction bytecode...");
-	for (size_t i = 0; i < instructions_size; i++)
-		if (write_instruction(instructions[i]))
+	for (size_t i = begin; i < end; i++)
+		if (write_instruction(ctx, ctx->instructions[i]))
 			return 1;
 	return 0;
 }
 
-int write_instruction(struct instruction i)
+/*
+ * A range of the queue encoded against its own copy of the context. Encoding
+ * only writes section contents at each instruction's own position, everything
+ * else it adds goes to the copy: relocations, stats and held messages. These
+ * are merged back in queue order once every range is done, so the output is
+ * the same however the queue was split.
+ */
+struct encoder {
+	struct wrasm_ctx ctx;
+	struct message_log messages;
+	size_t begin;
+	size_t end;
+	int err;
+};
+
+static void init_encoder(struct encoder *enc, const struct wrasm_ctx *ctx,
+			 size_t begin, size_t end)
+{
+	*enc = (struct encoder){
+		.ctx = *ctx,
+		.messages = { .messages = NULL },
+		.begin = begin,
+		.end = end,
+	};
+	enc->ctx.relocations = NULL;
+	enc->ctx.relocations_size = 0;
+	enc->ctx.relocations_capacity = 0;
+	enc->ctx.stats = (struct stats){ .counters = { 0 } };
+	enc->ctx.diagnostics.held = &enc->messages;
+}
+
+static void encode_range(void *arg)
+{
+	struct encoder *enc = arg;
+	struct diagnostics *prev = use_diagnostics(&enc->ctx.diagnostics);
+	enc->err = write_instructions(&enc->ctx, enc->begin, enc->end);
+	use_diagnostics(prev);
+}
+
+/*
+ * A serial encode stops at the first failing instruction, so nothing from the
+ * ranges after a failed one is kept. Returns whether any range so far failed.
+ */
+static int merge_encoder(struct wrasm_ctx *ctx, struct encoder *enc, int err)
+{
+	if (!err) {
+		replay_messages(&enc->messages);
+		append_relocations(ctx, &enc->ctx);
+		for (int i = 0; i < STAT_COUNT; i++)
+			ctx->stats.counters[i] += enc->ctx.stats.counters[i];
+		ctx->outputsection = enc->ctx.outputsection;
+	}
+	free_messages(&enc->messages);
+	free_relocations(&enc->ctx);
+	return err || enc->err;
+}
+
+static int write_parallel(struct wrasm_ctx *ctx, unsigned threads)
 {
-	linenumber = i.line;
+	const size_t count = ctx->instructions_size;
+	struct encoder *encoders = xmalloc(threads * sizeof(*encoders));
+	for (unsigned i = 0; i < threads; i++)
+		init_encoder(&encoders[i], ctx, count * i / threads,
+			     count * (i + 1) / threads);
+
+	run_parallel(&encode_range, encoders, sizeof(*encoders), threads);
+
+	int err = 0;
+	for (unsigned i = 0; i < threads; i++)
+		err = merge_encoder(ctx, &encoders[i], err);
+	free(encoders);
+	return err;
+}
+
+/* verbose output stays on one thread, rather than holding all of it back */
+static unsigned encode_threads(const struct wrasm_ctx *ctx)
+{
+	if (minloglevel < WARN)
+		return 1;
+	size_t threads = ctx->instructions_size / ENCODE_MIN_PER_THREAD;
+	if (threads > ctx->threads)
+		threads = ctx->threads;
+	return usable_threads((unsigned)threads);
+}
+
+int write_all_instructions(struct wrasm_ctx *ctx)
+{
+	ctx->diagnostics.line = 0;
+	logger(DEBUG, no_error, "Generating all instruction bytecode...");
+	const unsigned threads = encode_threads(ctx);
+	if (threads > 1)
+		return write_parallel(ctx, threads);
+	return write_instructions(ctx, 0, ctx->instructions_size);
+}
+
+int write_instruction(struct wrasm_ctx *ctx, struct instruction i)
+{
+	ctx->diagnostics.line = i.line;
 	logger(DEBUG, no_error,
 	       "Generating bytecode for %s instruction (offset: %zu)",
 	       i.formation.name, i.position.offset);
-	set_section(i.position.section);
+	set_section(ctx, i.position.section);
 
-	if (i.args.sym)
-		if (i.args.sym->section == SECTION_NULL)
+	if (i.args.sym != NO_SYMBOL) {
+		const struct symbol *sym = get_symbol_at(ctx, i.args.sym);
+		if (sym->section == SECTION_NULL && !ctx->relocatable)
 			logger(ERROR, error_unknown, "Symbol %s not found",
-			       i.args.sym->name);
-
-	struct bytecode bytecode =
-		i.formation.form_handler(i.formation.name, i.formation.idata,
-					 i.args, calc_fileoffset(i.position));
-	logger(DEBUG, no_error, "Bytecode finished generating");
-	if (!bytecode.size) {
-		logger(WARN, no_error,
-		       "No bytecode generated from instruction");
-		return 0;
+			       get_symbol_name(ctx, sym));
 	}
-	if (!bytecode.data) {
-		logger(ERROR, error_internal, "Received invalid bytecode");
+
+	unsigned char *out =
+		get_sectiondata(ctx, i.position, i.formation.idata.sz);
+	if (!out) {
+		logger(CRITICAL, error_system, "Error writing bytes to output");
 		return 1;
 	}
-	const size_t sz = (size_t)bytecode.size;
-	size_t nwritten =
-		write_sectiondata((char *)bytecode.data, sz, i.position);
-	free(bytecode.data);
-	if (nwritten != sz) {
-		logger(CRITICAL, error_system, "Error writing bytes to output");
+
+	const size_t sz = i.formation.form_handler(
+		ctx, i.formation.name, i.formation.idata, i.args,
+		calc_fileoffset(ctx, i.position), out);
+	logger(DEBUG, no_error, "Bytecode finished generating");
+	if (sz == FORM_ERROR) {
+		logger(ERROR, error_internal, "Received invalid bytecode");
 		return 1;
 	}
+	if (!sz)
+		logger(WARN, no_error,
+		       "No bytecode generated from instruction");
 	return 0;
 }
 
-int write_all_data(void)
+int write_all_data(struct wrasm_ctx *ctx)
 {
-	linenumber = 0;
+	ctx->diagnostics.line = 0;
 	logger(DEBUG, no_error, "Writing all data bytes...");
-	for (size_t i = 0; i < dataitems_size; i++)
-		if (write_data(dataitems[i]))
+	for (size_t i = 0; i < ctx->dataitems_size; i++)
+		if (write_data(ctx, ctx->dataitems[i]))
 			return 1;
 	return 0;
 }
 
-int write_data(struct rawdata data)
+int write_data(struct wrasm_ctx *ctx, struct rawdata data)
 {
-	linenumber = data.line;
+	ctx->diagnostics.line = data.line;
 	logger(DEBUG, no_error, "Writing data (offset: %zu)",
 	       data.position.offset);
-	set_section(data.position.section);
+	set_section(ctx, data.position.section);
 	const size_t written =
-		write_sectiondata(data.data, data.size, data.position);
-	free(data.data);
+		write_sectiondata(ctx, data.data, data.size, data.position);
 	if (written != data.size) {
 		logger(CRITICAL, error_system, "Error writing bytes to output");
 		return 1;
@@ -126,16 +245,18 @@ int write_data(struct rawdata data)
 	return 0;
 }
 
-void free_instructions(void)
+void free_instructions(struct wrasm_ctx *ctx)
 {
-	free(instructions);
-	instructions = NULL;
-	instructions_size = 0;
+	free(ctx->instructions);
+	ctx->instructions = NULL;
+	ctx->instructions_size = 0;
+	ctx->instructions_capacity = 0;
 }
 
-void free_data(void)
+void free_data(struct wrasm_ctx *ctx)
 {
-	free(dataitems);
-	dataitems = NULL;
-	dataitems_size = 0;
+	free(ctx->dataitems);
+	ctx->dataitems = NULL;
+	ctx->dataitems_size = 0;
+	ctx->dataitems_capacity = 0;
 }
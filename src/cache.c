@@ -0,0 +1,284 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_POSIX_IO
+#endif
+
+#include "cache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_POSIX_IO
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "args.h"
+#include "debug.h"
+#include "files.h"
+#include "input.h"
+#include "sha256.h"
+#include "xmalloc.h"
+
+#ifdef HAVE_POSIX_IO
+
+/* changed whenever keys stop covering everything that affects the output */
+#define CACHE_FORMAT 2
+#define CACHE_SUBDIRS 16
+#define COPY_CHUNK_SIZE 65536
+#define ENTRIES_MIN_CAPACITY 64
+
+struct entry {
+	char *path;
+	size_t size;
+	time_t used;
+};
+
+static void start_key(struct sha256 *sha, enum output_format format,
+		      bool compress)
+{
+	const uint64_t options[] = {
+		CACHE_FORMAT,
+		(uint64_t)versioninfo.major,
+		(uint64_t)versioninfo.minor,
+		(uint64_t)versioninfo.patch,
+		(uint64_t)format,
+		(uint64_t)compress,
+	};
+	init_sha256(sha);
+	update_sha256(sha, options, sizeof(options));
+	update_sha256(sha, versioninfo.note, strlen(versioninfo.note) + 1);
+}
+
+static void finish_key(struct cache_key *key, struct sha256 *sha)
+{
+	unsigned char digest[SHA256_LENGTH];
+	finish_sha256(sha, digest);
+	for (size_t i = 0; i < SHA256_LENGTH; i++)
+		snprintf(key->hex + 2 * i, 3, "%02x", digest[i]);
+}
+
+int cache_key(struct cache_key *key, const struct input *input,
+	      enum output_format format, bool compress)
+{
+	if (input->source != INPUT_MAPPED)
+		return 1;
+
+	key->format = format;
+	key->compress = compress;
+	struct sha256 sha;
+	start_key(&sha, format, compress);
+	update_sha256(&sha, input->data, input->size);
+	finish_key(key, &sha);
+	return 0;
+}
+
+bool source_unchanged(const struct cache_key *key, FILE *stream)
+{
+	struct sha256 sha;
+	start_key(&sha, key->format, key->compress);
+
+	rewind(stream);
+	char *buf = xmalloc(COPY_CHUNK_SIZE);
+	for (size_t got; (got = fread(buf, 1, COPY_CHUNK_SIZE, stream));)
+		update_sha256(&sha, buf, got);
+	free(buf);
+	if (ferror(stream))
+		return false;
+
+	struct cache_key again;
+	finish_key(&again, &sha);
+	return !strcmp(again.hex, key->hex);
+}
+
+static char *join_path(const char *dir, const char *name, size_t namelen)
+{
+	const size_t dirlen = strlen(dir);
+	char *path = xmalloc(dirlen + namelen + 2);
+	memcpy(path, dir, dirlen);
+	path[dirlen] = '/';
+	memcpy(path + dirlen + 1, name, namelen);
+	path[dirlen + namelen + 1] = '\0';
+	return path;
+}
+
+static char *subdir_path(const struct cache *cache,
+			 const struct cache_key *key)
+{
+	return join_path(cache->dir, key->hex, 1);
+}
+
+static char *entry_path(const struct cache *cache, const struct cache_key *key)
+{
+	char *subdir = subdir_path(cache, key);
+	char *path = join_path(subdir, key->hex, CACHE_KEY_LENGTH);
+	free(subdir);
+	return path;
+}
+
+/* written next to `to` and renamed over it, as assembled outputs are */
+static int copy_file(FILE *from, const char *to)
+{
+	char *tempname;
+	FILE *out = open_temp_output(to, &tempname);
+	if (!out) {
+		discard_temp_output(tempname);
+		return 1;
+	}
+
+	char *buf = xmalloc(COPY_CHUNK_SIZE);
+	int err = 0;
+	for (size_t got; !err && (got = fread(buf, 1, COPY_CHUNK_SIZE, from));)
+		err = fwrite(buf, 1, got, out) != got;
+	free(buf);
+	if (err || ferror(from)) {
+		fclose(out);
+		discard_temp_output(tempname);
+		return 1;
+	}
+	return commit_temp_output(out, tempname, to);
+}
+
+int fetch_cached(const struct cache *cache, const struct cache_key *key,
+		 const char *output)
+{
+	char *path = entry_path(cache, key);
+	FILE *f;
+	const int missing = open_file(&f, path, "rb");
+	free(path);
+	if (missing)
+		return 1;
+
+	/* entries are evicted in the order they were last used */
+	futimens(fileno(f), NULL);
+	const int err = copy_file(f, output);
+	fclose(f);
+	return err;
+}
+
+static int least_recent(const void *a, const void *b)
+{
+	const struct entry *x = a;
+	const struct entry *y = b;
+	if (x->used != y->used)
+		return x->used < y->used ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+/*
+ * Removes the entries used least recently until the subdirectory fits in
+ * `limit` bytes. Left over temporary files count as entries, so that they are
+ * cleared away eventually as well.
+ */
+static void evict(const char *subdir, size_t limit)
+{
+	DIR *dir = opendir(subdir);
+	if (!dir)
+		return;
+
+	struct entry *entries = NULL;
+	size_t count = 0, capacity = 0, total = 0;
+	for (struct dirent *ent; (ent = readdir(dir));) {
+		const char *name = ent->d_name;
+		if (name[0] == '.')
+			continue;
+		char *path = join_path(subdir, name, strlen(name));
+		struct stat st;
+		if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+			free(path);
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2
+					    : ENTRIES_MIN_CAPACITY;
+			entries = xrealloc(entries,
+					   capacity * sizeof(*entries));
+		}
+		entries[count++] = (struct entry){
+			.path = path,
+			.size = (size_t)st.st_size,
+			.used = st.st_mtime,
+		};
+		total += (size_t)st.st_size;
+	}
+	closedir(dir);
+
+	if (total > limit)
+		qsort(entries, count, sizeof(*entries), &least_recent);
+	/* an entry someone else removed first has made room all the same */
+	for (size_t i = 0; i < count && total > limit; i++) {
+		remove(entries[i].path);
+		total -= entries[i].size;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		free(entries[i].path);
+	free(entries);
+}
+
+void store_cached(const struct cache *cache, const struct cache_key *key,
+		  const char *output)
+{
+	char *subdir = subdir_path(cache, key);
+	/* both are usually there already, anything else fails the copy */
+	mkdir(cache->dir, 0777);
+	mkdir(subdir, 0777);
+
+	char *path = entry_path(cache, key);
+	FILE *f;
+	int err = open_file(&f, output, "rb");
+	if (!err) {
+		err = copy_file(f, path);
+		fclose(f);
+	}
+	free(path);
+
+	if (err)
+		logger(WARN, error_system,
+		       "Unable to add %s to the cache in %s", output,
+		       cache->dir);
+	else
+		evict(subdir, cache->limit / CACHE_SUBDIRS);
+	free(subdir);
+}
+
+#else
+
+/* nothing is ever cached without a way to list and date the entries */
+int cache_key(struct cache_key *key, const struct input *input,
+	      enum output_format format, bool compress)
+{
+	(void)key;
+	(void)input;
+	(void)format;
+	(void)compress;
+	return 1;
+}
+
+bool source_unchanged(const struct cache_key *key, FILE *stream)
+{
+	(void)key;
+	(void)stream;
+	return false;
+}
+
+int fetch_cached(const struct cache *cache, const struct cache_key *key,
+		 const char *output)
+{
+	(void)cache;
+	(void)key;
+	(void)output;
+	return 1;
+}
+
+void store_cached(const struct cache *cache, const struct cache_key *key,
+		  const char *output)
+{
+	(void)cache;
+	(void)key;
+	(void)output;
+}
+
+#endif
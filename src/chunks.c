@@ -0,0 +1,231 @@
+#include "chunks.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "context.h"
+#include "debug.h"
+#include "directives.h"
+#include "elf/output.h"
+#include "generation.h"
+#include "input.h"
+#include "lexer.h"
+#include "parallel.h"
+#include "stats.h"
+#include "symbols.h"
+#include "xmalloc.h"
+
+/* smaller pieces of input aren't worth starting another thread for */
+#define CHUNK_MIN_SIZE ((size_t)1 << 18)
+
+/*
+ * A piece of the input parsed into a context of its own. Positions in the
+ * context are relative to the start of the piece, and symbols are only those
+ * it mentions, so both are fixed up as it is merged.
+ */
+struct chunk {
+	struct wrasm_ctx ctx;
+	struct message_log messages;
+	const char *text;
+	size_t len;
+	int err;
+};
+
+unsigned count_chunks(const struct wrasm_ctx *ctx, const struct input *input)
+{
+	/* verbose output would all have to be held back until the merge */
+	if (input->source == INPUT_STREAM || minloglevel < WARN)
+		return 1;
+	size_t chunks = input->size / CHUNK_MIN_SIZE;
+	if (chunks > ctx->threads)
+		chunks = ctx->threads;
+	return usable_threads((unsigned)chunks);
+}
+
+static bool mentions_section(const char *line, size_t len)
+{
+	static const char directive[] = ".section";
+	const size_t dlen = sizeof(directive) - 1;
+	for (size_t i = 0; i + dlen <= len; i++)
+		if (line[i] == '.' && !memcmp(line + i, directive, dlen))
+			return true;
+	return false;
+}
+
+/*
+ * Follows the section selected and the line number through a chunk, without
+ * parsing it. Only the lines mentioning .section are tokenized, and anything
+ * wrong with them is left to be reported when the chunk is parsed.
+ */
+static void scan_chunk(const struct chunk *chunk, enum sections *section,
+		       size_t *line)
+{
+	const char *pos = chunk->text;
+	const char *end = chunk->text + chunk->len;
+	while (pos < end) {
+		const char *newline = memchr(pos, '\n', (size_t)(end - pos));
+		/* only the last line of the input is unterminated */
+		if (!newline)
+			return;
+		(*line)++;
+
+		struct tokenline tokens;
+		if (mentions_section(pos, (size_t)(newline - pos)) &&
+		    !tokenize(pos, &tokens))
+			*section = scan_section(tokens.tokens, tokens.count,
+						*section);
+		pos = newline + 1;
+	}
+}
+
+static void init_chunk(struct chunk *chunk, const struct wrasm_ctx *ctx,
+		       enum sections section, size_t line)
+{
+	init_context(&chunk->ctx);
+	chunk->ctx.outputsection = section;
+	chunk->ctx.relocatable = ctx->relocatable;
+	chunk->ctx.compress = ctx->compress;
+	chunk->ctx.diagnostics.line = line;
+	chunk->ctx.diagnostics.source = ctx->diagnostics.source;
+	chunk->ctx.diagnostics.keep_going = ctx->diagnostics.keep_going;
+	chunk->ctx.diagnostics.held = &chunk->messages;
+	chunk->messages = (struct message_log){ .messages = NULL };
+	chunk->err = 0;
+}
+
+static void parse_chunk(void *arg)
+{
+	struct chunk *chunk = arg;
+	struct diagnostics *prev = use_diagnostics(&chunk->ctx.diagnostics);
+
+	struct input input;
+	open_input_buffer(&input, chunk->text, chunk->len);
+	reserve_source(&chunk->ctx, chunk->len);
+	chunk->err = parse_input(&chunk->ctx, &input);
+	close_input(&input);
+
+	use_diagnostics(prev);
+}
+
+/*
+ * Symbols are looked up by name in the order the chunk first mentioned them,
+ * so they are created in the same order as a line by line parse would. Later
+ * definitions replace earlier ones, as parse_label() does.
+ */
+static int merge_symbols(struct wrasm_ctx *ctx, struct wrasm_ctx *from,
+			 const size_t *base, size_t *indices)
+{
+	for (size_t i = 0; i < from->symbols.count; i++) {
+		const struct symbol *sym = get_symbol_at(from, i);
+		const char *name = get_symbol_name(from, sym);
+		struct symbol *merged = get_or_create_symbol(
+			ctx, name, strlen(name), sym->type);
+		if (!merged)
+			return 1;
+		if (sym->section != SECTION_NULL) {
+			merged->section = sym->section;
+			merged->value = sym->value + (long)base[sym->section];
+		}
+		if (sym->binding != ELF_SYM_LOCAL)
+			merged->binding = sym->binding;
+		indices[i] = get_symbol_index(ctx, merged);
+	}
+	return 0;
+}
+
+static int merge_chunk(struct wrasm_ctx *ctx, struct chunk *chunk)
+{
+	struct wrasm_ctx *from = &chunk->ctx;
+
+	size_t base[SECTION_COUNT];
+	for (int i = 0; i < SECTION_COUNT; i++)
+		base[i] = get_section_size(ctx, i);
+
+	size_t *indices = xmalloc((from->symbols.count + 1) * sizeof(*indices));
+	if (merge_symbols(ctx, from, base, indices)) {
+		free(indices);
+		return 1;
+	}
+
+	reserve_instructions(ctx,
+			     ctx->instructions_size + from->instructions_size);
+	for (size_t i = 0; i < from->instructions_size; i++) {
+		struct instruction instruction = from->instructions[i];
+		instruction.position.offset +=
+			base[instruction.position.section];
+		if (instruction.args.sym != NO_SYMBOL)
+			instruction.args.sym = indices[instruction.args.sym];
+		add_instruction(ctx, instruction);
+	}
+	free(indices);
+
+	/* the data payloads live in the chunk's arena */
+	arena_adopt(&ctx->arena, &from->arena);
+	for (size_t i = 0; i < from->dataitems_size; i++) {
+		struct rawdata data = from->dataitems[i];
+		data.position.offset += base[data.position.section];
+		add_data(ctx, data);
+	}
+
+	for (int i = 0; i < SECTION_COUNT; i++)
+		inc_outputsize(ctx, i, get_section_size(from, i));
+	ctx->outputsection = from->outputsection;
+
+	/* everything else was counted again as it was added */
+	count_stat(&ctx->stats, STAT_SYMBOL_LOOKUPS,
+		   from->stats.counters[STAT_SYMBOL_LOOKUPS]);
+	count_stat(&ctx->stats, STAT_SYMBOL_PROBES,
+		   from->stats.counters[STAT_SYMBOL_PROBES]);
+	return 0;
+}
+
+int parse_chunks(struct wrasm_ctx *ctx, struct input *input, unsigned count)
+{
+	struct chunk *chunks = xmalloc(count * sizeof(*chunks));
+
+	struct message_log discarded = { .messages = NULL };
+	struct diagnostics scanning = { .held = &discarded };
+	struct diagnostics *prev = use_diagnostics(&scanning);
+
+	/* split evenly by size, then move each split on to the next line */
+	size_t start = 0;
+	enum sections section = ctx->outputsection;
+	size_t line = ctx->diagnostics.line;
+	for (unsigned i = 0; i < count; i++) {
+		size_t split = input->size * (i + 1) / count;
+		if (split < start)
+			split = start;
+		const char *newline =
+			memchr(input->data + split, '\n', input->size - split);
+		if (i + 1 == count || !newline)
+			split = input->size;
+		else
+			split = (size_t)(newline - input->data) + 1;
+
+		chunks[i].text = input->data + start;
+		chunks[i].len = split - start;
+		init_chunk(&chunks[i], ctx, section, line);
+		if (i + 1 < count)
+			scan_chunk(&chunks[i], &section, &line);
+		start = split;
+	}
+	use_diagnostics(prev);
+	free_messages(&discarded);
+
+	run_parallel(&parse_chunk, chunks, sizeof(*chunks), count);
+
+	/* a line by line parse would never get past the first failure */
+	int err = 0;
+	for (unsigned i = 0; i < count; i++) {
+		if (!err) {
+			replay_messages(&chunks[i].messages);
+			ctx->diagnostics.line = chunks[i].ctx.diagnostics.line;
+			err = chunks[i].err || merge_chunk(ctx, &chunks[i]);
+		}
+		free_messages(&chunks[i].messages);
+		free_context(&chunks[i].ctx);
+	}
+	free(chunks);
+	return err;
+}
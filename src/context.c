@@ -0,0 +1,47 @@
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "elf/reloc.h"
+#include "symbols.h"
+#include "xmalloc.h"
+
+void init_context(struct wrasm_ctx *ctx)
+{
+	*ctx = (struct wrasm_ctx){
+		.symbols = { .count = 0, .data = NULL, .slots = NULL },
+		.instructions = NULL,
+		.dataitems = NULL,
+		.outputsection = SECTION_TEXT,
+		.relocatable = true,
+		.relocations = NULL,
+		.threads = 1,
+		.arena = { .block = NULL },
+		.timer = { .phase = PHASE_NONE },
+	};
+}
+
+void free_context(struct wrasm_ctx *ctx)
+{
+	free_instructions(ctx);
+	free_data(ctx);
+	free_symbols(ctx);
+	free_relocations(ctx);
+	arena_release(&ctx->arena);
+}
+
+void reset_context(struct wrasm_ctx *ctx)
+{
+	ctx->instructions_size = 0;
+	ctx->dataitems_size = 0;
+	ctx->relocations_size = 0;
+	clear_symbols(ctx);
+	arena_reset(&ctx->arena);
+
+	ctx->outputsection = SECTION_TEXT;
+	memset(ctx->sections, 0, sizeof(ctx->sections));
+	ctx->pcrel_labels = 0;
+	ctx->rvc = false;
+}
@@ -1,13 +1,21 @@
 
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_FLOCKFILE
+#endif
+
 #include "debug.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "args.h"
+#include "xmalloc.h"
+
+#define MESSAGES_MIN_CAPACITY 16
 
-size_t linenumber;
+static THREAD_LOCAL struct diagnostics thread_diagnostics = { .line = 0 };
+static THREAD_LOCAL struct diagnostics *active_diagnostics = NULL;
 
 const char *level_names[6] = {
 	"debug", "info", "warning", "error", "critical", "none",
@@ -20,9 +28,10 @@ const char *level_colours[6] = {
 	"\033[1;31;1m",
 	"\033[1m",
 };
-size_t level_instances[6] = { 0 };
 
-static enum loglvl_t minloglevel = WARN;
+const char progname[] = "wrasm";
+
+enum loglvl_t minloglevel = WARN;
 static enum loglvl_t exitloglevel = ERROR;
 
 void set_min_loglevel(enum loglvl_t level)
@@ -39,20 +48,79 @@ void set_exit_loglevel(enum loglvl_t level)
 	       level_colours[exitloglevel], level_names[exitloglevel]);
 }
 
-void logger(enum loglvl_t level, enum error_t id, const char *format, ...)
+static struct diagnostics *current_diagnostics(void)
+{
+	return active_diagnostics ? active_diagnostics : &thread_diagnostics;
+}
+
+struct diagnostics *use_diagnostics(struct diagnostics *diag)
+{
+	struct diagnostics *prev = active_diagnostics;
+	active_diagnostics = diag;
+	return prev;
+}
+
+static void hold_message(struct message_log *log, enum loglvl_t level,
+			 enum error_t id, size_t line, const char *format,
+			 va_list params)
+{
+	va_list measure;
+	va_copy(measure, params);
+	const int len = vsnprintf(NULL, 0, format, measure);
+	va_end(measure);
+
+	char *text = NULL;
+	if (len >= 0) {
+		text = xmalloc((size_t)len + 1);
+		vsnprintf(text, (size_t)len + 1, format, params);
+	}
+
+	if (log->size == log->capacity) {
+		log->capacity = log->capacity ? 2 * log->capacity :
+						MESSAGES_MIN_CAPACITY;
+		log->messages =
+			xrealloc(log->messages,
+				 log->capacity * sizeof(*log->messages));
+	}
+	log->messages[log->size++] = (struct held_message){
+		.level = level,
+		.id = id,
+		.line = line,
+		.text = text,
+	};
+}
+
+void log_message(enum loglvl_t level, enum error_t id, const char *format,
+		 ...)
 {
-	level_instances[level]++;
+	struct diagnostics *diag = current_diagnostics();
+	if (diag->held) {
+		va_list held_params;
+		va_start(held_params, format);
+		hold_message(diag->held, level, id, diag->line, format,
+			     held_params);
+		va_end(held_params);
+		return;
+	}
+
+	diag->counts[level]++;
 	if (level < minloglevel)
 		return;
 
 	FILE *out = stderr;
+#ifdef HAVE_FLOCKFILE
+	/* keep messages from different jobs on separate lines */
+	flockfile(out);
+#endif
 
 	fprintf(out, "%s: %s0x%.02x\033[0m / %s%s\033[0m ", progname,
 		level_colours[level], id, level_colours[level],
 		level_names[level]);
-	if (linenumber)
+	if (diag->source)
+		fprintf(out, "- %s ", diag->source);
+	if (diag->line)
 		fprintf(out, "- %sL%lu\033[0m ", level_colours[level],
-			(unsigned long)linenumber);
+			(unsigned long)diag->line);
 
 	va_list format_params;
 	va_start(format_params, format);
@@ -60,15 +128,39 @@ void logger(enum loglvl_t level, enum error_t id, const char *format, ...)
 	va_end(format_params);
 
 	putc('\n', out);
+#ifdef HAVE_FLOCKFILE
+	funlockfile(out);
+#endif
 
-	if (level >= exitloglevel)
+	if (level >= exitloglevel && !diag->keep_going)
 		exit(EXIT_FAILURE);
 }
 
+void replay_messages(const struct message_log *log)
+{
+	struct diagnostics *diag = current_diagnostics();
+	const size_t line = diag->line;
+	for (size_t i = 0; i < log->size; i++) {
+		const struct held_message *msg = &log->messages[i];
+		diag->line = msg->line;
+		log_message(msg->level, msg->id, "%s",
+			    msg->text ? msg->text : "");
+	}
+	diag->line = line;
+}
+
+void free_messages(struct message_log *log)
+{
+	for (size_t i = 0; i < log->size; i++)
+		free(log->messages[i].text);
+	free(log->messages);
+	*log = (struct message_log){ .messages = NULL };
+}
+
 int get_clean_exit(enum loglvl_t level)
 {
 	for (; level <= NODEBUG; level++)
-		if (level_instances[level])
+		if (current_diagnostics()->counts[level])
 			return 1;
 	return 0;
 }
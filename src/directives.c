@@ -1,21 +1,21 @@
 #include "directives.h"
 
-#include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "context.h"
 #include "debug.h"
 #include "elf/output.h"
 #include "bytecode.h"
+#include "lexer.h"
 #include "macros.h"
-#include "stringutil.h"
 #include "symbols.h"
 #include "xmalloc.h"
 
 struct directive {
 	const char *name;
-	int (*parser)(const char *);
+	int (*parser)(struct wrasm_ctx *, const struct operands *);
 };
 struct directive directive_map[] = {
 	{ ".string", parse_asciz }, { ".asciz", parse_asciz },
@@ -30,33 +30,41 @@ struct {
 	{ ".data", SECTION_DATA },
 };
 
-static struct directive get_directive(const char *name)
+static struct directive get_directive(const struct token *name)
 {
 	for (unsigned long i = 0; i < ARRAY_LENGTH(directive_map); i++)
-		if (!strcmp(name, directive_map[i].name))
+		if (token_equals(name, directive_map[i].name))
 			return directive_map[i];
 	logger(ERROR, error_invalid_instruction,
-	       "Unknown directive found with name: %s", name);
+	       "Unknown directive found with name: %.*s", (int)name->len,
+	       name->str);
 	return (struct directive){ NULL, NULL };
 }
 
-int parse_directive(char *line)
+int parse_directive(struct wrasm_ctx *ctx, const struct token *tokens,
+		    size_t count)
 {
-	char *directivename = line;
-	while (!isspace(*line))
-		line++;
-	if (*line)
-		*(line++) = '\0';
-
-	struct directive directive = get_directive(directivename);
+	struct directive directive = get_directive(tokens);
 
 	if (directive.parser == NULL)
 		return 1;
 
-	char *args = trim_whitespace(line);
-	const int result = directive.parser(args);
-	free(args);
-	return result;
+	struct operands args;
+	if (split_operands(tokens + 1, count - 1, &args))
+		return 1;
+	return directive.parser(ctx, &args);
+}
+
+static const struct token *expect_single(const struct operands *args,
+					 enum token_type type,
+					 const char *expected)
+{
+	if (args->count == 1 && args->operands->count == 1 &&
+	    args->operands->tokens->type == type)
+		return args->operands->tokens;
+	logger(ERROR, error_invalid_syntax, "Expected a single %s argument",
+	       expected);
+	return NULL;
 }
 
 static char get_escapedchar(const char **str)
@@ -105,12 +113,6 @@ static inline size_t parse_nulltermstr(char *dest, const char *str)
 	size_t size = 0;
 	while (*str != '"') {
 		register char val = *str;
-		if (!val) {
-			logger(ERROR, error_invalid_syntax,
-			       "Expected '\"' (0x22 double quote) character at start or end of "
-			       "ascii string");
-			return (size_t)-1;
-		}
 		if (val == '\\') {
 			str++;
 			val = get_escapedchar(&str);
@@ -125,51 +127,83 @@ static inline size_t parse_nulltermstr(char *dest, const char *str)
 	return size;
 }
 
-static int parse_ascii_generic(const char *str, bool nullterm)
+static int parse_ascii_generic(struct wrasm_ctx *ctx,
+			       const struct operands *args, bool nullterm)
 {
-	char *parsed = xmalloc(strlen(str) - 1);
-	const size_t size = parse_nulltermstr(parsed, str) - !nullterm;
-	if (size == (size_t)-1)
+	const struct token *str = expect_single(args, TOKEN_STRING, "string");
+	if (!str)
 		return 1;
-	char *data = xmalloc(size);
-	memcpy(data, parsed, size);
-	free(parsed);
-	const struct sectionpos position = get_outputpos();
-	const int res = add_data((struct rawdata){ .data = data,
-						   .size = size,
-						   .position = position,
-						   .line = linenumber });
-	inc_outputsize(position.section, size);
+	/* the token includes both quotes, leaving room for a null byte */
+	char *data = arena_alloc(&ctx->arena, str->len);
+	const size_t size = parse_nulltermstr(data, str->str) - !nullterm;
+	const struct sectionpos position = get_outputpos(ctx);
+	const struct rawdata rawdata = {
+		.data = data,
+		.size = size,
+		.position = position,
+		.line = ctx->diagnostics.line,
+	};
+	const int res = add_data(ctx, rawdata);
+	inc_outputsize(ctx, position.section, size);
 	return res;
 }
-int parse_asciz(const char *str)
+enum sections scan_section(const struct token *tokens, size_t count,
+			   enum sections current)
 {
-	return parse_ascii_generic(str, true);
+	/* labels come first, in the same way parse_tokens() skips them */
+	while (count > 1 && tokens[0].type == TOKEN_IDENTIFIER &&
+	       tokens[1].type == TOKEN_COLON) {
+		tokens += 2;
+		count -= 2;
+	}
+	if (count != 2 || !token_equals(tokens, ".section") ||
+	    tokens[1].type != TOKEN_IDENTIFIER)
+		return current;
+	for (unsigned long i = 0; i < ARRAY_LENGTH(section_map); i++)
+		if (token_equals(&tokens[1], section_map[i].name))
+			return section_map[i].section;
+	return current;
+}
+
+int parse_asciz(struct wrasm_ctx *ctx, const struct operands *args)
+{
+	return parse_ascii_generic(ctx, args, true);
 }
-int parse_ascii(const char *str)
+int parse_ascii(struct wrasm_ctx *ctx, const struct operands *args)
 {
-	return parse_ascii_generic(str, false);
+	return parse_ascii_generic(ctx, args, false);
 }
-int parse_section(const char *str)
+int parse_section(struct wrasm_ctx *ctx, const struct operands *args)
 {
-	logger(DEBUG, no_error, "Selecting Section \"%s\"", str);
+	const struct token *name =
+		expect_single(args, TOKEN_IDENTIFIER, "section name");
+	if (!name)
+		return 1;
+	logger(DEBUG, no_error, "Selecting Section \"%.*s\"", (int)name->len,
+	       name->str);
 	for (unsigned long i = 0; i < ARRAY_LENGTH(section_map); i++) {
-		if (!strcmp(str, section_map[i].name)) {
-			change_output(section_map[i].section);
+		if (token_equals(name, section_map[i].name)) {
+			change_output(ctx, section_map[i].section);
 			return 0;
 		}
 	}
-	logger(WARN, error_invalid_instruction, "Unknown Section \"%s\"", str);
+	logger(WARN, error_invalid_instruction, "Unknown Section \"%.*s\"",
+	       (int)name->len, name->str);
 	return 1;
 }
-int parse_global(const char *str)
+int parse_global(struct wrasm_ctx *ctx, const struct operands *args)
 {
-	struct symbol *sym = get_or_create_symbol(str, SYMBOL_LABEL);
+	const struct token *name =
+		expect_single(args, TOKEN_IDENTIFIER, "symbol name");
+	if (!name)
+		return 1;
+	struct symbol *sym =
+		get_or_create_symbol(ctx, name->str, name->len, SYMBOL_LABEL);
 	if (!sym) {
-		logger(ERROR, error_internal, "Uknown symbol %s encountered",
-		       str);
+		logger(ERROR, error_internal, "Uknown symbol %.*s encountered",
+		       (int)name->len, name->str);
 		return 1;
 	}
-	sym->binding = 0x10;
+	sym->binding = ELF_SYM_GLOBAL;
 	return 0;
 }
@@ -1,10 +1,23 @@
 
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_WRITEV
+#endif
+
 #include "elf/output.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_WRITEV
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "context.h"
 #include "debug.h"
 #include "elf/def.h"
 #include "symbols.h"
@@ -15,59 +28,72 @@ enum sectiontypes_e {
 	SHT_PROGBITS = 0x1,
 	SHT_SYMTAB = 0x2,
 	SHT_STRTAB = 0x3,
+	SHT_RELA = 0x4,
 };
 
-enum sections outputsection = SECTION_TEXT;
-static struct section outputsections[SECTION_COUNT] = { { .size = 0,
-							  .contents = NULL } };
+/* the info field of a relocation section holds the section it applies to */
+#define SHF_INFO_LINK 0x40
 
-static struct {
+/* the info field depends on the contents, so is kept in struct section */
+static const struct {
 	uint64_t flags;
 	uint32_t link;
-	uint32_t info;
 	uint64_t align;
 	uint64_t entrysize;
 	uint32_t type;
 } sectiondata[SECTION_COUNT] = {
-	{ 0x00, 0x0, 0x0, 0x1, 0x0, SHT_NULL },
-	{ 0x00, 0x0, 0x0, 0x1, 0x0, SHT_STRTAB }, // .strtab
-	{ 0x06, 0x0, 0x0, 0x4, 0x0, SHT_PROGBITS }, // .text
-	{ 0x03, 0x0, 0x0, 0x1, 0x0, SHT_PROGBITS }, // .data
-	{ 0x00, 0x1, 0x0, 0x8, 0x18, SHT_SYMTAB }, // .symtab
+	{ 0x00, 0x0, 0x1, 0x0, SHT_NULL },
+	{ 0x00, 0x0, 0x1, 0x0, SHT_STRTAB }, // .strtab
+	{ 0x06, 0x0, 0x4, 0x0, SHT_PROGBITS }, // .text
+	{ 0x03, 0x0, 0x1, 0x0, SHT_PROGBITS }, // .data
+	{ 0x00, 0x1, 0x8, 0x18, SHT_SYMTAB }, // .symtab
+	{ SHF_INFO_LINK, 0x4, 0x8, 0x18, SHT_RELA }, // .rela.text
+	{ SHF_INFO_LINK, 0x4, 0x8, 0x18, SHT_RELA }, // .rela.data
 };
 
 static const char *sectionnames[SECTION_COUNT] = {
-	"", ".strtab", ".text", ".data", ".symtab",
+	"", ".strtab", ".text", ".data", ".symtab", ".rela.text", ".rela.data",
 };
 
-void change_output(enum sections section)
+void change_output(struct wrasm_ctx *ctx, enum sections section)
 {
 	if (section >= SECTION_COUNT || section < 0)
 		return;
-	outputsection = section;
+	ctx->outputsection = section;
 }
 
-struct sectionpos get_outputpos(void)
+struct sectionpos get_outputpos(const struct wrasm_ctx *ctx)
 {
 	return (struct sectionpos){
-		.section = outputsection,
-		.offset = outputsections[outputsection].size
+		.section = ctx->outputsection,
+		.offset = ctx->sections[ctx->outputsection].size
 	};
 }
 
-void inc_outputsize(enum sections section, size_t amount)
+void inc_outputsize(struct wrasm_ctx *ctx, enum sections section,
+		    size_t amount)
+{
+	ctx->sections[section].size += amount;
+}
+
+void set_section(struct wrasm_ctx *ctx, enum sections section)
 {
-	outputsections[section].size += amount;
+	ctx->outputsection = section;
 }
 
-void set_section(enum sections section)
+size_t calc_fileoffset(const struct wrasm_ctx *ctx, struct sectionpos a)
 {
-	outputsection = section;
+	return ctx->sections[a.section].offset + a.offset;
 }
 
-size_t calc_fileoffset(struct sectionpos a)
+const char *get_section_name(enum sections section)
 {
-	return outputsections[a.section].offset + a.offset;
+	return sectionnames[section];
+}
+
+size_t get_section_size(const struct wrasm_ctx *ctx, enum sections section)
+{
+	return ctx->sections[section].size;
 }
 
 static inline size_t align_offset(size_t offset, size_t align)
@@ -79,26 +105,22 @@ static inline size_t align_offset(size_t offset, size_t align)
 	return offset;
 }
 
-void calc_strtab(void)
+void calc_strtab(struct wrasm_ctx *ctx)
 {
+	struct section *outputsections = ctx->sections;
 	outputsections[SECTION_STRTAB].size = 0;
 	for (int i = 0; i < SECTION_COUNT; i++)
 		outputsections[SECTION_STRTAB].size +=
 			strlen(sectionnames[i]) + 1;
-	outputsections[SECTION_STRTAB].size += calc_symtab_str_buf_size();
+	outputsections[SECTION_STRTAB].size += get_symbol_strings_size(ctx);
 }
 
-int fill_strtab(void)
+int fill_strtab(struct wrasm_ctx *ctx)
 {
-	const size_t symtab_strings_sz = calc_symtab_str_buf_size();
-	char *symtab_strings = create_symtab_str_buf(symtab_strings_sz);
-	const size_t count =
-		write_sectiondata(symtab_strings, symtab_strings_sz,
-				  (struct sectionpos){
-					  .section = SECTION_STRTAB,
-					  .offset = 0,
-				  });
-	free(symtab_strings);
+	const size_t symtab_strings_sz = get_symbol_strings_size(ctx);
+	const size_t count = write_sectiondata(
+		ctx, get_symbol_strings(ctx), symtab_strings_sz,
+		(struct sectionpos){ .section = SECTION_STRTAB, .offset = 0 });
 	if (count != symtab_strings_sz) {
 		logger(ERROR, error_internal,
 		       "Unable to write data to memory for section .strtab");
@@ -108,7 +130,7 @@ int fill_strtab(void)
 	for (int i = 0; i < SECTION_COUNT; i++) {
 		const size_t sz = strlen(sectionnames[i]) + 1;
 		const size_t written =
-			write_sectiondata(sectionnames[i], sz,
+			write_sectiondata(ctx, sectionnames[i], sz,
 					  (struct sectionpos){
 						  .section = SECTION_STRTAB,
 						  .offset = offset,
@@ -118,71 +140,122 @@ int fill_strtab(void)
 			       "Unable to write data to memory for section .strtab");
 			return 1;
 		}
-		outputsections[i].nameoffset = (uint32_t)offset;
+		ctx->sections[i].nameoffset = (uint32_t)offset;
 		offset += sz;
 	}
 	return 0;
 }
 
-void calc_symtab(void)
+/*
+ * ELF requires every local symbol to come before the global ones, with the
+ * index of the first global symbol in the info field of the table. Symbols
+ * that were never defined can only be resolved by the linker, so are global.
+ */
+void calc_symtab(struct wrasm_ctx *ctx)
 {
-	size_t sz = 0;
-	for (size_t hash = 0; hash < SYMBOLMAP_ENTRIES; hash++)
-		sz += symbols[hash].count;
-	outputsections[SECTION_SYMTAB].size =
-		(sz + 1) * sizeof(struct elf64sym);
-	sectiondata[SECTION_SYMTAB].info = (uint32_t)sz;
+	const size_t sz = ctx->symbols.count;
+	ctx->sections[SECTION_SYMTAB].size = (sz + 1) * sizeof(struct elf64sym);
+
+	uint32_t next = 1;
+	for (size_t i = 0; i < sz; i++) {
+		struct symbol *sym = get_symbol_at(ctx, i);
+		if (sym->section == SECTION_NULL)
+			sym->binding = ELF_SYM_GLOBAL;
+		if (sym->binding == ELF_SYM_LOCAL)
+			sym->symtab_index = next++;
+	}
+	ctx->sections[SECTION_SYMTAB].info = next;
+	for (size_t i = 0; i < sz; i++) {
+		struct symbol *sym = get_symbol_at(ctx, i);
+		if (sym->binding != ELF_SYM_LOCAL)
+			sym->symtab_index = next++;
+	}
 }
 
-int fill_symtab(void)
+int fill_symtab(struct wrasm_ctx *ctx)
 {
 	const struct elf64sym blank = (struct elf64sym){ 0, 0, 0, 0, 0, 0 };
-	write_sectiondata(&blank, sizeof(blank),
+	write_sectiondata(ctx, &blank, sizeof(blank),
 			  (struct sectionpos){ .section = SECTION_SYMTAB,
 					       .offset = 0 });
-	uint32_t strtab_addr = 1;
-	size_t count = 1;
-	for (size_t hash = 0; hash < SYMBOLMAP_ENTRIES; hash++) {
-		for (size_t index = 0; index < symbols[hash].count; index++) {
-			const struct symbol *sym = &symbols[hash].data[index];
-			struct elf64sym entry = (struct elf64sym){
-				.name = strtab_addr,
-				.info = sym->binding,
-				.other = 0, /* TODO: add other attributes */
-				.shndx = (uint16_t)sym->section,
-				.value = (uint64_t)sym->value,
-				.size = 0, /* TODO: support for symbol sizes? */
-			};
-			write_sectiondata(
-				&entry, sizeof(entry),
-				(struct sectionpos){ .section = SECTION_SYMTAB,
-						     .offset = count *
-							       sizeof(entry) });
-			strtab_addr += (uint32_t)sym->name_sz;
-			count++;
-		}
+	for (size_t index = 0; index < ctx->symbols.count; index++) {
+		const struct symbol *sym = get_symbol_at(ctx, index);
+		struct elf64sym entry = (struct elf64sym){
+			.name = sym->name,
+			.info = sym->binding,
+			.other = 0, /* TODO: add other attributes */
+			.shndx = (uint16_t)sym->section,
+			.value = (uint64_t)sym->value,
+			.size = 0, /* TODO: support for symbol sizes? */
+		};
+		write_sectiondata(ctx, &entry, sizeof(entry),
+				  (struct sectionpos){
+					  .section = SECTION_SYMTAB,
+					  .offset = sym->symtab_index *
+						    sizeof(entry),
+				  });
 	}
 	return 0;
 }
 
-int alloc_output(void)
+static void layout_output(struct wrasm_ctx *ctx)
 {
+	struct section *outputsections = ctx->sections;
 	size_t offset = sizeof(struct elf64header);
 	for (int i = 0; i < SECTION_COUNT; i++) {
-		outputsections[i].contents = xmalloc(outputsections[i].size);
-		logger(DEBUG, no_error, "%d bytes allocated to section (%p)",
-		       outputsections[i].size, outputsections[i].contents);
 		offset = align_offset(offset, sectiondata[i].align);
 		outputsections[i].offset = offset;
 		offset += outputsections[i].size;
 	}
 	outputsections[SECTION_NULL].offset = 0x0;
+}
+
+/* the tables are all sections other than .text and .data */
+static void alloc_sections(struct wrasm_ctx *ctx, bool tables)
+{
+	struct section *outputsections = ctx->sections;
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		if ((sectiondata[i].type != SHT_PROGBITS) != tables)
+			continue;
+		outputsections[i].contents =
+			arena_alloc(&ctx->arena, outputsections[i].size);
+		logger(DEBUG, no_error, "%d bytes allocated to section (%p)",
+		       outputsections[i].size, outputsections[i].contents);
+	}
+	layout_output(ctx);
+}
+
+int alloc_output(struct wrasm_ctx *ctx)
+{
+	alloc_sections(ctx, false);
+	return 0;
+}
+
+int alloc_tables(struct wrasm_ctx *ctx)
+{
+	alloc_sections(ctx, true);
 	return 0;
 }
 
-size_t write_sectiondata(const void *bytes, size_t count,
-			 struct sectionpos position)
+unsigned char *get_sectiondata(struct wrasm_ctx *ctx,
+			       struct sectionpos position, size_t count)
+{
+	struct section *outputsections = ctx->sections;
+	if (position.offset + count > outputsections[position.section].size) {
+		logger(CRITICAL, error_internal,
+		       "Too many bytes for allowed size (requested end: %zu, allocated: %zu)",
+		       position.offset + count,
+		       outputsections[position.section].size);
+		return NULL;
+	}
+	return (unsigned char *)outputsections[position.section].contents +
+	       position.offset;
+}
+
+size_t write_sectiondata(struct wrasm_ctx *ctx, const void *bytes,
+			 size_t count, struct sectionpos position)
 {
+	struct section *outputsections = ctx->sections;
 	logger(DEBUG, no_error, "writing %d bytes to section %s",
 	       position.section, sectionnames[position.section]);
 	if (position.offset + count > outputsections[position.section].size) {
@@ -198,25 +271,111 @@ size_t write_sectiondata(const void *bytes, size_t count,
 	return count;
 }
 
-int flush_output(FILE *elf)
+/* header, padding and contents for each section, padding and section headers */
+#define OUTPUT_CHUNKS (2 * SECTION_COUNT + 3)
+struct outputchunks {
+	size_t count;
+	size_t position;
+	const void *base[OUTPUT_CHUNKS];
+	size_t len[OUTPUT_CHUNKS];
+};
+
+static const unsigned char padding[16] = { 0 };
+
+static int add_chunk(struct outputchunks *chunks, size_t offset,
+		     const void *base, size_t len)
+{
+	if (offset < chunks->position ||
+	    offset - chunks->position > sizeof(padding)) {
+		logger(CRITICAL, error_internal,
+		       "Unable to pad output to offset 0x%.08zx", offset);
+		return 1;
+	}
+	if (offset > chunks->position) {
+		chunks->base[chunks->count] = padding;
+		chunks->len[chunks->count++] = offset - chunks->position;
+	}
+	chunks->base[chunks->count] = base;
+	chunks->len[chunks->count++] = len;
+	chunks->position = offset + len;
+	return 0;
+}
+
+/*
+ * Writes every chunk to the output in order. Where available this is a single
+ * writev() call, only repeated if the kernel accepts a partial write.
+ */
+static int write_chunks(const struct outputchunks *chunks, FILE *elf)
 {
-	logger(DEBUG, no_error, "Writing ELF output to temporary file");
-	/* Generate headers */
-	struct elf64header elfheader = new_elf64header();
-	elfheader.phoffset = 0;
-	elfheader.phentrysize = 0;
-	elfheader.phcount = 0;
+#ifdef HAVE_WRITEV
+	struct iovec iov[OUTPUT_CHUNKS];
+	for (size_t i = 0; i < chunks->count; i++) {
+		iov[i].iov_base = (void *)chunks->base[i];
+		iov[i].iov_len = chunks->len[i];
+	}
 
-	elfheader.shcount = SECTION_COUNT;
-	elfheader.shentrysize = sizeof(struct elf64sectionheader);
-	elfheader.shstrindex = SECTION_STRTAB;
+	if (fflush(elf))
+		return 1;
+	const int fd = fileno(elf);
+	struct iovec *next = iov;
+	int remaining = (int)chunks->count;
+	while (remaining) {
+		const ssize_t written = writev(fd, next, remaining);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return 1;
+		}
+		size_t left = (size_t)written;
+		while (remaining && left >= next->iov_len) {
+			left -= next->iov_len;
+			next++;
+			remaining--;
+		}
+		if (remaining) {
+			next->iov_base = (char *)next->iov_base + left;
+			next->iov_len -= left;
+		}
+	}
+	return 0;
+#else
+	for (size_t i = 0; i < chunks->count; i++)
+		if (fwrite(chunks->base[i], 1, chunks->len[i], elf) !=
+		    chunks->len[i])
+			return 1;
+	return fflush(elf) != 0;
+#endif
+}
 
+/* the file headers and every chunk of the finished ELF file, in order */
+struct elfimage {
+	struct elf64header header;
 	struct elf64sectionheader sectionheaders[SECTION_COUNT];
+	struct outputchunks chunks;
+};
+
+static int build_image(const struct wrasm_ctx *ctx, struct elfimage *image)
+{
+	const struct section *outputsections = ctx->sections;
+	/* Generate headers */
+	struct elf64header *elfheader = &image->header;
+	*elfheader = new_elf64header();
+	if (ctx->rvc)
+		elfheader->flags |= EF_RISCV_RVC;
+	elfheader->phoffset = 0;
+	elfheader->phentrysize = 0;
+	elfheader->phcount = 0;
+
+	elfheader->shcount = SECTION_COUNT;
+	elfheader->shentrysize = sizeof(struct elf64sectionheader);
+	elfheader->shstrindex = SECTION_STRTAB;
+
+	struct elf64sectionheader *sectionheaders = image->sectionheaders;
 	for (int i = 0; i < SECTION_COUNT; i++) {
 		sectionheaders[i] = new_elf64sectionheader();
 		sectionheaders[i].flags = sectiondata[i].flags;
 		sectionheaders[i].link = sectiondata[i].link;
-		sectionheaders[i].info = sectiondata[i].info;
+		sectionheaders[i].info = outputsections[i].info;
 		sectionheaders[i].addralign = sectiondata[i].align;
 		sectionheaders[i].entrysize = sectiondata[i].entrysize;
 		sectionheaders[i].type = sectiondata[i].type;
@@ -231,33 +390,64 @@ int flush_output(FILE *elf)
 
 	/* Fix offset and alignment stuff */
 	sectionheaders[SECTION_NULL].addralign = 0x0;
-	elfheader.shoffset =
+	elfheader->shoffset =
 		align_offset(outputsections[SECTION_COUNT - 1].offset +
 				     outputsections[SECTION_COUNT - 1].size,
 			     8);
 
 	logger(DEBUG, no_error, "Section Header offset at 0x%.08x",
-	       elfheader.shoffset);
+	       elfheader->shoffset);
 
-	/* Write data to output */
-	logger(DEBUG, no_error, "Writing ELF header");
-	fwrite(&elfheader, sizeof(elfheader), 1, elf);
+	/* Lay out the data sequentially so that pipes work as well */
+	struct outputchunks *chunks = &image->chunks;
+	*chunks = (struct outputchunks){ .count = 0, .position = 0 };
+	if (add_chunk(chunks, 0, elfheader, sizeof(*elfheader)))
+		return 1;
 	for (int i = 0; i < SECTION_COUNT; i++) {
+		if (!outputsections[i].size)
+			continue;
 		logger(DEBUG, no_error, "Writing Section (%s)",
 		       sectionnames[i]);
-		fseek(elf, (long)outputsections[i].offset, SEEK_SET);
-		fwrite(outputsections[i].contents, 1, outputsections[i].size,
-		       elf);
+		if (add_chunk(chunks, outputsections[i].offset,
+			      outputsections[i].contents,
+			      outputsections[i].size))
+			return 1;
 	}
 	logger(DEBUG, no_error, "Writing section headers");
-	fseek(elf, (long)elfheader.shoffset, SEEK_SET);
-	fwrite(sectionheaders, sizeof(sectionheaders), 1, elf);
+	return add_chunk(chunks, elfheader->shoffset, sectionheaders,
+			 sizeof(image->sectionheaders));
+}
+
+int flush_output(struct wrasm_ctx *ctx, FILE *elf)
+{
+	logger(DEBUG, no_error, "Writing ELF output");
+	struct elfimage image;
+	if (build_image(ctx, &image))
+		return 1;
 
+	if (write_chunks(&image.chunks, elf)) {
+		logger(ERROR, error_system, "Unable to write ELF output");
+		return 1;
+	}
 	return 0;
 }
 
-void free_output(void)
+int copy_output(struct wrasm_ctx *ctx, unsigned char **data, size_t *size)
 {
-	for (int i = 0; i < SECTION_COUNT; i++)
-		free(outputsections[i].contents);
+	logger(DEBUG, no_error, "Copying ELF output to memory");
+	struct elfimage image;
+	if (build_image(ctx, &image))
+		return 1;
+
+	unsigned char *out = xmalloc(image.chunks.position);
+	size_t position = 0;
+	for (size_t i = 0; i < image.chunks.count; i++) {
+		memcpy(out + position, image.chunks.base[i],
+		       image.chunks.len[i]);
+		position += image.chunks.len[i];
+	}
+
+	*data = out;
+	*size = position;
+	return 0;
 }
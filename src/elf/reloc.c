@@ -0,0 +1,176 @@
+#include "elf/reloc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "context.h"
+#include "debug.h"
+#include "elf/def.h"
+#include "stats.h"
+#include "symbols.h"
+#include "xmalloc.h"
+
+#define RELOCATIONS_MIN_CAPACITY 64
+
+/* the relocation section holding relocations for each output section */
+static enum sections relocation_section(enum sections section)
+{
+	switch (section) {
+	case SECTION_TEXT:
+		return SECTION_RELA_TEXT;
+	case SECTION_DATA:
+		return SECTION_RELA_DATA;
+	default:
+		return SECTION_NULL;
+	}
+}
+
+/*
+ * Undefined and global symbols are left for the linker. So are symbols in
+ * other sections, as the linker is free to move sections apart.
+ */
+bool needs_relocation(const struct wrasm_ctx *ctx, const struct symbol *sym)
+{
+	if (!ctx->relocatable)
+		return false;
+	return sym->section == SECTION_NULL ||
+	       sym->binding != ELF_SYM_LOCAL ||
+	       sym->section != ctx->outputsection;
+}
+
+static struct relocation *next_relocation(struct wrasm_ctx *ctx)
+{
+	if (ctx->relocations_size == ctx->relocations_capacity) {
+		ctx->relocations_capacity =
+			ctx->relocations_capacity ?
+				2 * ctx->relocations_capacity :
+				RELOCATIONS_MIN_CAPACITY;
+		ctx->relocations = xrealloc(ctx->relocations,
+					    ctx->relocations_capacity *
+						    sizeof(*ctx->relocations));
+	}
+	return &ctx->relocations[ctx->relocations_size++];
+}
+
+void add_relocation(struct wrasm_ctx *ctx, enum reloc_type type, size_t sym,
+		    size_t position)
+{
+	const enum sections section = ctx->outputsection;
+	*next_relocation(ctx) = (struct relocation){
+		.position = {
+			.section = section,
+			.offset = position - ctx->sections[section].offset,
+		},
+		.sym = sym,
+		.type = type,
+	};
+	count_stat(&ctx->stats, STAT_RELOCATIONS, 1);
+}
+
+void add_pcrel_lo_relocation(struct wrasm_ctx *ctx, size_t hiposition,
+			     size_t loposition)
+{
+	const enum sections section = ctx->outputsection;
+	const size_t base = ctx->sections[section].offset;
+	*next_relocation(ctx) = (struct relocation){
+		.position = {
+			.section = section,
+			.offset = loposition - base,
+		},
+		.sym = NO_SYMBOL,
+		.type = R_RISCV_PCREL_LO12_I,
+		.hioffset = hiposition - base,
+	};
+	count_stat(&ctx->stats, STAT_RELOCATIONS, 1);
+}
+
+/* labels are numbered in the order the relocations were added */
+int label_pcrel_relocations(struct wrasm_ctx *ctx)
+{
+	for (size_t i = 0; i < ctx->relocations_size; i++) {
+		struct relocation *reloc = &ctx->relocations[i];
+		if (reloc->sym != NO_SYMBOL)
+			continue;
+
+		char name[32];
+		int len;
+		do {
+			len = snprintf(name, sizeof(name), ".Lpcrel_hi%zu",
+				       ctx->pcrel_labels++);
+		} while (get_symbol(ctx, name, (size_t)len));
+
+		struct symbol *label =
+			create_symbol(ctx, name, (size_t)len, SYMBOL_LABEL);
+		if (!label) {
+			/* the rest can't be written without a symbol */
+			ctx->relocations_size = i;
+			return 1;
+		}
+		label->section = reloc->position.section;
+		label->value = (long)reloc->hioffset;
+		reloc->sym = get_symbol_index(ctx, label);
+	}
+	return 0;
+}
+
+/* the relocations were already counted as they were added to `from` */
+void append_relocations(struct wrasm_ctx *ctx, struct wrasm_ctx *from)
+{
+	for (size_t i = 0; i < from->relocations_size; i++)
+		*next_relocation(ctx) = from->relocations[i];
+	free_relocations(from);
+}
+
+void calc_relocations(struct wrasm_ctx *ctx)
+{
+	ctx->sections[SECTION_RELA_TEXT].size = 0;
+	ctx->sections[SECTION_RELA_TEXT].info = SECTION_TEXT;
+	ctx->sections[SECTION_RELA_DATA].size = 0;
+	ctx->sections[SECTION_RELA_DATA].info = SECTION_DATA;
+
+	for (size_t i = 0; i < ctx->relocations_size; i++) {
+		const enum sections section = relocation_section(
+			ctx->relocations[i].position.section);
+		ctx->sections[section].size += sizeof(struct elf64rela);
+	}
+}
+
+/* relocations are written in the order they were added to each section */
+int fill_relocations(struct wrasm_ctx *ctx)
+{
+	size_t offsets[SECTION_COUNT] = { 0 };
+	for (size_t i = 0; i < ctx->relocations_size; i++) {
+		const struct relocation *reloc = &ctx->relocations[i];
+		const struct symbol *sym = get_symbol_at(ctx, reloc->sym);
+		const struct elf64rela entry = {
+			.offset = reloc->position.offset,
+			.info = (uint64_t)sym->symtab_index << 32 | reloc->type,
+			.addend = 0,
+		};
+
+		const enum sections section =
+			relocation_section(reloc->position.section);
+		const struct sectionpos position = {
+			.section = section,
+			.offset = offsets[section],
+		};
+		if (write_sectiondata(ctx, &entry, sizeof(entry), position) !=
+		    sizeof(entry)) {
+			logger(ERROR, error_internal,
+			       "Unable to write data to memory for section %s",
+			       get_section_name(section));
+			return 1;
+		}
+		offsets[section] += sizeof(entry);
+	}
+	return 0;
+}
+
+void free_relocations(struct wrasm_ctx *ctx)
+{
+	free(ctx->relocations);
+	ctx->relocations = NULL;
+	ctx->relocations_size = 0;
+	ctx->relocations_capacity = 0;
+}
@@ -0,0 +1,87 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_POSIX_IO
+#endif
+#define __STDC_WANT_LIB_EXT1__ 1
+
+#include "files.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_POSIX_IO
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "xmalloc.h"
+
+int open_file(FILE **f, const char *filename, const char *flags)
+{
+#ifdef __STDC_LIB_EXT1__
+	return fopen_s(f, filename, flags);
+#else
+	*f = fopen(filename, flags);
+	return !*f;
+#endif
+}
+
+FILE *open_temp_output(const char *filename, char **tempname)
+{
+	/* room for ".<pid>.<attempt>" */
+	const size_t suffixlen = 48;
+	const size_t len = strlen(filename);
+	char *name = xmalloc(len + suffixlen);
+	memcpy(name, filename, len);
+	*tempname = name;
+
+#ifdef HAVE_POSIX_IO
+	/*
+	 * O_EXCL rather than mkstemp(), as mkstemp() creates the file as 0600
+	 * and fixing that up means a umask() round trip, which is process wide
+	 * and so races with other jobs opening outputs.
+	 */
+	for (unsigned attempt = 0;; attempt++) {
+		snprintf(name + len, suffixlen, ".%ld.%u", (long)getpid(),
+			 attempt);
+		const int fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd >= 0)
+			return fdopen(fd, "wb");
+		if (errno != EEXIST)
+			return NULL;
+	}
+#else
+	FILE *f;
+	memcpy(name + len, ".tmp", sizeof(".tmp"));
+	if (open_file(&f, name, "wb"))
+		return NULL;
+	return f;
+#endif
+}
+
+int commit_temp_output(FILE *f, char *tempname, const char *filename)
+{
+	if (fclose(f)) {
+		discard_temp_output(tempname);
+		return 1;
+	}
+
+#ifndef HAVE_POSIX_IO
+	/* rename() will not replace an existing file on every platform */
+	remove(filename);
+#endif
+	if (rename(tempname, filename)) {
+		discard_temp_output(tempname);
+		return 1;
+	}
+	free(tempname);
+	return 0;
+}
+
+void discard_temp_output(char *tempname)
+{
+	remove(tempname);
+	free(tempname);
+}
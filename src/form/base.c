@@ -2,13 +2,12 @@
 #include "form/base.h"
 
 #include <assert.h>
-#include <string.h>
 
 #include "debug.h"
 #include "form/generic.h"
+#include "form/immediate.h"
 #include "macros.h"
 #include "parse.h"
-#include "xmalloc.h"
 
 /*
  * Clang can correctly optimise fully defined switches over enumerated values.
@@ -24,14 +23,14 @@
 #define FULLY_DEFINED_SWITCH() __assume(0)
 #else
 #warning "compiler does not define __GNUC__ and is not MSVC"
-#define FULLY_DEFINED_SWITCH() return error_bytecode
+#define FULLY_DEFINED_SWITCH() return FORM_ERROR
 #endif
 
 /* TODO: Add HINT instruction support */
 const struct formation rv32i[] = {
 	{ "nop", &form_nop, &parse_none, { 4, OP_OPI, 0, 0 } },
 
-	{ "li", &form_load_pseudo, &parse_li, { 8, LOAD_IMM, 0, 0 } },
+	{ "li", &form_load_pseudo, &parse_li, { 4, LOAD_IMM, 0, 0 } },
 	{ "la", &form_load_pseudo, &parse_la, { 8, LOAD_ADDR, 0, 0 } },
 
 	{ "mv", &form_math, &parse_pseudo, { 4, MATH_MV, 0, 0 } },
@@ -54,6 +53,9 @@ const struct formation rv32i[] = {
 	{ "bgtu", &form_branchifr, &parse_btype, { 4, BRANCHIFR_GTU, 0, 0 } },
 	{ "bleu", &form_branchifr, &parse_btype, { 4, BRANCHIFR_LEU, 0, 0 } },
 
+	{ "call", &form_call, &parse_j, { 8, CALL_CALL, 0, 0 } },
+	{ "tail", &form_call, &parse_j, { 8, CALL_TAIL, 0, 0 } },
+
 	{ "j", &form_jump, &parse_j, { 4, JUMP_J, 0, 0 } },
 	{ "jr", &form_jump, &parse_jr, { 4, JUMP_JR, 0, 0 } },
 	{ "ret", &form_jump, &parse_none, { 4, JUMP_RET, 0, 0 } },
@@ -133,9 +135,11 @@ const struct formation rv64i[] = {
 	END_FORMATION
 };
 
-struct bytecode form_syscall(const char *name, struct idata instruction,
-			     struct args args, size_t position)
+size_t form_syscall(struct wrasm_ctx *ctx, const char *name,
+		    struct idata instruction, struct args args, size_t position,
+		    unsigned char *out)
 {
+	(void)ctx;
 	(void)args;
 	(void)position;
 	logger(DEBUG, no_error, "Generating syscall %s", name);
@@ -146,28 +150,71 @@ struct bytecode form_syscall(const char *name, struct idata instruction,
 
 	assert(instruction.sz == 4);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (funct3 << 12) | (funct7 << 20);
-	return res;
+	put_u32(out, opcode | (funct3 << 12) | (funct7 << 20));
+	return 4;
 }
 
-struct bytecode form_nop(const char *name, struct idata instruction,
-			 struct args args, size_t position)
+size_t form_nop(struct wrasm_ctx *ctx, const char *name,
+		struct idata instruction, struct args args, size_t position,
+		unsigned char *out)
 {
 	(void)args;
 	(void)position;
 	logger(DEBUG, no_error, "Generating nop instruction %s", name);
 
-	return form_itype(name, instruction,
+	return form_itype(ctx, name, instruction,
 			  (struct args){ .rd = 0, .rs1 = 0, .imm = 0 },
-			  position);
+			  position, out);
 }
 
-struct bytecode form_load_pseudo(const char *name, struct idata instruction,
-				 struct args args, size_t position)
+/* each step of the sequence modifies rd, starting from x0 */
+static size_t form_load_imm(struct wrasm_ctx *ctx, struct idata instruction,
+			    struct args args, size_t position,
+			    unsigned char *out)
+{
+	static const struct {
+		const char *name;
+		struct idata idata;
+	} ops[] = {
+		[IMM_LUI] = { "lui (li)", { 4, OP_LUI, 0, 0 } },
+		[IMM_ADDI] = { "addi (li)", { 4, OP_OPI, 0x0, 0 } },
+		[IMM_ADDIW] = { "addiw (li)", { 4, OP_OPI32, 0x0, 0 } },
+		[IMM_SLLI] = { "slli (li)", { 4, OP_OPI, 0x1, 0 } },
+		[IMM_SRLI] = { "srli (li)", { 4, OP_OPI, 0x5, 0 } },
+	};
+
+	struct imm_sequence seq;
+	build_imm_sequence(args.imm, &seq);
+	/* the size was picked from the same sequence when parsing */
+	assert(4 * seq.count == instruction.sz);
+
+	size_t sz = 0;
+	for (size_t i = 0; i < seq.count; i++) {
+		const struct imm_step step = seq.steps[i];
+		const struct args stepargs = {
+			.rd = args.rd,
+			.rs1 = i ? args.rd : 0,
+			.imm = step.op == IMM_LUI ? (int64_t)step.imm << 12 :
+						    step.imm,
+		};
+		const size_t stepsz =
+			step.op == IMM_LUI ?
+				form_utype(ctx, ops[step.op].name,
+					   ops[step.op].idata, stepargs,
+					   position + sz, out + sz) :
+				form_itype(ctx, ops[step.op].name,
+					   ops[step.op].idata, stepargs,
+					   position + sz, out + sz);
+		if (stepsz == FORM_ERROR)
+			return FORM_ERROR;
+		sz += stepsz;
+	}
+	return sz;
+}
+
+size_t form_load_pseudo(struct wrasm_ctx *ctx, const char *name,
+			struct idata instruction, struct args args,
+			size_t position, unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating load instruction %s", name);
 
@@ -178,12 +225,13 @@ struct bytecode form_load_pseudo(const char *name, struct idata instruction,
 	uint32_t value;
 	switch (type) {
 	case LOAD_IMM:
-		opcode = OP_LUI;
-		value = args.imm;
-		break;
+		return form_load_imm(ctx, instruction, args, position, out);
 	case LOAD_ADDR:
 		opcode = OP_AUIPC;
-		value = (uint32_t)calc_symbol_offset(args.sym, position);
+		value = (uint32_t)symbol_offset(ctx, args.sym, position,
+						R_RISCV_PCREL_HI20);
+		if (needs_relocation(ctx, get_symbol_at(ctx, args.sym)))
+			add_pcrel_lo_relocation(ctx, position, position + 4);
 		break;
 	default:
 		UNREACHABLE();
@@ -201,37 +249,65 @@ struct bytecode form_load_pseudo(const char *name, struct idata instruction,
 	const char *uppernames[] = { "lui (li)", "auipc (la)" };
 	const char *lowernames[] = { "addi (li)", "addi (la)" };
 
-	struct bytecode upper = form_utype(uppernames[type],
-					   (struct idata){ 4, opcode, 0, 0 },
-					   (struct args){
-						   .rd = rd,
-						   .imm = value & 0xFFFFF000,
-					   },
-					   position);
-	struct bytecode lower = form_itype(lowernames[type],
-					   (struct idata){ 4, OP_OPI, 0x0, 0 },
-					   (struct args){
-						   .rd = rd,
-						   .rs1 = rd,
-						   .imm = value & 0xFFF,
-					   },
-					   position + 4);
-
-	unsigned char *data = malloc(upper.size + lower.size);
-	memcpy(data, upper.data, upper.size);
-	memcpy(data + upper.size, lower.data, lower.size);
-
-	free(upper.data);
-	free(lower.data);
-
-	return (struct bytecode){
-		.size = upper.size + lower.size,
-		.data = data,
-	};
+	/* the lower half is sign extended, so round the upper half to match */
+	const size_t upper = form_utype(ctx, uppernames[type],
+					(struct idata){ 4, opcode, 0, 0 },
+					(struct args){
+						.rd = rd,
+						.imm = (value + 0x800) &
+						       0xFFFFF000,
+					},
+					position, out);
+	const size_t lower = form_itype(ctx, lowernames[type],
+					(struct idata){ 4, OP_OPI, 0x0, 0 },
+					(struct args){
+						.rd = rd,
+						.rs1 = rd,
+						.imm = value & 0xFFF,
+					},
+					position + 4, out + upper);
+
+	return upper + lower;
+}
+
+size_t form_call(struct wrasm_ctx *ctx, const char *name,
+		 struct idata instruction, struct args args, size_t position,
+		 unsigned char *out)
+{
+	logger(DEBUG, no_error, "Generating call instruction %s", name);
+
+	const enum call_pseudo type = instruction.opcode;
+	/* tail calls must not overwrite the return address */
+	const uint8_t link = type == CALL_TAIL ? 6 : 1;
+	const uint8_t rd = type == CALL_TAIL ? 0 : 1;
+
+	/* one relocation covers both the auipc and the jalr */
+	const uint32_t offset = (uint32_t)symbol_offset(ctx, args.sym, position,
+							R_RISCV_CALL_PLT);
+
+	const size_t upper = form_utype(ctx, "auipc (call)",
+					(struct idata){ 4, OP_AUIPC, 0, 0 },
+					(struct args){
+						.rd = link,
+						.imm = (offset + 0x800) &
+						       0xFFFFF000,
+					},
+					position, out);
+	const size_t lower = form_itype(ctx, "jalr (call)",
+					(struct idata){ 4, OP_JALR, 0x0, 0 },
+					(struct args){
+						.rd = rd,
+						.rs1 = link,
+						.imm = offset & 0xFFF,
+					},
+					position + 4, out + upper);
+
+	return upper + lower;
 }
 
-struct bytecode form_math(const char *name, struct idata instruction,
-			  struct args args, size_t position)
+size_t form_math(struct wrasm_ctx *ctx, const char *name,
+		 struct idata instruction, struct args args, size_t position,
+		 unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating math instruction %s", name);
 
@@ -240,37 +316,38 @@ struct bytecode form_math(const char *name, struct idata instruction,
 	switch (type) {
 	case MATH_MV: // addi rd, rs, 0
 		args.imm = 0;
-		return form_itype("mv (addi)",
+		return form_itype(ctx, "mv (addi)",
 				  (struct idata){ 4, OP_OPI, 0x0, 0 }, args,
-				  position);
+				  position, out);
 	case MATH_NOT: // xori rd, rs, -1
 		args.imm = (uint32_t)-1;
-		return form_itype("not (xori)",
+		return form_itype(ctx, "not (xori)",
 				  (struct idata){ 4, OP_OPI, 0x4, 0 }, args,
-				  position);
+				  position, out);
 	case MATH_NEG: // sub rd, x0, rs
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_rtype("neg (sub)",
+		return form_rtype(ctx, "neg (sub)",
 				  (struct idata){ 4, OP_OP, 0x0, 0x20 }, args,
-				  position);
+				  position, out);
 	case MATH_NEGW: // subw rd, x0, rs
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_rtype("neg (sub)",
+		return form_rtype(ctx, "neg (sub)",
 				  (struct idata){ 4, OP_OP32, 0x0, 0x20 }, args,
-				  position);
+				  position, out);
 	case MATH_SEXTW: // addiw rd, rs, 0
 		args.imm = 0;
-		return form_itype("sextw (addiw)",
+		return form_itype(ctx, "sextw (addiw)",
 				  (struct idata){ 4, OP_OPI32, 0x0, 0 }, args,
-				  position);
+				  position, out);
 	}
 	FULLY_DEFINED_SWITCH();
 }
 
-struct bytecode form_setif(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+size_t form_setif(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating conditional set intruction %s",
 	       name);
@@ -279,80 +356,85 @@ struct bytecode form_setif(const char *name, struct idata instruction,
 	switch (type) {
 	case SETIF_EQZ: // sltiu rd, rs, 1
 		args.imm = 1;
-		return form_itype("sltiu (snez)",
+		return form_itype(ctx, "sltiu (snez)",
 				  (struct idata){ 4, OP_OPI, 0x3, 0x00 }, args,
-				  position);
+				  position, out);
 	case SETIF_NEZ: // sltu rd, x0, rs
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_rtype("sltu (snez)",
+		return form_rtype(ctx, "sltu (snez)",
 				  (struct idata){ 4, OP_OP, 0x3, 0x00 }, args,
-				  position);
+				  position, out);
 	case SETIF_LTZ: // slt rd, rs, x0
 		args.rs2 = 0;
-		return form_rtype("slt (sltz)",
+		return form_rtype(ctx, "slt (sltz)",
 				  (struct idata){ 4, OP_OP, 0x2, 0x00 }, args,
-				  position);
+				  position, out);
 	case SETIF_GTZ: // slt rd, x0, rs
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_rtype("slt (sgtz)",
+		return form_rtype(ctx, "slt (sgtz)",
 				  (struct idata){ 4, OP_OP, 0x2, 0x00 }, args,
-				  position);
+				  position, out);
 	}
 	FULLY_DEFINED_SWITCH();
 }
 
-struct bytecode form_branchifz(const char *name, struct idata instruction,
-			       struct args args, size_t position)
+size_t form_branchifz(struct wrasm_ctx *ctx, const char *name,
+		      struct idata instruction, struct args args,
+		      size_t position, unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating conditional branch intruction %s",
 	       name);
 	const enum branchifz_pseudo type = instruction.opcode;
+	/* relaxation may have grown the branch, see relax.h */
+	const size_t sz = instruction.sz;
 	// op rs1, offset
 	switch (type) {
 	case BRANCHIFZ_EQZ: // beq rs, x0, offset
 		args.rs2 = 0;
-		return form_btype("beq (beqz)",
-				  (struct idata){ 4, OP_BRANCH, 0x0, 0 }, args,
-				  position);
+		return form_btype(ctx, "beq (beqz)",
+				  (struct idata){ sz, OP_BRANCH, 0x0, 0 },
+				  args, position, out);
 	case BRANCHIFZ_NEZ: // bne rs, x0, offset
 		args.rs2 = 0;
-		return form_btype("bne (bnez)",
-				  (struct idata){ 4, OP_BRANCH, 0x1, 0 }, args,
-				  position);
+		return form_btype(ctx, "bne (bnez)",
+				  (struct idata){ sz, OP_BRANCH, 0x1, 0 },
+				  args, position, out);
 	case BRANCHIFZ_LEZ: // bge x0, rs, offset
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_btype("bge (blez)",
-				  (struct idata){ 4, OP_BRANCH, 0x5, 0 }, args,
-				  position);
+		return form_btype(ctx, "bge (blez)",
+				  (struct idata){ sz, OP_BRANCH, 0x5, 0 },
+				  args, position, out);
 	case BRANCHIFZ_GEZ: // bge rs, x0, offset
 		args.rs2 = 0;
-		return form_btype("bge (blez)",
-				  (struct idata){ 4, OP_BRANCH, 0x5, 0 }, args,
-				  position);
+		return form_btype(ctx, "bge (blez)",
+				  (struct idata){ sz, OP_BRANCH, 0x5, 0 },
+				  args, position, out);
 	case BRANCHIFZ_LTZ: // blt rs, x0, offset
 		args.rs2 = 0;
-		return form_btype("bge (blez)",
-				  (struct idata){ 4, OP_BRANCH, 0x4, 0 }, args,
-				  position);
+		return form_btype(ctx, "bge (blez)",
+				  (struct idata){ sz, OP_BRANCH, 0x4, 0 },
+				  args, position, out);
 	case BRANCHIFZ_GTZ: // blt x0, rs, offset
 		args.rs2 = args.rs1;
 		args.rs1 = 0;
-		return form_btype("bge (blez)",
-				  (struct idata){ 4, OP_BRANCH, 0x4, 0 }, args,
-				  position);
+		return form_btype(ctx, "bge (blez)",
+				  (struct idata){ sz, OP_BRANCH, 0x4, 0 },
+				  args, position, out);
 	}
 	FULLY_DEFINED_SWITCH();
 }
 
-struct bytecode form_branchifr(const char *name, struct idata instruction,
-			       struct args args, size_t position)
+size_t form_branchifr(struct wrasm_ctx *ctx, const char *name,
+		      struct idata instruction, struct args args,
+		      size_t position, unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating conditional branch intruction %s",
 	       name);
 	const enum branchifr_pseudo type = instruction.opcode;
+	const size_t sz = instruction.sz;
 
 	const uint8_t rs1 = args.rs1;
 	args.rs1 = args.rs2;
@@ -361,31 +443,34 @@ struct bytecode form_branchifr(const char *name, struct idata instruction,
 	const uint8_t funct3 = (uint8_t)(type);
 	const char *names[] = { "blt (bgt)", "bge (ble)", "bltu (bgtu)",
 				"bgeu (bleu)" };
-	return form_btype(names[type - BRANCHIFR_GT],
-			  (struct idata){ 4, OP_BRANCH, funct3, 0 }, args,
-			  position);
+	return form_btype(ctx, names[type - BRANCHIFR_GT],
+			  (struct idata){ sz, OP_BRANCH, funct3, 0 }, args,
+			  position, out);
 }
 
-struct bytecode form_jump(const char *name, struct idata instruction,
-			  struct args args, size_t position)
+size_t form_jump(struct wrasm_ctx *ctx, const char *name,
+		 struct idata instruction, struct args args, size_t position,
+		 unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating unconditional jump intruction %s",
 	       name);
 	const enum jump_pseudo type = instruction.opcode;
+	const size_t sz = instruction.sz;
 	switch (type) {
 	case JUMP_J:
 		args.rd = 0;
-		return form_jtype("jal (j)", (struct idata){ 4, OP_JAL, 0, 0 },
-				  args, position);
+		return form_jtype(ctx, "jal (j)",
+				  (struct idata){ sz, OP_JAL, 0, 0 }, args,
+				  position, out);
 	case JUMP_RET:
 		args.rs1 = 1;
 		// fall through
 	case JUMP_JR:
 		args.rd = 0;
 		args.imm = 0;
-		return form_itype("jalr (jr)",
+		return form_itype(ctx, "jalr (jr)",
 				  (struct idata){ 4, OP_JALR, 0x0, 0 }, args,
-				  position);
+				  position, out);
 	}
 	FULLY_DEFINED_SWITCH();
 }
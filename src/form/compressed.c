@@ -0,0 +1,718 @@
+#include "form/compressed.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "debug.h"
+#include "form/base.h"
+#include "form/generic.h"
+#include "parse.h"
+#include "symbols.h"
+
+#define REG_RA 1
+#define REG_SP 2
+
+/*
+ * The CR and CA formats have a fourth or sixth function bit beyond funct3,
+ * which is kept in funct7. For CA instructions funct7 also holds funct2.
+ */
+const struct formation rv64c[] = {
+	{ "c.addi4spn", &form_caddi4spn, &parse_itype, { 2, OP_C0, 0x0, 0 } },
+	{ "c.lw", &form_cload, &parse_ltype, { 2, OP_C0, 0x2, 0 } },
+	{ "c.ld", &form_cload, &parse_ltype, { 2, OP_C0, 0x3, 0 } },
+	{ "c.sw", &form_cstore, &parse_stype, { 2, OP_C0, 0x6, 0 } },
+	{ "c.sd", &form_cstore, &parse_stype, { 2, OP_C0, 0x7, 0 } },
+
+	{ "c.nop", &form_cfixed, &parse_none, { 2, OP_C1, 0x0, 0 } },
+	{ "c.addi", &form_ci, &parse_ci, { 2, OP_C1, 0x0, 0 } },
+	{ "c.addiw", &form_ci, &parse_ci, { 2, OP_C1, 0x1, 0 } },
+	{ "c.li", &form_ci, &parse_ci, { 2, OP_C1, 0x2, 0 } },
+	{ "c.addi16sp", &form_caddi16sp, &parse_ci, { 2, OP_C1, 0x3, 0 } },
+	{ "c.lui", &form_clui, &parse_utype, { 2, OP_C1, 0x3, 0 } },
+	{ "c.srli", &form_cshift, &parse_ci, { 2, OP_C1, 0x4, 0x0 } },
+	{ "c.srai", &form_cshift, &parse_ci, { 2, OP_C1, 0x4, 0x1 } },
+	{ "c.andi", &form_candi, &parse_ci, { 2, OP_C1, 0x4, 0x2 } },
+	{ "c.sub", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x0 } },
+	{ "c.xor", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x1 } },
+	{ "c.or", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x2 } },
+	{ "c.and", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x3 } },
+	{ "c.subw", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x4 } },
+	{ "c.addw", &form_ca, &parse_cr, { 2, OP_C1, 0x4, 0x5 } },
+	{ "c.j", &form_cjump, &parse_j, { 2, OP_C1, 0x5, 0 } },
+	{ "c.beqz", &form_cbranch, &parse_bztype, { 2, OP_C1, 0x6, 0 } },
+	{ "c.bnez", &form_cbranch, &parse_bztype, { 2, OP_C1, 0x7, 0 } },
+
+	{ "c.slli", &form_cshift, &parse_ci, { 2, OP_C2, 0x0, 0 } },
+	{ "c.lwsp", &form_cloadsp, &parse_ltype, { 2, OP_C2, 0x2, 0 } },
+	{ "c.ldsp", &form_cloadsp, &parse_ltype, { 2, OP_C2, 0x3, 0 } },
+	{ "c.jr", &form_cjr, &parse_jr, { 2, OP_C2, 0x4, 0 } },
+	{ "c.jalr", &form_cjr, &parse_jr, { 2, OP_C2, 0x4, 1 } },
+	{ "c.mv", &form_cr, &parse_cr, { 2, OP_C2, 0x4, 0 } },
+	{ "c.add", &form_cr, &parse_cr, { 2, OP_C2, 0x4, 1 } },
+	{ "c.ebreak", &form_cfixed, &parse_none, { 2, OP_C2, 0x4, 1 } },
+	{ "c.swsp", &form_cstoresp, &parse_stype, { 2, OP_C2, 0x6, 0 } },
+	{ "c.sdsp", &form_cstoresp, &parse_stype, { 2, OP_C2, 0x7, 0 } },
+
+	END_FORMATION
+};
+
+/* most formats only have room for x8 to x15 */
+static inline bool is_creg(uint8_t reg)
+{
+	return reg >= 8 && reg <= 15;
+}
+
+static inline bool fits_signed(int64_t value, int bits)
+{
+	return value >= -(INT64_C(1) << (bits - 1)) &&
+	       value < (INT64_C(1) << (bits - 1));
+}
+
+/* a multiple of scale between 0 and max */
+static inline bool fits_scaled(int64_t value, int64_t scale, int64_t max)
+{
+	return value >= 0 && value <= max && value % scale == 0;
+}
+
+/* bits hi to lo of value, moved down to bit 0 */
+static inline uint32_t bits(int64_t value, int hi, int lo)
+{
+	return ((uint64_t)value >> lo) & ((1u << (hi - lo + 1)) - 1);
+}
+
+/* the upper immediate of lui, sign extended from bit 31 as lui does */
+static inline int64_t lui_upper(int64_t imm)
+{
+	return (int64_t)((((uint64_t)imm >> 12) & 0xFFFFF) ^ 0x80000) - 0x80000;
+}
+
+static uint32_t check_creg(const char *name, uint8_t reg)
+{
+	if (!is_creg(reg))
+		logger(ERROR, error_instruction_other,
+		       "%s only takes registers x8 to x15, but got x%d", name,
+		       reg);
+	return bits(reg, 2, 0);
+}
+
+static void check_reg(const char *name, bool valid, uint8_t reg)
+{
+	if (!valid)
+		logger(ERROR, error_instruction_other,
+		       "%s can not take register x%d", name, reg);
+}
+
+static void check_imm(const char *name, bool valid, int64_t imm)
+{
+	if (!valid)
+		logger(ERROR, error_instruction_other,
+		       "Immediate %" PRId64 " is out of range for %s", imm,
+		       name);
+}
+
+/* the bits every compressed format shares */
+static inline uint16_t encode_common(struct idata instruction)
+{
+	assert(instruction.sz == 2);
+	return (uint16_t)(instruction.opcode | instruction.funct3 << 13);
+}
+
+size_t form_cr(struct wrasm_ctx *ctx, const char *name,
+	       struct idata instruction, struct args args, size_t position,
+	       unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CR type instruction %s", name);
+
+	/* with x0 as the source these encode c.jr, c.jalr and c.ebreak */
+	check_reg(name, args.rs2, args.rs2);
+
+	put_u16(out, encode_common(instruction) | instruction.funct7 << 12 |
+			     args.rd << 7 | args.rs2 << 2);
+	return 2;
+}
+
+size_t form_cjr(struct wrasm_ctx *ctx, const char *name,
+		struct idata instruction, struct args args, size_t position,
+		unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CR type jump %s", name);
+
+	check_reg(name, args.rs1, args.rs1);
+
+	put_u16(out, encode_common(instruction) | instruction.funct7 << 12 |
+			     args.rs1 << 7);
+	return 2;
+}
+
+size_t form_ci(struct wrasm_ctx *ctx, const char *name,
+	       struct idata instruction, struct args args, size_t position,
+	       unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CI type instruction %s", name);
+
+	/* c.addiw rd of x0 is reserved, the others are hints */
+	check_reg(name, args.rd || instruction.funct3 != 0x1, args.rd);
+	check_imm(name, fits_signed(args.imm, 6), args.imm);
+
+	put_u16(out, encode_common(instruction) | bits(args.imm, 5, 5) << 12 |
+			     args.rd << 7 | bits(args.imm, 4, 0) << 2);
+	return 2;
+}
+
+/* c.srli, c.srai and c.andi share the CB format */
+static uint16_t encode_cb_imm(const char *name, struct idata instruction,
+			      struct args args)
+{
+	return encode_common(instruction) | bits(args.imm, 5, 5) << 12 |
+	       instruction.funct7 << 10 | check_creg(name, args.rd) << 7 |
+	       bits(args.imm, 4, 0) << 2;
+}
+
+size_t form_cshift(struct wrasm_ctx *ctx, const char *name,
+		   struct idata instruction, struct args args, size_t position,
+		   unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating compressed shift %s", name);
+
+	/* a shift amount of 0 encodes a hint rather than a shift in RV64 */
+	check_imm(name, args.imm > 0 && args.imm < 64, args.imm);
+
+	if (instruction.opcode == OP_C1) {
+		put_u16(out, encode_cb_imm(name, instruction, args));
+		return 2;
+	}
+
+	/* c.slli can shift any register */
+	put_u16(out, encode_common(instruction) | bits(args.imm, 5, 5) << 12 |
+			     args.rd << 7 | bits(args.imm, 4, 0) << 2);
+	return 2;
+}
+
+size_t form_candi(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CB type instruction %s", name);
+
+	check_imm(name, fits_signed(args.imm, 6), args.imm);
+
+	put_u16(out, encode_cb_imm(name, instruction, args));
+	return 2;
+}
+
+size_t form_clui(struct wrasm_ctx *ctx, const char *name,
+		 struct idata instruction, struct args args, size_t position,
+		 unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating compressed lui %s", name);
+
+	const int64_t upper = lui_upper(args.imm);
+	check_reg(name, args.rd && args.rd != REG_SP, args.rd);
+	check_imm(name, upper && fits_signed(upper, 6), args.imm);
+
+	put_u16(out, encode_common(instruction) | bits(upper, 5, 5) << 12 |
+			     args.rd << 7 | bits(upper, 4, 0) << 2);
+	return 2;
+}
+
+size_t form_caddi16sp(struct wrasm_ctx *ctx, const char *name,
+		      struct idata instruction, struct args args,
+		      size_t position, unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating stack adjustment %s", name);
+
+	const int64_t imm = args.imm;
+	check_reg(name, args.rd == REG_SP, args.rd);
+	check_imm(name, imm && imm % 16 == 0 && fits_signed(imm, 10), imm);
+
+	put_u16(out, encode_common(instruction) | bits(imm, 9, 9) << 12 |
+			     REG_SP << 7 | bits(imm, 4, 4) << 6 |
+			     bits(imm, 6, 6) << 5 | bits(imm, 8, 7) << 3 |
+			     bits(imm, 5, 5) << 2);
+	return 2;
+}
+
+size_t form_caddi4spn(struct wrasm_ctx *ctx, const char *name,
+		      struct idata instruction, struct args args,
+		      size_t position, unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CIW type instruction %s", name);
+
+	const int64_t imm = args.imm;
+	check_reg(name, args.rs1 == REG_SP, args.rs1);
+	check_imm(name, imm && fits_scaled(imm, 4, 1020), imm);
+
+	put_u16(out, encode_common(instruction) | bits(imm, 5, 4) << 11 |
+			     bits(imm, 9, 6) << 7 | bits(imm, 2, 2) << 6 |
+			     bits(imm, 3, 3) << 5 |
+			     check_creg(name, args.rd) << 2);
+	return 2;
+}
+
+/* the low bit of funct3 picks the doubleword loads and stores */
+static inline bool is_doubleword(struct idata instruction)
+{
+	return instruction.funct3 & 0x1;
+}
+
+size_t form_cloadsp(struct wrasm_ctx *ctx, const char *name,
+		    struct idata instruction, struct args args,
+		    size_t position, unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CI type load %s", name);
+
+	const int64_t imm = args.imm;
+	check_reg(name, args.rs1 == REG_SP, args.rs1);
+	check_reg(name, args.rd, args.rd);
+
+	uint16_t offset;
+	if (is_doubleword(instruction)) {
+		check_imm(name, fits_scaled(imm, 8, 504), imm);
+		offset = bits(imm, 4, 3) << 5 | bits(imm, 8, 6) << 2;
+	} else {
+		check_imm(name, fits_scaled(imm, 4, 252), imm);
+		offset = bits(imm, 4, 2) << 4 | bits(imm, 7, 6) << 2;
+	}
+
+	put_u16(out, encode_common(instruction) | bits(imm, 5, 5) << 12 |
+			     args.rd << 7 | offset);
+	return 2;
+}
+
+size_t form_cstoresp(struct wrasm_ctx *ctx, const char *name,
+		     struct idata instruction, struct args args,
+		     size_t position, unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CSS type store %s", name);
+
+	const int64_t imm = args.imm;
+	check_reg(name, args.rs1 == REG_SP, args.rs1);
+
+	uint16_t offset;
+	if (is_doubleword(instruction)) {
+		check_imm(name, fits_scaled(imm, 8, 504), imm);
+		offset = bits(imm, 5, 3) << 10 | bits(imm, 8, 6) << 7;
+	} else {
+		check_imm(name, fits_scaled(imm, 4, 252), imm);
+		offset = bits(imm, 5, 2) << 9 | bits(imm, 7, 6) << 7;
+	}
+
+	put_u16(out, encode_common(instruction) | offset | args.rs2 << 2);
+	return 2;
+}
+
+/* c.lw, c.ld, c.sw and c.sd only differ in which register goes in rd' */
+static uint16_t encode_cmem(const char *name, struct idata instruction,
+			    uint8_t reg, uint8_t base, int64_t imm)
+{
+	uint16_t offset;
+	if (is_doubleword(instruction)) {
+		check_imm(name, fits_scaled(imm, 8, 248), imm);
+		offset = bits(imm, 7, 6) << 5;
+	} else {
+		check_imm(name, fits_scaled(imm, 4, 124), imm);
+		offset = bits(imm, 2, 2) << 6 | bits(imm, 6, 6) << 5;
+	}
+
+	return encode_common(instruction) | bits(imm, 5, 3) << 10 |
+	       check_creg(name, base) << 7 | offset |
+	       check_creg(name, reg) << 2;
+}
+
+size_t form_cload(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CL type load %s", name);
+
+	put_u16(out,
+		encode_cmem(name, instruction, args.rd, args.rs1, args.imm));
+	return 2;
+}
+
+size_t form_cstore(struct wrasm_ctx *ctx, const char *name,
+		   struct idata instruction, struct args args, size_t position,
+		   unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CS type store %s", name);
+
+	put_u16(out,
+		encode_cmem(name, instruction, args.rs2, args.rs1, args.imm));
+	return 2;
+}
+
+size_t form_ca(struct wrasm_ctx *ctx, const char *name,
+	       struct idata instruction, struct args args, size_t position,
+	       unsigned char *out)
+{
+	(void)ctx;
+	(void)position;
+	logger(DEBUG, no_error, "Generating CA type instruction %s", name);
+
+	put_u16(out, encode_common(instruction) |
+			     bits(instruction.funct7, 2, 2) << 12 | 0x3 << 10 |
+			     check_creg(name, args.rd) << 7 |
+			     bits(instruction.funct7, 1, 0) << 5 |
+			     check_creg(name, args.rs2) << 2);
+	return 2;
+}
+
+size_t form_cbranch(struct wrasm_ctx *ctx, const char *name,
+		    struct idata instruction, struct args args,
+		    size_t position, unsigned char *out)
+{
+	logger(DEBUG, no_error, "Generating CB type branch %s", name);
+
+	const int32_t offset =
+		symbol_offset(ctx, args.sym, position, R_RISCV_RVC_BRANCH);
+	if (!fits_signed(offset, 9))
+		logger(ERROR, error_instruction_other,
+		       "Branch to %s is out of range (offset %d)",
+		       get_symbol_name(ctx, get_symbol_at(ctx, args.sym)),
+		       offset);
+
+	put_u16(out, encode_common(instruction) | bits(offset, 8, 8) << 12 |
+			     bits(offset, 4, 3) << 10 |
+			     check_creg(name, args.rs1) << 7 |
+			     bits(offset, 7, 6) << 5 | bits(offset, 2, 1) << 3 |
+			     bits(offset, 5, 5) << 2);
+	return 2;
+}
+
+size_t form_cjump(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
+{
+	logger(DEBUG, no_error, "Generating CJ type jump %s", name);
+
+	const int32_t offset =
+		symbol_offset(ctx, args.sym, position, R_RISCV_RVC_JUMP);
+	if (!fits_signed(offset, 12))
+		logger(ERROR, error_instruction_other,
+		       "Jump to %s is out of range (offset %d)",
+		       get_symbol_name(ctx, get_symbol_at(ctx, args.sym)),
+		       offset);
+
+	put_u16(out, encode_common(instruction) | bits(offset, 11, 11) << 12 |
+			     bits(offset, 4, 4) << 11 |
+			     bits(offset, 9, 8) << 9 |
+			     bits(offset, 10, 10) << 8 |
+			     bits(offset, 6, 6) << 7 | bits(offset, 7, 7) << 6 |
+			     bits(offset, 3, 1) << 3 | bits(offset, 5, 5) << 2);
+	return 2;
+}
+
+size_t form_cfixed(struct wrasm_ctx *ctx, const char *name,
+		   struct idata instruction, struct args args, size_t position,
+		   unsigned char *out)
+{
+	(void)ctx;
+	(void)args;
+	(void)position;
+	logger(DEBUG, no_error, "Generating compressed instruction %s", name);
+
+	put_u16(out, encode_common(instruction) | instruction.funct7 << 12);
+	return 2;
+}
+
+/* switches an instruction over to a compressed instruction */
+static bool use_compressed(struct instruction *instruction, const char *name,
+			   struct args args)
+{
+	const struct formation *formation = find_formation(name, strlen(name));
+	assert(formation);
+	instruction->formation = *formation;
+	args.sym = NO_SYMBOL;
+	instruction->args = args;
+	return true;
+}
+
+/* the operands of instructions which modify a single register */
+static struct args single_reg(uint8_t rd, int64_t imm)
+{
+	return (struct args){ .rd = rd, .rs1 = rd, .imm = imm };
+}
+
+/* the operands of the two register CR and CA formats */
+static struct args two_regs(uint8_t rd, uint8_t rs2)
+{
+	return (struct args){ .rd = rd, .rs1 = rd, .rs2 = rs2 };
+}
+
+static bool compress_addi(struct instruction *instruction)
+{
+	const struct args a = instruction->args;
+	if (a.rd && a.rd == a.rs1 && a.imm && fits_signed(a.imm, 6))
+		return use_compressed(instruction, "c.addi",
+				      single_reg(a.rd, a.imm));
+	if (a.rd && !a.rs1 && fits_signed(a.imm, 6))
+		return use_compressed(instruction, "c.li",
+				      single_reg(a.rd, a.imm));
+	if (a.rd && a.rs1 && !a.imm)
+		return use_compressed(instruction, "c.mv",
+				      two_regs(a.rd, a.rs1));
+	if (a.rd == REG_SP && a.rs1 == REG_SP && a.imm % 16 == 0 &&
+	    fits_signed(a.imm, 10))
+		return use_compressed(instruction, "c.addi16sp",
+				      single_reg(REG_SP, a.imm));
+	if (is_creg(a.rd) && a.rs1 == REG_SP && a.imm &&
+	    fits_scaled(a.imm, 4, 1020))
+		return use_compressed(instruction, "c.addi4spn", a);
+	return false;
+}
+
+static bool compress_itype(struct instruction *instruction)
+{
+	const struct idata idata = instruction->formation.idata;
+	const struct args a = instruction->args;
+	const bool same = a.rd && a.rd == a.rs1;
+
+	switch (idata.opcode) {
+	case OP_OPI:
+		if (idata.funct3 == 0x0)
+			return compress_addi(instruction);
+		if (idata.funct3 == 0x1 && same && a.imm > 0 && a.imm < 64)
+			return use_compressed(instruction, "c.slli", a);
+		if (idata.funct3 == 0x5 && same && is_creg(a.rd) &&
+		    a.imm > 0 && a.imm < 64)
+			return use_compressed(instruction, "c.srli", a);
+		if (idata.funct3 == 0x7 && same && is_creg(a.rd) &&
+		    fits_signed(a.imm, 6))
+			return use_compressed(instruction, "c.andi", a);
+		return false;
+	case OP_OPI32:
+		if (idata.funct3 == 0x0 && same && fits_signed(a.imm, 6))
+			return use_compressed(instruction, "c.addiw", a);
+		return false;
+	case OP_LOAD:
+		if (idata.funct3 == 0x2 && is_creg(a.rd) && is_creg(a.rs1) &&
+		    fits_scaled(a.imm, 4, 124))
+			return use_compressed(instruction, "c.lw", a);
+		if (idata.funct3 == 0x2 && a.rd && a.rs1 == REG_SP &&
+		    fits_scaled(a.imm, 4, 252))
+			return use_compressed(instruction, "c.lwsp", a);
+		if (idata.funct3 == 0x3 && is_creg(a.rd) && is_creg(a.rs1) &&
+		    fits_scaled(a.imm, 8, 248))
+			return use_compressed(instruction, "c.ld", a);
+		if (idata.funct3 == 0x3 && a.rd && a.rs1 == REG_SP &&
+		    fits_scaled(a.imm, 8, 504))
+			return use_compressed(instruction, "c.ldsp", a);
+		return false;
+	case OP_JALR:
+		if (a.imm || !a.rs1)
+			return false;
+		if (a.rd == 0)
+			return use_compressed(instruction, "c.jr", a);
+		if (a.rd == REG_RA)
+			return use_compressed(instruction, "c.jalr", a);
+		return false;
+	}
+	return false;
+}
+
+static bool compress_rtype(struct instruction *instruction)
+{
+	const struct idata idata = instruction->formation.idata;
+	const struct args a = instruction->args;
+	if (!a.rd)
+		return false;
+
+	if (idata.opcode == OP_OP && idata.funct3 == 0x0 && !idata.funct7) {
+		if (a.rs1 == a.rd && a.rs2)
+			return use_compressed(instruction, "c.add",
+					      two_regs(a.rd, a.rs2));
+		if (a.rs2 == a.rd && a.rs1)
+			return use_compressed(instruction, "c.add",
+					      two_regs(a.rd, a.rs1));
+		if (!a.rs1 && a.rs2)
+			return use_compressed(instruction, "c.mv",
+					      two_regs(a.rd, a.rs2));
+		if (!a.rs2 && a.rs1)
+			return use_compressed(instruction, "c.mv",
+					      two_regs(a.rd, a.rs1));
+		return false;
+	}
+
+	if (!is_creg(a.rd) || !is_creg(a.rs1) || !is_creg(a.rs2))
+		return false;
+
+	static const struct {
+		const char *name;
+		uint8_t opcode;
+		uint8_t funct3;
+		uint8_t funct7;
+		bool commutative;
+	} arith[] = {
+		{ "c.sub", OP_OP, 0x0, 0x20, false },
+		{ "c.xor", OP_OP, 0x4, 0x00, true },
+		{ "c.or", OP_OP, 0x6, 0x00, true },
+		{ "c.and", OP_OP, 0x7, 0x00, true },
+		{ "c.subw", OP_OP32, 0x0, 0x20, false },
+		{ "c.addw", OP_OP32, 0x0, 0x00, true },
+	};
+	for (size_t i = 0; i < sizeof(arith) / sizeof(*arith); i++) {
+		if (idata.opcode != arith[i].opcode ||
+		    idata.funct3 != arith[i].funct3 ||
+		    idata.funct7 != arith[i].funct7)
+			continue;
+		if (a.rs1 == a.rd)
+			return use_compressed(instruction, arith[i].name,
+					      two_regs(a.rd, a.rs2));
+		if (a.rs2 == a.rd && arith[i].commutative)
+			return use_compressed(instruction, arith[i].name,
+					      two_regs(a.rd, a.rs1));
+		return false;
+	}
+	return false;
+}
+
+static bool compress_store(struct instruction *instruction)
+{
+	const struct idata idata = instruction->formation.idata;
+	const struct args a = instruction->args;
+	if (idata.opcode != OP_STORE)
+		return false;
+
+	if (idata.funct3 == 0x2 && is_creg(a.rs1) && is_creg(a.rs2) &&
+	    fits_scaled(a.imm, 4, 124))
+		return use_compressed(instruction, "c.sw", a);
+	if (idata.funct3 == 0x2 && a.rs1 == REG_SP &&
+	    fits_scaled(a.imm, 4, 252))
+		return use_compressed(instruction, "c.swsp", a);
+	if (idata.funct3 == 0x3 && is_creg(a.rs1) && is_creg(a.rs2) &&
+	    fits_scaled(a.imm, 8, 248))
+		return use_compressed(instruction, "c.sd", a);
+	if (idata.funct3 == 0x3 && a.rs1 == REG_SP &&
+	    fits_scaled(a.imm, 8, 504))
+		return use_compressed(instruction, "c.sdsp", a);
+	return false;
+}
+
+static bool compress_pseudo(struct instruction *instruction)
+{
+	const struct formation *formation = &instruction->formation;
+	const struct args a = instruction->args;
+
+	if (formation->form_handler == &form_nop)
+		return use_compressed(instruction, "c.nop", empty_args);
+
+	if (formation->form_handler == &form_math) {
+		if (formation->idata.opcode == MATH_MV && a.rd && a.rs1)
+			return use_compressed(instruction, "c.mv",
+					      two_regs(a.rd, a.rs1));
+		if (formation->idata.opcode == MATH_SEXTW && a.rd &&
+		    a.rd == a.rs1)
+			return use_compressed(instruction, "c.addiw",
+					      single_reg(a.rd, 0));
+		return false;
+	}
+
+	/* li which is a single addi or lui */
+	if (formation->form_handler == &form_load_pseudo &&
+	    formation->idata.opcode == LOAD_IMM && a.rd) {
+		const int64_t upper = lui_upper(a.imm);
+		if (fits_signed(a.imm, 6))
+			return use_compressed(instruction, "c.li",
+					      single_reg(a.rd, a.imm));
+		if (a.rd != REG_SP && upper && fits_signed(upper, 6) &&
+		    upper * 4096 == a.imm)
+			return use_compressed(instruction, "c.lui",
+					      single_reg(a.rd, a.imm));
+		return false;
+	}
+
+	if (formation->form_handler == &form_jump) {
+		if (formation->idata.opcode == JUMP_RET)
+			return use_compressed(instruction, "c.jr",
+					      (struct args){ .rs1 = REG_RA });
+		if (formation->idata.opcode == JUMP_JR && a.rs1)
+			return use_compressed(instruction, "c.jr", a);
+		return false;
+	}
+
+	return false;
+}
+
+bool compress_instruction(struct instruction *instruction)
+{
+	const struct formation *formation = &instruction->formation;
+	if (formation->idata.sz != 4)
+		return false;
+
+	if (formation->form_handler == &form_itype)
+		return compress_itype(instruction);
+	if (formation->form_handler == &form_itype2) {
+		const struct args a = instruction->args;
+		if (formation->idata.opcode == OP_OPI && a.rd == a.rs1 &&
+		    is_creg(a.rd) && a.imm > 0 && a.imm < 64)
+			return use_compressed(instruction, "c.srai", a);
+		return false;
+	}
+	if (formation->form_handler == &form_rtype)
+		return compress_rtype(instruction);
+	if (formation->form_handler == &form_stype)
+		return compress_store(instruction);
+	if (formation->form_handler == &form_utype) {
+		const struct args a = instruction->args;
+		const int64_t upper = lui_upper(a.imm);
+		if (formation->idata.opcode == OP_LUI && a.rd &&
+		    a.rd != REG_SP && upper && fits_signed(upper, 6))
+			return use_compressed(instruction, "c.lui", a);
+		return false;
+	}
+	if (formation->form_handler == &form_syscall) {
+		/* ebreak, ecall has no compressed form */
+		if (formation->idata.funct7 == 0x001)
+			return use_compressed(instruction, "c.ebreak",
+					      empty_args);
+		return false;
+	}
+	return compress_pseudo(instruction);
+}
+
+bool compressible_branch(const struct instruction *instruction)
+{
+	const struct formation *formation = &instruction->formation;
+	const struct args a = instruction->args;
+
+	if (formation->form_handler == &form_btype)
+		return formation->idata.funct3 <= 0x1 && !a.rs2 &&
+		       is_creg(a.rs1);
+	if (formation->form_handler == &form_branchifz)
+		return (formation->idata.opcode == BRANCHIFZ_EQZ ||
+			formation->idata.opcode == BRANCHIFZ_NEZ) &&
+		       is_creg(a.rs1);
+	if (formation->form_handler == &form_jtype)
+		return !a.rd;
+	if (formation->form_handler == &form_jump)
+		return formation->idata.opcode == JUMP_J;
+	return false;
+}
@@ -2,32 +2,36 @@
 #include "form/generic.h"
 
 #include <assert.h>
-#include <string.h>
 
 #include "debug.h"
+#include "form/compressed.h"
 #include "symbols.h"
-#include "xmalloc.h"
 
-const struct bytecode error_bytecode = { .size = (size_t)-1, .data = NULL };
-
-int32_t calc_symbol_offset(const struct symbol *sym, size_t position)
+int32_t calc_symbol_offset(const struct wrasm_ctx *ctx,
+			   const struct symbol *sym, size_t position)
 {
-	const size_t sympos = calc_fileoffset((struct sectionpos){
+	const size_t sympos = calc_fileoffset(ctx, (struct sectionpos){
 		.section = sym->section,
 		.offset = sym->value,
 	});
 	return (int32_t)(sympos - position);
 }
 
-struct bytecode form_empty_bytecode(void)
+int32_t symbol_offset(struct wrasm_ctx *ctx, size_t index, size_t position,
+		      enum reloc_type type)
 {
-	logger(DEBUG, no_error, "Generating empty bytecode");
-	return (struct bytecode){ .size = 0, .data = NULL };
+	const struct symbol *sym = get_symbol_at(ctx, index);
+	if (!needs_relocation(ctx, sym))
+		return calc_symbol_offset(ctx, sym, position);
+	add_relocation(ctx, type, index, position);
+	return 0;
 }
 
-struct bytecode form_rtype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+size_t form_rtype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
+	(void)ctx;
 	(void)position;
 	logger(DEBUG, no_error, "Generating R type instruction %s", name);
 
@@ -40,18 +44,16 @@ struct bytecode form_rtype(const char *name, struct idata instruction,
 
 	assert(instruction.sz == 4);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (rd << 7) | (funct3 << 12) |
-				(rs1 << 15) | (rs2 << 20) | (funct7 << 25);
-	return res;
+	put_u32(out, opcode | (rd << 7) | (funct3 << 12) | (rs1 << 15) |
+		     (rs2 << 20) | (funct7 << 25));
+	return 4;
 }
 
-struct bytecode form_itype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+size_t form_itype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
+	(void)ctx;
 	(void)position;
 	logger(DEBUG, no_error, "Generating I type instruction %s", name);
 
@@ -63,27 +65,27 @@ struct bytecode form_itype(const char *name, struct idata instruction,
 
 	assert(instruction.sz == 4);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (rd << 7) | (funct3 << 12) |
-				(rs1 << 15) | (imm_11_0 << 20);
-	return res;
+	put_u32(out, opcode | (rd << 7) | (funct3 << 12) | (rs1 << 15) |
+		     (imm_11_0 << 20));
+	return 4;
 }
 
-struct bytecode form_itype2(const char *name, struct idata instruction,
-			    struct args args, size_t position)
+size_t form_itype2(struct wrasm_ctx *ctx, const char *name,
+		   struct idata instruction, struct args args, size_t position,
+		   unsigned char *out)
 {
 	logger(DEBUG, no_error, "Generating I type 2 instruction %s", name);
-	struct bytecode res = form_itype(name, instruction, args, position);
-	*(uint32_t *)res.data |= 0x40000000; /* set type 2 bit */
-	return res;
+	const size_t sz =
+		form_itype(ctx, name, instruction, args, position, out);
+	put_u32(out, get_u32(out) | 0x40000000); /* set type 2 bit */
+	return sz;
 }
 
-struct bytecode form_stype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+size_t form_stype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
+	(void)ctx;
 	(void)position;
 	logger(DEBUG, no_error, "Generating S type instruction %s", name);
 
@@ -96,29 +98,14 @@ struct bytecode form_stype(const char *name, struct idata instruction,
 
 	assert(instruction.sz == 4);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (imm_4_0 << 7) | (funct3 << 12) |
-				(rs1 << 15) | (rs2 << 20) | (imm_11_5 << 25);
-	return res;
+	put_u32(out, opcode | (imm_4_0 << 7) | (funct3 << 12) | (rs1 << 15) |
+		     (rs2 << 20) | (imm_11_5 << 25));
+	return 4;
 }
 
-struct bytecode form_btype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+static uint32_t encode_btype(struct idata instruction, struct args args,
+			     uint32_t offset)
 {
-	(void)position;
-	logger(DEBUG, no_error, "Generating B type instruction %s", name);
-
-	if (args.sym->type != SYMBOL_LABEL)
-		logger(ERROR, error_invalid_syntax,
-		       "Incorrect argument types for instruction %s."
-		       " Expected label, but got a different symbol",
-		       args.sym->name);
-
-	const uint32_t offset =
-		(uint32_t)calc_symbol_offset(args.sym, position);
 	const uint32_t opcode = instruction.opcode;
 	const uint32_t imm_11 = (offset >> 11) & 0x1;
 	const uint32_t imm_4_1 = (offset >> 1) & 0xF;
@@ -128,24 +115,71 @@ struct bytecode form_btype(const char *name, struct idata instruction,
 	const uint32_t imm_10_5 = (offset >> 5) & 0x3F;
 	const uint32_t imm_12 = (offset >> 12) & 0x1;
 
-	logger(DEBUG, no_error, "B type instruction has offset of 0x%.04X",
-	       offset);
+	return opcode | (imm_11 << 7) | (imm_4_1 << 8) | (funct3 << 12) |
+	       (rs1 << 15) | (rs2 << 20) | (imm_10_5 << 25) | (imm_12 << 31);
+}
 
-	assert(instruction.sz == 4);
+/* a branch grown by relaxation, which skips a jump when not taken */
+static size_t form_far_branch(struct wrasm_ctx *ctx, const char *name,
+			      struct idata instruction, struct args args,
+			      size_t position, unsigned char *out)
+{
+	logger(DEBUG, no_error, "B type instruction %s relaxed to %zu bytes",
+	       name, instruction.sz);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (imm_11 << 7) | (imm_4_1 << 8) |
-				(funct3 << 12) | (rs1 << 15) | (rs2 << 20) |
-				(imm_10_5 << 25) | (imm_12 << 31);
-	return res;
+	const struct idata jump = { instruction.sz - 4, OP_JAL, 0, 0 };
+	instruction.funct3 ^= 0x1; /* beq <-> bne, blt <-> bge and so on */
+	put_u32(out, encode_btype(instruction, args, (uint32_t)instruction.sz));
+
+	const size_t sz = form_jtype(ctx, name, jump,
+				     (struct args){ .rd = 0, .sym = args.sym },
+				     position + 4, out + 4);
+	return sz == FORM_ERROR ? FORM_ERROR : 4 + sz;
 }
 
-struct bytecode form_utype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+size_t form_btype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
+	logger(DEBUG, no_error, "Generating B type instruction %s", name);
+
+	const struct symbol *sym = get_symbol_at(ctx, args.sym);
+	if (sym->type != SYMBOL_LABEL)
+		logger(ERROR, error_invalid_syntax,
+		       "Incorrect argument types for instruction %s."
+		       " Expected label, but got a different symbol",
+		       get_symbol_name(ctx, sym));
+
+	/* compression only shrinks beqz and bnez, see compressible_branch() */
+	if (instruction.sz == 2)
+		return form_cbranch(ctx, name,
+				    (struct idata){ 2, OP_C1,
+						    0x6 | instruction.funct3,
+						    0 },
+				    args, position, out);
+	if (instruction.sz != 4)
+		return form_far_branch(ctx, name, instruction, args, position,
+				       out);
+
+	const int32_t offset =
+		symbol_offset(ctx, args.sym, position, R_RISCV_BRANCH);
+	if (offset < -0x1000 || offset >= 0x1000)
+		logger(ERROR, error_instruction_other,
+		       "Branch to %s is out of range (offset %d)",
+		       get_symbol_name(ctx, sym), offset);
+
+	logger(DEBUG, no_error, "B type instruction has offset of 0x%.04X",
+	       (uint32_t)offset);
+
+	put_u32(out, encode_btype(instruction, args, (uint32_t)offset));
+	return 4;
+}
+
+size_t form_utype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
+{
+	(void)ctx;
 	(void)position;
 	logger(DEBUG, no_error, "Generating U type instruction %s", name);
 
@@ -155,22 +189,58 @@ struct bytecode form_utype(const char *name, struct idata instruction,
 
 	assert(instruction.sz == 4);
 
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (rd << 7) | (imm_12_31 << 12);
-	return res;
+	put_u32(out, opcode | (rd << 7) | (imm_12_31 << 12));
+	return 4;
 }
 
-struct bytecode form_jtype(const char *name, struct idata instruction,
-			   struct args args, size_t position)
+/* a jump grown by relaxation, rd holds the target address before the jump */
+static size_t form_far_jump(struct wrasm_ctx *ctx, const char *name,
+			    struct args args, size_t position,
+			    unsigned char *out)
+{
+	logger(DEBUG, no_error, "J type instruction %s relaxed to 8 bytes",
+	       name);
+
+	/* plain jumps have no rd to use, so use t1 the same as tail */
+	const uint8_t link = args.rd ? args.rd : 6;
+	const uint32_t offset = (uint32_t)symbol_offset(ctx, args.sym, position,
+							R_RISCV_CALL_PLT);
+
+	form_utype(ctx, "auipc (far jal)", (struct idata){ 4, OP_AUIPC, 0, 0 },
+		   (struct args){
+			   .rd = link,
+			   .imm = (offset + 0x800) & 0xFFFFF000,
+		   },
+		   position, out);
+	form_itype(ctx, "jalr (far jal)", (struct idata){ 4, OP_JALR, 0x0, 0 },
+		   (struct args){
+			   .rd = args.rd,
+			   .rs1 = link,
+			   .imm = offset & 0xFFF,
+		   },
+		   position + 4, out + 4);
+	return 8;
+}
+
+size_t form_jtype(struct wrasm_ctx *ctx, const char *name,
+		  struct idata instruction, struct args args, size_t position,
+		  unsigned char *out)
 {
-	(void)position;
 	logger(DEBUG, no_error, "Generating J type instruction %s", name);
 
-	int32_t offset = calc_symbol_offset(args.sym, position);
+	if (instruction.sz == 2)
+		return form_cjump(ctx, name, (struct idata){ 2, OP_C1, 0x5, 0 },
+				  args, position, out);
+	if (instruction.sz != 4)
+		return form_far_jump(ctx, name, args, position, out);
+
+	int32_t offset = symbol_offset(ctx, args.sym, position, R_RISCV_JAL);
 	logger(DEBUG, no_error, "Offset of J type instruction is 0x%x", offset);
+	if (offset < -0x100000 || offset >= 0x100000)
+		logger(ERROR, error_instruction_other,
+		       "Jump to %s is out of range (offset %d)",
+		       get_symbol_name(ctx, get_symbol_at(ctx, args.sym)),
+		       offset);
 
 	const uint32_t opcode = instruction.opcode;
 	const uint32_t rd = args.rd & 0x1F;
@@ -179,14 +249,7 @@ struct bytecode form_jtype(const char *name, struct idata instruction,
 	const uint32_t imm_10_1 = (offset >> 1) & 0x3FF;
 	const uint32_t imm_20 = (offset >> 20) & 0x1;
 
-	assert(instruction.sz == 4);
-
-	struct bytecode res = {
-		.size = 4,
-		.data = xmalloc(4),
-	};
-	*(uint32_t *)res.data = opcode | (rd << 7) | (imm_19_12 << 12) |
-				(imm_11 << 20) | (imm_10_1 << 21) |
-				(imm_20 << 31);
-	return res;
+	put_u32(out, opcode | (rd << 7) | (imm_19_12 << 12) | (imm_11 << 20) |
+		     (imm_10_1 << 21) | (imm_20 << 31));
+	return 4;
 }
@@ -0,0 +1,130 @@
+#include "form/immediate.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+static inline bool fits_signed(int64_t value, int bits)
+{
+	return value >= -(INT64_C(1) << (bits - 1)) &&
+	       value < (INT64_C(1) << (bits - 1));
+}
+
+/* the low bits of value, sign extended */
+static inline int64_t sign_extend(uint64_t value, int bits)
+{
+	const uint64_t sign = UINT64_C(1) << (bits - 1);
+	return (int64_t)(((value & ((sign << 1) - 1)) ^ sign) - sign);
+}
+
+/* an arithmetic shift, without relying on how >> treats negative values */
+static inline int64_t shift_right(int64_t value, int amount)
+{
+	return sign_extend((uint64_t)value >> amount, 64 - amount);
+}
+
+static int trailing_zeros(uint64_t value)
+{
+	int count = 0;
+	while (!(value & 1)) {
+		value >>= 1;
+		count++;
+	}
+	return count;
+}
+
+static int leading_zeros(uint64_t value)
+{
+	int count = 0;
+	while (!(value & (UINT64_C(1) << 63))) {
+		value <<= 1;
+		count++;
+	}
+	return count;
+}
+
+static void push_step(struct imm_sequence *seq, enum imm_op op, int64_t imm)
+{
+	assert(seq->count < IMM_MAX_STEPS);
+	seq->steps[seq->count++] = (struct imm_step){ op, (int32_t)imm };
+}
+
+static void build_steps(int64_t value, struct imm_sequence *seq)
+{
+	if (fits_signed(value, 32)) {
+		/* round the upper half up when the lower half is negative */
+		const int64_t hi20 =
+			(int64_t)((((uint64_t)value + 0x800) >> 12) & 0xFFFFF);
+		const int64_t lo12 = sign_extend((uint64_t)value, 12);
+		if (hi20)
+			push_step(seq, IMM_LUI, hi20);
+		/* addiw, as addi would carry into the upper 32 bits */
+		if (lo12 || !hi20)
+			push_step(seq, hi20 ? IMM_ADDIW : IMM_ADDI, lo12);
+		return;
+	}
+
+	/* build the upper bits, then shift them up and add the lowest 12 */
+	const int64_t lo12 = sign_extend((uint64_t)value, 12);
+	int64_t upper = (int64_t)((uint64_t)value - (uint64_t)lo12);
+	int shift = 0;
+	if (!fits_signed(upper, 32)) {
+		shift = trailing_zeros((uint64_t)upper);
+		upper = shift_right(upper, shift);
+		/* leave 12 zero bits for lui rather than shifting them in */
+		if (shift > 12 && !fits_signed(upper, 12) &&
+		    fits_signed((int64_t)((uint64_t)upper << 12), 32)) {
+			shift -= 12;
+			upper = (int64_t)((uint64_t)upper << 12);
+		}
+	}
+
+	build_steps(upper, seq);
+	if (shift)
+		push_step(seq, IMM_SLLI, shift);
+	if (lo12)
+		push_step(seq, IMM_ADDI, lo12);
+}
+
+/* replaces seq with the steps for value followed by a shift, if shorter */
+static void try_shifted(int64_t value, enum imm_op op, int shift,
+			struct imm_sequence *seq)
+{
+	struct imm_sequence shifted = { .count = 0 };
+	build_steps(value, &shifted);
+	if (shifted.count + 1 >= seq->count)
+		return;
+	push_step(&shifted, op, shift);
+	*seq = shifted;
+}
+
+void build_imm_sequence(int64_t value, struct imm_sequence *seq)
+{
+	seq->count = 0;
+	build_steps(value, seq);
+
+	/* the low bits of even constants can be shifted in at the end */
+	if ((value & 0xFFF) && !(value & 1) && seq->count >= 2) {
+		const int zeros = trailing_zeros((uint64_t)value);
+		try_shifted(shift_right(value, zeros), IMM_SLLI, zeros, seq);
+	}
+	if (seq->count <= 2 || value <= 0)
+		return;
+
+	/*
+	 * Positive constants can be built shifted up against the sign bit and
+	 * shifted back down, filling the bits shifted out with ones first, as
+	 * for masks, and then with zeros.
+	 */
+	const int zeros = leading_zeros((uint64_t)value);
+	const uint64_t fill = (UINT64_C(1) << zeros) - 1;
+	const uint64_t shifted = (uint64_t)value << zeros;
+	try_shifted((int64_t)(shifted | fill), IMM_SRLI, zeros, seq);
+	try_shifted((int64_t)shifted, IMM_SRLI, zeros, seq);
+}
+
+size_t load_imm_size(int64_t value)
+{
+	struct imm_sequence seq;
+	build_imm_sequence(value, &seq);
+	return 4 * seq.count;
+}
@@ -5,30 +5,29 @@
 #include <string.h>
 
 #include "debug.h"
-#include "form/atomic.h"
-#include "form/base.h"
-#include "form/csr.h"
-#include "form/fencei.h"
 #include "form/generic.h"
-#include "macros.h"
+#include "form/hash.h"
 
-struct formation parse_form(const char *instruction)
+const struct formation *find_formation(const char *instruction, size_t len)
 {
-	logger(DEBUG, no_error, "Getting formation for instruction %s",
-	       instruction);
+	const uint32_t hash = hash_mnemonic(instruction, len);
+	const struct formation *form =
+		formation_hash_slots[formation_hash_slot(hash)];
+	if (!form || strncmp(instruction, form->name, len) || form->name[len])
+		return NULL;
+	return form;
+}
+
+struct formation parse_form(const char *instruction, size_t len)
+{
+	logger(DEBUG, no_error, "Getting formation for instruction %.*s",
+	       (int)len, instruction);
 
-	const struct formation *sets[] = {
-		rv32i, rv64i, rv32a, rv64a, zicsr, zifencei,
-	};
-	for (size_t i = 0; i < ARRAY_LENGTH(sets); i++) {
-		while (sets[i]->name) {
-			if (!strcmp(instruction, sets[i]->name))
-				return *sets[i];
-			sets[i]++;
-		}
-	}
+	const struct formation *form = find_formation(instruction, len);
+	if (form)
+		return *form;
 
 	logger(ERROR, error_invalid_instruction,
-	       "Unknown assembly instruction - %s\n", instruction);
+	       "Unknown assembly instruction - %.*s", (int)len, instruction);
 	return (struct formation)END_FORMATION;
 }
@@ -0,0 +1,236 @@
+#include "format.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "debug.h"
+#include "elf/output.h"
+#include "macros.h"
+#include "xmalloc.h"
+
+static const struct {
+	const char *name;
+	const char *extension;
+} formats[] = {
+	[FORMAT_ELF] = { "elf", ".o" },
+	[FORMAT_BIN] = { "bin", ".bin" },
+	[FORMAT_IHEX] = { "ihex", ".hex" },
+};
+
+int parse_output_format(const char *name, enum output_format *format)
+{
+	for (size_t i = 0; i < ARRAY_LENGTH(formats); i++) {
+		if (strcmp(name, formats[i].name))
+			continue;
+		*format = (enum output_format)i;
+		return 0;
+	}
+	return 1;
+}
+
+const char *get_format_extension(enum output_format format)
+{
+	return formats[format].extension;
+}
+
+/*
+ * Flat output is either streamed to a file or copied into memory. With
+ * neither, the sink only counts how many bytes would have been written.
+ */
+struct sink {
+	FILE *file;
+	unsigned char *buf;
+	size_t len;
+};
+
+static void sink_write(struct sink *sink, const void *bytes, size_t count)
+{
+	if (sink->file)
+		fwrite(bytes, 1, count, sink->file);
+	else if (sink->buf)
+		memcpy(sink->buf + sink->len, bytes, count);
+	sink->len += count;
+}
+
+/*
+ * Symbols are resolved using file offsets, so .text and .data keep the same
+ * distance between them as in the ELF file. This keeps pc relative references
+ * from one to the other intact. Addresses start from 0 at the start of .text.
+ */
+static const enum sections image_sections[] = { SECTION_TEXT, SECTION_DATA };
+
+static size_t image_address(const struct wrasm_ctx *ctx,
+			    enum sections section)
+{
+	return ctx->sections[section].offset -
+	       ctx->sections[SECTION_TEXT].offset;
+}
+
+static void write_bin(const struct wrasm_ctx *ctx, struct sink *sink)
+{
+	static const unsigned char zeroes[16] = { 0 };
+	for (size_t i = 0; i < ARRAY_LENGTH(image_sections); i++) {
+		const struct section *sec = &ctx->sections[image_sections[i]];
+		if (!sec->size)
+			continue;
+		const size_t address = image_address(ctx, image_sections[i]);
+		while (sink->len < address) {
+			size_t gap = address - sink->len;
+			if (gap > sizeof(zeroes))
+				gap = sizeof(zeroes);
+			sink_write(sink, zeroes, gap);
+		}
+		sink_write(sink, sec->contents, sec->size);
+	}
+}
+
+enum ihex_record {
+	IHEX_DATA = 0x00,
+	IHEX_END = 0x01,
+	IHEX_LINEAR_ADDRESS = 0x04,
+};
+
+#define IHEX_RECORD_BYTES 16
+/* start code, count, address, type, data, checksum and newline */
+#define IHEX_RECORD_LENGTH (1 + 2 + 4 + 2 + 2 * IHEX_RECORD_BYTES + 2 + 1)
+
+static char *put_hex_byte(char *out, uint8_t byte)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	*out++ = digits[byte >> 4];
+	*out++ = digits[byte & 0xF];
+	return out;
+}
+
+static void write_ihex_record(struct sink *sink, enum ihex_record type,
+			      uint16_t address, const unsigned char *bytes,
+			      size_t count)
+{
+	const uint8_t header[4] = {
+		(uint8_t)count,
+		(uint8_t)(address >> 8),
+		(uint8_t)address,
+		(uint8_t)type,
+	};
+	char record[IHEX_RECORD_LENGTH];
+	uint8_t checksum = 0;
+	char *c = record;
+
+	*c++ = ':';
+	for (size_t i = 0; i < sizeof(header); i++) {
+		c = put_hex_byte(c, header[i]);
+		checksum += header[i];
+	}
+	for (size_t i = 0; i < count; i++) {
+		c = put_hex_byte(c, bytes[i]);
+		checksum += bytes[i];
+	}
+	c = put_hex_byte(c, (uint8_t)-checksum);
+	*c++ = '\n';
+
+	sink_write(sink, record, (size_t)(c - record));
+}
+
+static int write_ihex(const struct wrasm_ctx *ctx, struct sink *sink)
+{
+	uint32_t upper = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(image_sections); i++) {
+		const struct section *sec = &ctx->sections[image_sections[i]];
+		const size_t base = image_address(ctx, image_sections[i]);
+		if (base + sec->size > UINT32_MAX) {
+			logger(ERROR, error_other,
+			       "Output is too large for Intel HEX addresses");
+			return 1;
+		}
+
+		for (size_t done = 0; done < sec->size;) {
+			const uint32_t address = (uint32_t)(base + done);
+			if (address >> 16 != upper) {
+				upper = address >> 16;
+				const unsigned char ext[2] = {
+					(unsigned char)(upper >> 8),
+					(unsigned char)upper,
+				};
+				write_ihex_record(sink, IHEX_LINEAR_ADDRESS,
+						  0, ext, sizeof(ext));
+			}
+
+			/* records never cross into the next 64KiB */
+			size_t count = 0x10000 - (address & 0xFFFF);
+			if (count > IHEX_RECORD_BYTES)
+				count = IHEX_RECORD_BYTES;
+			if (count > sec->size - done)
+				count = sec->size - done;
+			write_ihex_record(sink, IHEX_DATA, (uint16_t)address,
+					  (const unsigned char *)sec->contents +
+						  done,
+					  count);
+			done += count;
+		}
+	}
+	write_ihex_record(sink, IHEX_END, 0, NULL, 0);
+	return 0;
+}
+
+static int write_flat(const struct wrasm_ctx *ctx, enum output_format format,
+		      struct sink *sink)
+{
+	switch (format) {
+	case FORMAT_BIN:
+		write_bin(ctx, sink);
+		return 0;
+	case FORMAT_IHEX:
+		return write_ihex(ctx, sink);
+	case FORMAT_ELF:
+		break;
+	}
+	logger(CRITICAL, error_internal, "Output format %d is not flat",
+	       (int)format);
+	return 1;
+}
+
+int write_output_format(struct wrasm_ctx *ctx, enum output_format format,
+			FILE *out)
+{
+	if (format == FORMAT_ELF)
+		return flush_output(ctx, out);
+
+	logger(DEBUG, no_error, "Writing %s output", formats[format].name);
+	struct sink sink = { .file = out, .buf = NULL, .len = 0 };
+	if (write_flat(ctx, format, &sink))
+		return 1;
+	if (fflush(out) || ferror(out)) {
+		logger(ERROR, error_system, "Unable to write %s output",
+		       formats[format].name);
+		return 1;
+	}
+	return 0;
+}
+
+int copy_output_format(struct wrasm_ctx *ctx, enum output_format format,
+		       unsigned char **data, size_t *size)
+{
+	if (format == FORMAT_ELF)
+		return copy_output(ctx, data, size);
+
+	logger(DEBUG, no_error, "Copying %s output to memory",
+	       formats[format].name);
+	struct sink counter = { .file = NULL, .buf = NULL, .len = 0 };
+	if (write_flat(ctx, format, &counter))
+		return 1;
+
+	/* one spare byte so that empty output is still a valid allocation */
+	struct sink sink = {
+		.file = NULL,
+		.buf = xmalloc(counter.len + 1),
+		.len = 0,
+	};
+	write_flat(ctx, format, &sink);
+
+	*data = sink.buf;
+	*size = sink.len;
+	return 0;
+}
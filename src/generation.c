@@ -5,149 +5,146 @@
 #include <string.h>
 
 #include "bytecode.h"
+#include "chunks.h"
+#include "context.h"
 #include "debug.h"
 #include "directives.h"
 #include "elf/output.h"
+#include "elf/reloc.h"
+#include "format.h"
+#include "input.h"
+#include "lexer.h"
 #include "parse.h"
-#include "stringutil.h"
+#include "relax.h"
+#include "stats.h"
 #include "symbols.h"
 #include "xmalloc.h"
 
-/*
- * custom getline implementation for cross platform support removes newline at
- * end of line and therefore not compatible with GNU/POSIX getline
- */
-size_t getl(char **lineptr, size_t *n, FILE *stream)
+int parse_input(struct wrasm_ctx *ctx, struct input *input)
 {
-	char *bufptr = NULL;
-	char *p = bufptr;
-	size_t size;
-	int c;
-
-	if (lineptr == NULL)
-		return (size_t)-1;
-	if (stream == NULL)
-		return (size_t)-1;
-	if (n == NULL)
-		return (size_t)-1;
-
-	bufptr = *lineptr;
-	size = *n;
-
-	c = fgetc(stream);
-	if (c == EOF)
-		return (size_t)-1;
-
-	if (!bufptr) {
-		size = 128;
-		bufptr = xmalloc(size);
-	}
-	p = bufptr;
-	while (c != EOF) {
-		if ((size_t)(p - bufptr) > (size - 1)) {
-			size = size + 128;
-			bufptr = xrealloc(bufptr, size);
-		}
-		if (c == '\n')
-			break;
-		*p++ = (char)c;
-		c = fgetc(stream);
+	struct lineview line;
+	int err = 0;
+	while (!err && next_line(input, &line)) {
+		ctx->diagnostics.line++;
+		logger(DEBUG, no_error, "Parsing line \"%.*s\"",
+		       (int)line.len, line.str);
+		err = parse_line(ctx, line.str, get_outputpos(ctx));
+		logger(DEBUG, no_error, " | Finished parsing line");
 	}
-
-	*(p++) = '\0';
-	*lineptr = bufptr;
-	*n = size;
-
-	return (size_t)(p - bufptr - 1);
+	return err;
 }
 
-void parse_file(FILE *ifp, FILE *ofp)
+int assemble_input(struct wrasm_ctx *ctx, struct input *input)
 {
-	char *line = NULL;
-	size_t linesize = 0;
-	size_t nread;
+	ctx->diagnostics.line = 0;
+
+	start_phase(ctx, PHASE_PARSE);
+	if (input->size_hint)
+		reserve_source(ctx, input->size_hint);
+
+	const unsigned chunks = count_chunks(ctx, input);
+	int err = chunks > 1 ? parse_chunks(ctx, input, chunks) :
+			       parse_input(ctx, input);
+
+	close_input(input);
+	count_stat(&ctx->stats, STAT_LINES, ctx->diagnostics.line);
+	ctx->diagnostics.line = 0;
+	/*
+	 * When errors do not exit, instructions whose operands failed to parse
+	 * are still queued with whatever arguments could be read, and must not
+	 * go on to be relaxed and encoded.
+	 */
+	if (err || get_clean_exit(ERROR))
+		return 1;
 
-	linenumber = 0;
+	start_phase(ctx, PHASE_RELAX);
+	if (ctx->compress)
+		compress_instructions(ctx);
+	relax_branches(ctx);
+
+	start_phase(ctx, PHASE_LAYOUT);
+	alloc_output(ctx);
+
+	start_phase(ctx, PHASE_ENCODE);
+	err = write_all(ctx);
+
+	ctx->diagnostics.line = 0;
+
+	start_phase(ctx, PHASE_TABLES);
+	if (label_pcrel_relocations(ctx))
+		err = 1;
+	calc_strtab(ctx);
+	calc_symtab(ctx);
+	calc_relocations(ctx);
+	alloc_tables(ctx);
+	fill_strtab(ctx);
+	fill_symtab(ctx);
+	fill_relocations(ctx);
+	return err;
+}
 
-	fseek(ifp, 0L, SEEK_SET);
+void parse_file(struct wrasm_ctx *ctx, struct input *input, FILE *ofp,
+		enum output_format format)
+{
+	struct diagnostics *prev = use_diagnostics(&ctx->diagnostics);
+	ctx->relocatable = format == FORMAT_ELF;
 
-	while ((nread = getl(&line, &linesize, ifp)) != (size_t)-1) {
-		linenumber++;
-		logger(DEBUG, no_error, "Parsing line \"%s\"", line);
-		if (parse_line(line, get_outputpos()))
-			return;
-		logger(DEBUG, no_error, " | Finished parsing line");
+	if (!assemble_input(ctx, input)) {
+		start_phase(ctx, PHASE_WRITE);
+		write_output_format(ctx, format, ofp);
+		record_section_sizes(ctx);
 	}
 
-	linenumber = 0;
-
-	calc_strtab();
-	calc_symtab();
-	alloc_output();
-
-	write_all();
-
-	free(line);
-
-	linenumber = 0;
-
-	fill_strtab();
-	fill_symtab();
-
-	flush_output(ofp);
-
-	free_output();
-	free_instructions();
-	free_data();
-	free_symbols();
+	start_phase(ctx, PHASE_CLEANUP);
+	reset_context(ctx);
+	start_phase(ctx, PHASE_NONE);
+	use_diagnostics(prev);
 }
 
-static inline int parse_line_trimmed(char *, struct sectionpos);
-int parse_line(char *line, struct sectionpos position)
+static int parse_tokens(struct wrasm_ctx *, const struct token *, size_t,
+			struct sectionpos);
+int parse_line(struct wrasm_ctx *ctx, const char *line,
+	       struct sectionpos position)
 {
-	char *trimmed_line = trim_whitespace(line);
-	const int result = parse_line_trimmed(trimmed_line, position);
-	free(trimmed_line);
-	return result;
+	struct tokenline tokens;
+	if (tokenize(line, &tokens))
+		return 1;
+	return parse_tokens(ctx, tokens.tokens, tokens.count, position);
 }
 
-static inline int parse_line_trimmed(char *line, struct sectionpos position)
+static int parse_tokens(struct wrasm_ctx *ctx, const struct token *tokens,
+			size_t count, struct sectionpos position)
 {
-	logger(DEBUG, no_error, " |-> \"%s\"", line);
-
-	switch (*line) {
-	case '\0':
-	case ';':
+	if (!count)
 		return 0;
+
+	logger(DEBUG, no_error, " |-> %zu tokens", count);
+
+	if (count > 1 && tokens[0].type == TOKEN_IDENTIFIER &&
+	    tokens[1].type == TOKEN_COLON)
+		return parse_label(ctx, tokens, count, position);
+
+	switch (*tokens->str) {
 	case '.':
 	case '[':
-		return parse_directive(line);
-	case '/':
-		if (line[1] == '/')
-			return 0;
+		return parse_directive(ctx, tokens, count);
 	}
 
-	if (strchr(line, ':'))
-		return parse_label(line, position);
-
-	return parse_asm(line, position);
+	return parse_asm(ctx, tokens, count, position);
 }
 
-int parse_label(char *line, struct sectionpos position)
+int parse_label(struct wrasm_ctx *ctx, const struct token *tokens, size_t count,
+		struct sectionpos position)
 {
-	char *end = strchr(line, ':');
-	/* check for invalid label definition */
-	if (end == NULL)
-		return 0;
-
-	logger(DEBUG, no_error, "Creating label (%s)", line);
+	logger(DEBUG, no_error, "Creating label (%.*s)", (int)tokens->len,
+	       tokens->str);
 
-	*(end++) = '\0';
-	char *name = trim_whitespace(line);
-	struct symbol *label = get_or_create_symbol(name, SYMBOL_LABEL);
-	free(name);
+	struct symbol *label = get_or_create_symbol(ctx, tokens->str,
+						    tokens->len, SYMBOL_LABEL);
+	if (!label)
+		return 1;
 
-	const struct sectionpos fpos = get_outputpos();
+	const struct sectionpos fpos = get_outputpos(ctx);
 	if (fpos.offset == (size_t)-1) {
 		logger(CRITICAL, error_system,
 		       "Unable to determine section file position");
@@ -157,8 +154,7 @@ int parse_label(char *line, struct sectionpos position)
 	label->section = fpos.section;
 	label->value = (long)fpos.offset;
 
-	logger(DEBUG, no_error, "Moving on to line (%s %p)", end, end);
-	return parse_line(end, position);
+	return parse_tokens(ctx, tokens + 2, count - 2, position);
 }
 
 int parse_preprocessor(const char *line)
@@ -0,0 +1,193 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_MMAP
+#endif
+
+#include "input.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "debug.h"
+#include "xmalloc.h"
+
+#define STREAM_CHUNK_SIZE 65536
+
+#ifdef HAVE_MMAP
+/*
+ * Map the entire input file into memory. Only regular files can be mapped,
+ * anything else (pipes, terminals etc) falls back to buffered streaming.
+ */
+static bool map_input(struct input *in)
+{
+	const int fd = fileno(in->stream);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size)
+		return false;
+
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+			  0);
+	if (data == MAP_FAILED)
+		return false;
+	posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	in->data = data;
+	in->size = (size_t)st.st_size;
+	in->size_hint = in->size;
+	in->source = INPUT_MAPPED;
+	in->eof = true;
+	return true;
+}
+#endif
+
+int open_input(struct input *in, FILE *stream)
+{
+	*in = (struct input){
+		.stream = stream,
+		.data = NULL,
+		.size = 0,
+		.pos = 0,
+		.capacity = 0,
+		.source = INPUT_STREAM,
+		.eof = false,
+		.tail = NULL,
+		.size_hint = 0,
+	};
+
+#ifdef HAVE_MMAP
+	if (map_input(in)) {
+		logger(DEBUG, no_error, "Mapped %zu bytes of input", in->size);
+		return 0;
+	}
+#endif
+
+	logger(DEBUG, no_error, "Unable to map input, streaming instead");
+	in->capacity = STREAM_CHUNK_SIZE;
+	/* keep a spare byte to terminate the final line */
+	in->data = xmalloc(in->capacity + 1);
+	return 0;
+}
+
+/*
+ * Read source text straight out of memory. The text is not copied, so it has
+ * to stay unchanged until the input is closed.
+ */
+int open_input_buffer(struct input *in, const char *text, size_t len)
+{
+	*in = (struct input){
+		.stream = NULL,
+		/* memchr() is never passed NULL, even for empty sources */
+		.data = (char *)(len ? text : ""),
+		.size = len,
+		.pos = 0,
+		.capacity = 0,
+		.source = INPUT_BUFFER,
+		.eof = true,
+		.tail = NULL,
+		.size_hint = len,
+	};
+	return 0;
+}
+
+/*
+ * Read more data into the stream buffer, discarding everything before the
+ * current position. Returns false once no more data can be read.
+ */
+static bool fill_buffer(struct input *in)
+{
+	if (in->eof)
+		return false;
+
+	const size_t remaining = in->size - in->pos;
+	memmove(in->data, in->data + in->pos, remaining);
+	in->size = remaining;
+	in->pos = 0;
+
+	if (in->size == in->capacity) {
+		in->capacity *= 2;
+		in->data = xrealloc(in->data, in->capacity + 1);
+	}
+
+	const size_t nread = fread(in->data + in->size, 1,
+				   in->capacity - in->size, in->stream);
+	in->size += nread;
+
+	if (nread)
+		return true;
+
+	if (ferror(in->stream))
+		logger(ERROR, error_system, "Unable to read from input file");
+	in->eof = true;
+	return false;
+}
+
+/*
+ * The last line of a file without a trailing newline has nothing after it to
+ * terminate it. For streamed input the spare byte at the end of the buffer is
+ * used, but memory mapped files and caller buffers have to copy the line.
+ */
+static const char *terminate_last_line(struct input *in, size_t len)
+{
+	const char *start = in->data + in->pos;
+	if (in->source == INPUT_STREAM) {
+		in->data[in->pos + len] = '\0';
+		return start;
+	}
+	in->tail = xmalloc(len + 1);
+	memcpy(in->tail, start, len);
+	in->tail[len] = '\0';
+	return in->tail;
+}
+
+bool next_line(struct input *in, struct lineview *line)
+{
+	for (;;) {
+		const char *start = in->data + in->pos;
+		const size_t available = in->size - in->pos;
+		const char *end = memchr(start, '\n', available);
+
+		if (end) {
+			line->str = start;
+			line->len = (size_t)(end - start);
+			in->pos += line->len + 1;
+			return true;
+		}
+
+		if (fill_buffer(in))
+			continue;
+
+		if (!available)
+			return false;
+
+		line->str = terminate_last_line(in, available);
+		line->len = available;
+		in->pos = in->size;
+		return true;
+	}
+}
+
+void close_input(struct input *in)
+{
+	switch (in->source) {
+	case INPUT_STREAM:
+		free(in->data);
+		break;
+	case INPUT_MAPPED:
+#ifdef HAVE_MMAP
+		munmap(in->data, in->size);
+#endif
+		break;
+	case INPUT_BUFFER:
+		break;
+	}
+	free(in->tail);
+	in->data = NULL;
+	in->tail = NULL;
+}
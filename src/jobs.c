@@ -0,0 +1,179 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_PTHREADS
+#endif
+
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "cache.h"
+#include "context.h"
+#include "debug.h"
+#include "files.h"
+#include "generation.h"
+#include "input.h"
+#include "stats.h"
+#include "xmalloc.h"
+
+struct jobqueue {
+	struct job *jobs;
+	size_t count;
+	size_t next;
+	struct stats *totals;
+#ifdef HAVE_PTHREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+/* the input stays open throughout, so that it can be hashed again */
+static void assemble_stream(struct wrasm_ctx *ctx, struct job *job, FILE *in)
+{
+	struct input input;
+	open_input(&input, in);
+
+	struct cache_key key;
+	const bool cacheable =
+		job->cache &&
+		!cache_key(&key, &input, job->format, job->compress);
+	if (cacheable && !fetch_cached(job->cache, &key, job->output)) {
+		count_stat(&ctx->stats, STAT_CACHE_HITS, 1);
+		close_input(&input);
+		return;
+	}
+	if (cacheable)
+		count_stat(&ctx->stats, STAT_CACHE_MISSES, 1);
+
+	char *tempname;
+	FILE *out = open_temp_output(job->output, &tempname);
+	if (!out) {
+		logger(ERROR, error_system, "Unable to open output file %s",
+		       job->output);
+		close_input(&input);
+		discard_temp_output(tempname);
+		job->failed = true;
+		return;
+	}
+
+	parse_file(ctx, &input, out, job->format);
+
+	if (get_clean_exit(ERROR)) {
+		fclose(out);
+		discard_temp_output(tempname);
+		job->failed = true;
+		return;
+	}
+	if (commit_temp_output(out, tempname, job->output)) {
+		logger(ERROR, error_system, "Unable to write output file %s",
+		       job->output);
+		job->failed = true;
+		return;
+	}
+	/* a hit would not repeat any warnings, so only clean objects go in */
+	if (cacheable && !get_clean_exit(WARN) && source_unchanged(&key, in))
+		store_cached(job->cache, &key, job->output);
+}
+
+static void assemble_job(struct wrasm_ctx *ctx, struct job *job)
+{
+	FILE *in;
+	if (open_file(&in, job->input, "r")) {
+		logger(ERROR, error_system, "Unable to open input file");
+		job->failed = true;
+		return;
+	}
+	assemble_stream(ctx, job, in);
+	fclose(in);
+}
+
+static struct job *next_job(struct jobqueue *queue)
+{
+#ifdef HAVE_PTHREADS
+	pthread_mutex_lock(&queue->lock);
+#endif
+	struct job *job = NULL;
+	if (queue->next < queue->count)
+		job = &queue->jobs[queue->next++];
+#ifdef HAVE_PTHREADS
+	pthread_mutex_unlock(&queue->lock);
+#endif
+	return job;
+}
+
+static void run_job(struct jobqueue *queue, struct job *job)
+{
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+	ctx.diagnostics.source = job->input;
+	ctx.compress = job->compress;
+	struct diagnostics *prev = use_diagnostics(&ctx.diagnostics);
+
+	assemble_job(&ctx, job);
+
+	use_diagnostics(prev);
+	free_context(&ctx);
+
+#ifdef HAVE_PTHREADS
+	pthread_mutex_lock(&queue->lock);
+#endif
+	collect_stats(&ctx, queue->totals);
+#ifdef HAVE_PTHREADS
+	pthread_mutex_unlock(&queue->lock);
+#endif
+}
+
+static void *worker(void *arg)
+{
+	struct jobqueue *queue = arg;
+	for (struct job *job; (job = next_job(queue));)
+		run_job(queue, job);
+	return NULL;
+}
+
+size_t run_jobs(struct job *jobs, size_t count, unsigned threads,
+		struct stats *totals)
+{
+	struct jobqueue queue = {
+		.jobs = jobs,
+		.count = count,
+		.next = 0,
+		.totals = totals,
+	};
+
+#ifdef HAVE_PTHREADS
+	pthread_mutex_init(&queue.lock, NULL);
+
+	if (threads > count)
+		threads = (unsigned)count;
+	/* the calling thread takes jobs as well */
+	pthread_t *workers =
+		threads > 1 ? xmalloc((threads - 1) * sizeof(*workers)) : NULL;
+	unsigned started = 0;
+	for (; started + 1 < threads; started++)
+		if (pthread_create(&workers[started], NULL, &worker, &queue))
+			break;
+	if (started + 1 < threads)
+		logger(WARN, error_system,
+		       "Unable to start more than %u assembly threads",
+		       started + 1);
+
+	worker(&queue);
+	for (unsigned i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	free(workers);
+	pthread_mutex_destroy(&queue.lock);
+#else
+	(void)threads;
+	worker(&queue);
+#endif
+
+	size_t failed = 0;
+	for (size_t i = 0; i < count; i++)
+		failed += jobs[i].failed;
+	return failed;
+}
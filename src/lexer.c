@@ -0,0 +1,220 @@
+#include "lexer.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+/*
+ * Every byte is classified with a single table lookup, rather than a chain of
+ * comparisons and <ctype.h> calls. Only ASCII is in any class, the same as
+ * <ctype.h> in the C locale.
+ */
+enum char_class {
+	CHAR_END = 1 << 0,
+	CHAR_COMMENT = 1 << 1,
+	CHAR_SPACE = 1 << 2,
+	CHAR_SYMBOL = 1 << 3,
+	CHAR_DIGIT = 1 << 4,
+	CHAR_LETTER = 1 << 5,
+};
+
+static const unsigned char char_classes[256] = {
+	['\0'] = CHAR_END, ['\n'] = CHAR_END,
+	[';'] = CHAR_COMMENT, ['#'] = CHAR_COMMENT,
+
+	[' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\v'] = CHAR_SPACE,
+	['\f'] = CHAR_SPACE, ['\r'] = CHAR_SPACE,
+
+	['_'] = CHAR_SYMBOL, ['.'] = CHAR_SYMBOL, ['$'] = CHAR_SYMBOL,
+
+	['0'] = CHAR_DIGIT, ['1'] = CHAR_DIGIT, ['2'] = CHAR_DIGIT,
+	['3'] = CHAR_DIGIT, ['4'] = CHAR_DIGIT, ['5'] = CHAR_DIGIT,
+	['6'] = CHAR_DIGIT, ['7'] = CHAR_DIGIT, ['8'] = CHAR_DIGIT,
+	['9'] = CHAR_DIGIT,
+
+	['A'] = CHAR_LETTER, ['B'] = CHAR_LETTER, ['C'] = CHAR_LETTER,
+	['D'] = CHAR_LETTER, ['E'] = CHAR_LETTER, ['F'] = CHAR_LETTER,
+	['G'] = CHAR_LETTER, ['H'] = CHAR_LETTER, ['I'] = CHAR_LETTER,
+	['J'] = CHAR_LETTER, ['K'] = CHAR_LETTER, ['L'] = CHAR_LETTER,
+	['M'] = CHAR_LETTER, ['N'] = CHAR_LETTER, ['O'] = CHAR_LETTER,
+	['P'] = CHAR_LETTER, ['Q'] = CHAR_LETTER, ['R'] = CHAR_LETTER,
+	['S'] = CHAR_LETTER, ['T'] = CHAR_LETTER, ['U'] = CHAR_LETTER,
+	['V'] = CHAR_LETTER, ['W'] = CHAR_LETTER, ['X'] = CHAR_LETTER,
+	['Y'] = CHAR_LETTER, ['Z'] = CHAR_LETTER,
+
+	['a'] = CHAR_LETTER, ['b'] = CHAR_LETTER, ['c'] = CHAR_LETTER,
+	['d'] = CHAR_LETTER, ['e'] = CHAR_LETTER, ['f'] = CHAR_LETTER,
+	['g'] = CHAR_LETTER, ['h'] = CHAR_LETTER, ['i'] = CHAR_LETTER,
+	['j'] = CHAR_LETTER, ['k'] = CHAR_LETTER, ['l'] = CHAR_LETTER,
+	['m'] = CHAR_LETTER, ['n'] = CHAR_LETTER, ['o'] = CHAR_LETTER,
+	['p'] = CHAR_LETTER, ['q'] = CHAR_LETTER, ['r'] = CHAR_LETTER,
+	['s'] = CHAR_LETTER, ['t'] = CHAR_LETTER, ['u'] = CHAR_LETTER,
+	['v'] = CHAR_LETTER, ['w'] = CHAR_LETTER, ['x'] = CHAR_LETTER,
+	['y'] = CHAR_LETTER, ['z'] = CHAR_LETTER,
+};
+
+static inline bool char_is(char c, unsigned classes)
+{
+	return char_classes[(unsigned char)c] & classes;
+}
+
+static inline bool is_line_end(char c)
+{
+	return char_is(c, CHAR_END);
+}
+
+/* the end of the line or the start of a comment */
+static inline bool is_token_end(const char *c)
+{
+	return char_is(*c, CHAR_END | CHAR_COMMENT) ||
+	       (c[0] == '/' && c[1] == '/');
+}
+
+static inline bool is_identifier_start(char c)
+{
+	return char_is(c, CHAR_LETTER | CHAR_SYMBOL);
+}
+
+static inline bool is_identifier_char(char c)
+{
+	return char_is(c, CHAR_LETTER | CHAR_SYMBOL | CHAR_DIGIT);
+}
+
+static const char *lex_string(const char *c)
+{
+	for (c++; *c != '"'; c++) {
+		if (is_line_end(*c))
+			return NULL;
+		if (*c == '\\' && !is_line_end(c[1]))
+			c++;
+	}
+	return c + 1;
+}
+
+static const char *lex_number(const char *c)
+{
+	while (char_is(*c, CHAR_LETTER | CHAR_DIGIT))
+		c++;
+	return c;
+}
+
+static enum token_type lex_token(const char **c)
+{
+	const char *start = *c;
+	const char *end = start + 1;
+	enum token_type type = TOKEN_OTHER;
+
+	switch (*start) {
+	case ',':
+		type = TOKEN_COMMA;
+		break;
+	case ':':
+		type = TOKEN_COLON;
+		break;
+	case '(':
+		type = TOKEN_OPEN_PAREN;
+		break;
+	case ')':
+		type = TOKEN_CLOSE_PAREN;
+		break;
+	case '"':
+		type = TOKEN_STRING;
+		end = lex_string(start);
+		break;
+	case '-':
+	case '+':
+		if (!char_is(start[1], CHAR_DIGIT))
+			break;
+		type = TOKEN_NUMBER;
+		end = lex_number(end);
+		break;
+	default:
+		if (char_is(*start, CHAR_DIGIT)) {
+			type = TOKEN_NUMBER;
+			end = lex_number(end);
+		} else if (is_identifier_start(*start)) {
+			type = TOKEN_IDENTIFIER;
+			while (is_identifier_char(*end))
+				end++;
+		}
+		break;
+	}
+
+	*c = end;
+	return type;
+}
+
+int tokenize(const char *line, struct tokenline *tokens)
+{
+	tokens->count = 0;
+
+	const char *c = line;
+	for (;;) {
+		while (char_is(*c, CHAR_SPACE))
+			c++;
+		if (is_token_end(c))
+			return 0;
+
+		if (tokens->count == MAX_LINE_TOKENS) {
+			logger(ERROR, error_invalid_syntax,
+			       "Too many tokens on a single line");
+			return 1;
+		}
+
+		const char *start = c;
+		const enum token_type type = lex_token(&c);
+		if (!c) {
+			logger(ERROR, error_invalid_syntax,
+			       "Expected '\"' (0x22 double quote) character at end of string");
+			return 1;
+		}
+
+		tokens->tokens[tokens->count++] = (struct token){
+			.str = start,
+			.len = (size_t)(c - start),
+			.type = type,
+		};
+	}
+}
+
+int split_operands(const struct token *tokens, size_t count,
+		   struct operands *operands)
+{
+	operands->count = 0;
+	if (!count)
+		return 0;
+
+	size_t first = 0;
+	for (size_t i = 0; i <= count; i++) {
+		if (i < count && tokens[i].type != TOKEN_COMMA)
+			continue;
+
+		if (operands->count == MAX_OPERANDS) {
+			logger(ERROR, error_invalid_syntax,
+			       "Too many arguments (expected at most %d)",
+			       MAX_OPERANDS);
+			return 1;
+		}
+
+		struct operand *op = &operands->operands[operands->count++];
+		op->tokens = &tokens[first];
+		op->count = i - first;
+		if (op->count) {
+			const struct token *last = &tokens[i - 1];
+			op->str = tokens[first].str;
+			op->len = (size_t)(last->str + last->len - op->str);
+		} else {
+			op->str = "";
+			op->len = 0;
+		}
+		first = i + 1;
+	}
+	return 0;
+}
+
+bool token_equals(const struct token *token, const char *str)
+{
+	return !strncmp(token->str, str, token->len) && !str[token->len];
+}
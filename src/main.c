@@ -1,99 +1,327 @@
-
-#define __STDC_WANT_LIB_EXT1__ 1
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "args.h"
+#include "cache.h"
+#include "context.h"
 #include "debug.h"
+#include "files.h"
+#include "format.h"
 #include "generation.h"
+#include "input.h"
+#include "jobs.h"
+#include "server.h"
+#include "stats.h"
 #include "xmalloc.h"
 
+/* MiB, unless given with --cache-size */
+#define CACHE_DEFAULT_SIZE 256
+
 FILE *inputfile = NULL;
-FILE *outputtempfile = NULL;
 FILE *outputfile = NULL;
-
-static int open(FILE **f, const char *filename, const char *flags)
-{
-#ifdef __STDC_LIB_EXT1__
-	return fopen_s(f, filename, flags));
-#else
-	*f = fopen(filename, flags);
-	return !*f;
-#endif
-}
+/* the output is written next to its destination, then renamed over it */
+char *outputtempname = NULL;
 
 void closefiles(void)
 {
 	if (inputfile)
 		fclose(inputfile);
-	if (outputtempfile)
-		fclose(outputtempfile);
+	inputfile = NULL;
 	if (outputfile && outputfile != stdin && outputfile != stdout &&
 	    outputfile != stderr)
 		fclose(outputfile);
+	outputfile = NULL;
+
+	/* the output was never completed, so leave the destination alone */
+	if (outputtempname) {
+		discard_temp_output(outputtempname);
+		outputtempname = NULL;
+	}
 }
 
-void open_files(void)
+static int commit_output(void)
 {
-	logger(DEBUG, no_error, "Opening files");
+	if (outputfile == stdout)
+		return fflush(stdout) != 0;
 
-	outputtempfile = tmpfile();
-	if (!outputtempfile) {
-		logger(ERROR, error_system, "Unable to create temporary file");
-		exit(EXIT_FAILURE);
-	}
+	const int err = commit_temp_output(outputfile, outputtempname,
+					   *cmdargs.outputfile->filename);
+	outputfile = NULL;
+	outputtempname = NULL;
+	return err;
+}
+
+int open_files(void)
+{
+	logger(DEBUG, no_error, "Opening files");
 
 	logger(DEBUG, no_error, "Opening %s", *cmdargs.inputfile->filename);
-	if (open(&inputfile, *cmdargs.inputfile->filename, "r")) {
+	if (open_file(&inputfile, *cmdargs.inputfile->filename, "r")) {
 		perror("Error: ");
 		logger(ERROR, error_system, "Unable to open input file");
-		exit(EXIT_FAILURE);
+		return 1;
 	}
 
 	if (!**cmdargs.outputfile->filename) {
 		logger(DEBUG, no_error, "All files opened successfully");
 		outputfile = stdout;
-		return;
+		return 0;
 	}
 
-	logger(DEBUG, no_error, "Opening %s", *cmdargs.outputfile->filename);
-	if (open(&outputfile, *cmdargs.outputfile->filename, "wb")) {
+	logger(DEBUG, no_error, "Opening temporary output for %s",
+	       *cmdargs.outputfile->filename);
+	outputfile = open_temp_output(*cmdargs.outputfile->filename,
+				      &outputtempname);
+	if (!outputfile) {
 		perror("Error: ");
 		logger(ERROR, error_system, "Unable to open output file");
-		exit(EXIT_FAILURE);
+		return 1;
 	}
 
 	logger(DEBUG, no_error, "All files opened successfully");
+	return 0;
 }
 
-void copy_files(FILE *dest, FILE *src)
+/* <outdir>/<input name without its extension><output extension> */
+static char *object_name(const char *outdir, const char *basename,
+			 const char *extension, const char *outextension)
 {
-	const long pos = ftell(src);
-	rewind(outputtempfile);
-
-	char *buffer = xmalloc(BUFSIZ);
-	for (;;) {
-		const size_t bytes = fread(buffer, 1, BUFSIZ, src);
-		fwrite(buffer, 1, bytes, dest);
-		if (bytes != BUFSIZ)
-			break;
+	const size_t dirlen = strlen(outdir);
+	const size_t stemlen = strlen(basename) - strlen(extension);
+	const size_t outlen = strlen(outextension) + 1;
+	const int slash = dirlen && outdir[dirlen - 1] != '/';
+	char *name = xmalloc(dirlen + slash + stemlen + outlen);
+
+	memcpy(name, outdir, dirlen);
+	if (slash)
+		name[dirlen] = '/';
+	memcpy(name + dirlen + slash, basename, stemlen);
+	memcpy(name + dirlen + slash + stemlen, outextension, outlen);
+	return name;
+}
+
+static const struct cache *output_cache(struct cache *cache)
+{
+	if (!cmdargs.cachedir->count)
+		return NULL;
+	const size_t size = cmdargs.cachesize->count ?
+				    (size_t)*cmdargs.cachesize->ival :
+				    CACHE_DEFAULT_SIZE;
+	*cache = (struct cache){
+		.dir = *cmdargs.cachedir->sval,
+		.limit = size << 20,
+	};
+	return cache;
+}
+
+static int compare_outputs(const void *a, const void *b)
+{
+	const struct job *const *x = a;
+	const struct job *const *y = b;
+	return strcmp((*x)->output, (*y)->output);
+}
+
+/*
+ * Inputs with the same name in different directories would be assembled to
+ * the same object, each job renaming over the other's. Returns the first such
+ * pair, or NULL if every output is distinct.
+ */
+static const struct job **find_clash(struct job *jobs, size_t count,
+				     const struct job **sorted)
+{
+	for (size_t i = 0; i < count; i++)
+		sorted[i] = &jobs[i];
+	qsort(sorted, count, sizeof(*sorted), &compare_outputs);
+	for (size_t i = 0; i + 1 < count; i++)
+		if (!strcmp(sorted[i]->output, sorted[i + 1]->output))
+			return &sorted[i];
+	return NULL;
+}
+
+static int assemble_files(void)
+{
+	const size_t count = (size_t)cmdargs.inputfile->count;
+	const unsigned threads =
+		cmdargs.jobs->count ? (unsigned)*cmdargs.jobs->ival : 1;
+	struct cache cachedir;
+	const struct cache *cache = output_cache(&cachedir);
+
+	struct job *jobs = xcalloc(count, sizeof(*jobs));
+	for (size_t i = 0; i < count; i++) {
+		jobs[i].input = cmdargs.inputfile->filename[i];
+		jobs[i].output = object_name(
+			*cmdargs.outputfile->filename,
+			cmdargs.inputfile->basename[i],
+			cmdargs.inputfile->extension[i],
+			get_format_extension(cmdargs.outputformat));
+		jobs[i].format = cmdargs.outputformat;
+		jobs[i].compress = cmdargs.compress->count;
+		jobs[i].cache = cache;
+	}
+
+	const struct job **sorted = xmalloc(count * sizeof(*sorted));
+	const struct job **clash = find_clash(jobs, count, sorted);
+	if (clash) {
+		logger(ERROR, error_invalid_syntax,
+		       "%s and %s would both be assembled to %s",
+		       clash[0]->input, clash[1]->input, clash[0]->output);
+		/* only reached if errors were made not to exit */
+		free(sorted);
+		for (size_t i = 0; i < count; i++)
+			free(jobs[i].output);
+		free(jobs);
+		return EXIT_FAILURE;
+	}
+	free(sorted);
+
+	/* errors fail their own job rather than the whole run */
+	set_exit_loglevel(NODEBUG);
+	struct stats totals = { .counters = { 0 } };
+	const size_t failed = run_jobs(jobs, count, threads, &totals);
+
+	for (size_t i = 0; i < count; i++)
+		free(jobs[i].output);
+	free(jobs);
+
+	if (cmdargs.stats->count)
+		print_stats(stderr, &totals);
+	if (failed) {
+		fprintf(stderr, "%s: %zu of %zu files failed to assemble\n",
+			progname, failed, count);
+		return EXIT_FAILURE;
 	}
-	free(buffer);
+	return EXIT_SUCCESS;
+}
 
-	fseek(src, pos, SEEK_SET);
+static void report_stats(struct wrasm_ctx *ctx)
+{
+	if (!cmdargs.stats->count)
+		return;
+	struct stats totals = { .counters = { 0 } };
+	collect_stats(ctx, &totals);
+	print_stats(stderr, &totals);
 }
 
-int main(int argc, char *argv[])
+static int assemble_file(struct wrasm_ctx *ctx)
 {
-	parse_cmdargs(argc, argv);
-	open_files();
-	parse_file(inputfile, outputtempfile);
+	if (open_files()) {
+		closefiles();
+		return EXIT_FAILURE;
+	}
+	struct input input;
+	open_input(&input, inputfile);
+
+	/* output to stdout is never cached */
+	const char *output = *cmdargs.outputfile->filename;
+	struct cache cachedir;
+	const struct cache *cache = output_cache(&cachedir);
+	struct cache_key key;
+	const bool cacheable =
+		cache && *output &&
+		!cache_key(&key, &input, cmdargs.outputformat,
+			   cmdargs.compress->count);
+	if (cacheable && !fetch_cached(cache, &key, output)) {
+		logger(DEBUG, no_error, "Copied %s from the cache", output);
+		count_stat(&ctx->stats, STAT_CACHE_HITS, 1);
+		close_input(&input);
+		closefiles();
+		report_stats(ctx);
+		return EXIT_SUCCESS;
+	}
+	if (cacheable)
+		count_stat(&ctx->stats, STAT_CACHE_MISSES, 1);
+
+	ctx->compress = cmdargs.compress->count;
+	ctx->threads = cmdargs.jobs->count ? (unsigned)*cmdargs.jobs->ival : 1;
+	parse_file(ctx, &input, outputfile, cmdargs.outputformat);
 
 	logger(DEBUG, no_error, "Done generating bytecode");
-	copy_files(outputfile, outputtempfile);
+	if (get_clean_exit(ERROR)) {
+		closefiles();
+		return EXIT_FAILURE;
+	}
+	if (commit_output()) {
+		perror("Error: ");
+		logger(ERROR, error_system, "Unable to write output file");
+	} else if (cacheable && !get_clean_exit(WARN) &&
+		   source_unchanged(&key, inputfile)) {
+		/* a hit would not repeat the warnings */
+		store_cached(cache, &key, output);
+	}
 	logger(DEBUG, no_error, "Finished writing bytecode to output");
 	closefiles();
 
+	report_stats(ctx);
 	return get_clean_exit(ERROR);
 }
+
+static int assemble(struct wrasm_ctx *ctx)
+{
+	if (cmdargs.inputfile->count > 1)
+		return assemble_files();
+
+	struct diagnostics *prev = use_diagnostics(&ctx->diagnostics);
+	const int status = assemble_file(ctx);
+	use_diagnostics(prev);
+	return status;
+}
+
+/*
+ * Kept by the server from one request to the next, so that once it has seen
+ * its largest source it no longer allocates.
+ */
+static struct wrasm_ctx server_ctx;
+
+/* runs in the server itself, so a request must never exit, see run_server() */
+static int serve_request(int argc, char *argv[])
+{
+	/* only the request's own --verbose applies, not the server's */
+	minloglevel = WARN;
+	server_ctx.diagnostics = (struct diagnostics){ .keep_going = true };
+	server_ctx.stats = (struct stats){ .counters = { 0 } };
+	server_ctx.timer = (struct phasetimer){ .phase = PHASE_NONE };
+	struct diagnostics *prev = use_diagnostics(&server_ctx.diagnostics);
+
+	int status = parse_cmdargs(argc, argv);
+	if (status < 0 && cmdargs.server->count) {
+		logger(ERROR, error_invalid_syntax,
+		       "A request cannot start another server");
+		status = EXIT_FAILURE;
+	}
+	/* --connect is what sent the request here in the first place */
+	if (status < 0)
+		status = assemble(&server_ctx);
+
+	use_diagnostics(prev);
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	int status = parse_cmdargs(argc, argv);
+	if (status >= 0)
+		return status;
+	atexit(&closefiles);
+
+	if (cmdargs.server->count) {
+		init_context(&server_ctx);
+		status = run_server(*cmdargs.server->sval, &serve_request);
+		free_context(&server_ctx);
+		return status;
+	}
+
+	if (cmdargs.connect->count) {
+		status = forward_request(*cmdargs.connect->sval, argc, argv);
+		if (status >= 0)
+			return status;
+		logger(INFO, no_error, "No server on %s, assembling here",
+		       *cmdargs.connect->sval);
+	}
+
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+	status = assemble(&ctx);
+	free_context(&ctx);
+	return status;
+}
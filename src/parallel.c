@@ -0,0 +1,86 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_PTHREADS
+#endif
+
+#include "parallel.h"
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "xmalloc.h"
+
+/* 0 until set_processors(), when the system is asked instead */
+static unsigned processors_set = 0;
+
+void set_processors(unsigned count)
+{
+	processors_set = count;
+}
+
+unsigned usable_threads(unsigned requested)
+{
+	if (!requested)
+		requested = 1;
+	if (processors_set)
+		return requested > processors_set ? processors_set : requested;
+#ifdef HAVE_PTHREADS
+	const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (processors > 0 && requested > (unsigned long)processors)
+		return (unsigned)processors;
+	return requested;
+#else
+	(void)requested;
+	return 1;
+#endif
+}
+
+struct task {
+	void (*fn)(void *);
+	void *item;
+#ifdef HAVE_PTHREADS
+	pthread_t thread;
+#endif
+};
+
+static void *run_task(void *arg)
+{
+	struct task *task = arg;
+	task->fn(task->item);
+	return NULL;
+}
+
+void run_parallel(void (*fn)(void *), void *items, size_t size,
+		  unsigned count)
+{
+	if (!count)
+		return;
+
+	struct task *tasks = xmalloc(count * sizeof(*tasks));
+	for (unsigned i = 0; i < count; i++)
+		tasks[i] = (struct task){
+			.fn = fn,
+			.item = (char *)items + i * size,
+		};
+
+	unsigned started = 1;
+#ifdef HAVE_PTHREADS
+	for (; started < count; started++)
+		if (pthread_create(&tasks[started].thread, NULL, &run_task,
+				   &tasks[started]))
+			break;
+#endif
+
+	run_task(&tasks[0]);
+	for (unsigned i = started; i < count; i++)
+		run_task(&tasks[i]);
+#ifdef HAVE_PTHREADS
+	for (unsigned i = 1; i < started; i++)
+		pthread_join(tasks[i].thread, NULL);
+#endif
+	free(tasks);
+}
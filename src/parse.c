@@ -1,812 +1,702 @@
 
 #include "parse.h"
 
-#include <ctype.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "bytecode.h"
+#include "context.h"
 #include "debug.h"
 #include "elf/output.h"
+#include "form/base.h"
+#include "form/immediate.h"
 #include "form/instructions.h"
+#include "lexer.h"
 #include "registers.h"
-#include "stringutil.h"
 #include "symbols.h"
-#include "xmalloc.h"
 
 const struct args empty_args = {
 	.rd = 0,
 	.rs1 = 0,
 	.rs2 = 0,
 	.imm = 0,
-	.sym = NULL,
+	.sym = NO_SYMBOL,
 };
 
-static char *trim_arg(char *s)
+static uint8_t expect_reg(const struct operand *arg)
 {
-	const char *tok = strtok(s, ",");
-	if (!tok)
-		return NULL;
-	return trim_whitespace(tok);
-}
-
-static uint8_t expect_reg(char *arg)
-{
-	size_t reg = get_register_id(arg);
+	size_t reg = (size_t)-1;
+	if (arg->count == 1 && arg->tokens->type == TOKEN_IDENTIFIER)
+		reg = get_register_id(arg->tokens->str, arg->tokens->len);
 	if (reg == (size_t)-1)
 		logger(ERROR, error_instruction_other,
-		       "Expected register but got %s", arg);
+		       "Expected register but got %.*s", (int)arg->len,
+		       arg->str);
 	return (uint8_t)reg;
 }
 
-static void expect_offreg(char *arg, int32_t *offset, uint8_t *reg)
+static void expect_offreg(const struct operand *arg, int64_t *offset,
+			  uint8_t *reg)
 {
-	*offset = (int32_t)strtol(arg, &arg, 0);
+	const struct token *tok = arg->tokens;
+	const struct token *end = arg->tokens + arg->count;
 
-	while (isspace(*arg))
-		arg++;
+	*offset = 0;
+	if (tok != end && tok->type == TOKEN_NUMBER) {
+		size_t imm;
+		if (get_immediate(tok->str, tok->len, &imm))
+			logger(ERROR, error_instruction_other,
+			       "Expected integer offset but got %.*s",
+			       (int)tok->len, tok->str);
+		*offset = (int64_t)imm;
+		tok++;
+	}
 
-	if (*arg != '(')
+	if (tok == end || tok->type != TOKEN_OPEN_PAREN) {
 		logger(ERROR, error_instruction_other,
-		       "Expected '(' but got '%c'", *arg);
-	arg++;
-	char *closing = arg;
-	while (*closing != ')') {
-		if (!*closing) {
-			logger(ERROR, error_instruction_other,
-			       "Expected closing parenthesis");
-			return;
-		}
-		closing++;
+		       "Expected '(' but got \"%.*s\"",
+		       (int)(tok == end ? 0 : tok->len),
+		       tok == end ? "" : tok->str);
+		return;
+	}
+	tok++;
+
+	if (end - tok < 2 || tok[1].type != TOKEN_CLOSE_PAREN) {
+		logger(ERROR, error_instruction_other,
+		       "Expected closing parenthesis");
+		return;
 	}
-	*closing = '\0';
 
-	size_t r = get_register_id(arg);
+	size_t r = (size_t)-1;
+	if (tok->type == TOKEN_IDENTIFIER)
+		r = get_register_id(tok->str, tok->len);
 
 	if (r == (size_t)-1)
 		logger(ERROR, error_instruction_other,
-		       "Expected register but got %s", arg);
+		       "Expected register but got %.*s", (int)tok->len,
+		       tok->str);
 
 	*reg = (uint8_t)r;
 
-	closing++;
-	if (*closing)
+	tok += 2;
+	if (tok != end)
 		logger(ERROR, error_instruction_other,
-		       "Received unexpected expression \"%s\"", closing);
+		       "Received unexpected expression \"%.*s\"",
+		       (int)(arg->str + arg->len - tok->str), tok->str);
 }
 
-static uint32_t expect_imm(char *arg)
+static int64_t expect_imm(const struct operand *arg)
 {
-	size_t imm;
-	if (get_immediate(arg, &imm))
+	size_t imm = 0;
+	if (arg->count != 1 || arg->tokens->type != TOKEN_NUMBER ||
+	    get_immediate(arg->tokens->str, arg->tokens->len, &imm))
 		logger(ERROR, error_instruction_other,
-		       "Expected immediate but got %s", arg);
-	return (uint32_t)imm;
+		       "Expected immediate but got %.*s", (int)arg->len,
+		       arg->str);
+	return (int64_t)imm;
 }
 
-static uint16_t expect_csr(char *arg)
+static uint16_t expect_csr(const struct operand *arg)
 {
-	const uint16_t csr = get_csr(arg);
+	uint16_t csr = 0xFFFF;
+	if (arg->count == 1)
+		csr = get_csr(arg->tokens->str, arg->tokens->len);
 	if (csr == 0xFFFF)
 		logger(ERROR, error_instruction_other,
-		       "Expected valid control/status register but got %s",
-		       arg);
+		       "Expected valid control/status register but got %.*s",
+		       (int)arg->len, arg->str);
 	return csr;
 }
 
-static int expect_one_arg(char *first)
+static size_t expect_symbol(struct wrasm_ctx *ctx, const struct operand *arg)
 {
-	if (strtok(NULL, ",")) {
-		logger(ERROR, error_instruction_other,
-		       "Instruction has more than one argument");
-		return 0;
-	}
-
-	if (!first) {
+	if (arg->count != 1 || arg->tokens->type != TOKEN_IDENTIFIER) {
 		logger(ERROR, error_instruction_other,
-		       "Expected one argument, not none");
-		return 1;
+		       "Expected symbol but got %.*s", (int)arg->len,
+		       arg->str);
+		return NO_SYMBOL;
 	}
-	return 0;
+	const struct symbol *sym = get_or_create_symbol(
+		ctx, arg->tokens->str, arg->tokens->len, SYMBOL_LABEL);
+	return sym ? get_symbol_index(ctx, sym) : NO_SYMBOL;
 }
 
-static int expect_two_args(char *first, char *second)
+static int expect_args(const struct operands *ops, size_t count)
 {
-	if (strtok(NULL, ",")) {
-		logger(ERROR, error_instruction_other,
-		       "Instruction has more than two arguments");
+	if (ops->count == count)
 		return 0;
-	}
 
-	if (!first) {
-		logger(ERROR, error_instruction_other,
-		       "Expected two arguments, not none");
-		return 1;
-	}
-	if (!second) {
-		logger(ERROR, error_instruction_other,
-		       "Expected two arguments, not one");
-		free(first);
-		return 1;
-	}
-	return 0;
+	logger(ERROR, error_instruction_other,
+	       "Expected %zu argument(s) but got %zu", count, ops->count);
+	return 1;
 }
 
-static int expect_three_args(char *first, char *second, char *third)
+int parse_asm(struct wrasm_ctx *ctx, const struct token *tokens, size_t count,
+	      struct sectionpos position)
 {
-	if (strtok(NULL, ",")) {
-		logger(ERROR, error_instruction_other,
-		       "Instruction has more than three arguments");
-		return 0;
-	}
+	logger(DEBUG, no_error, "Parsing assembly %.*s", (int)tokens->len,
+	       tokens->str);
 
-	if (!first) {
-		logger(ERROR, error_instruction_other,
-		       "Expected three arguments, not none");
-		return 1;
-	}
-	if (!second) {
-		logger(ERROR, error_instruction_other,
-		       "Expected three arguments, not one");
-		free(first);
-		return 1;
-	}
-	if (!third) {
-		logger(ERROR, error_instruction_other,
-		       "Expected three arguments, not two");
-		free(first);
-		free(second);
+	if (tokens->type != TOKEN_IDENTIFIER) {
+		logger(ERROR, error_invalid_syntax,
+		       "Expected instruction but got %.*s", (int)tokens->len,
+		       tokens->str);
 		return 1;
 	}
-	return 0;
-}
-
-int parse_asm(const char *linestr, struct sectionpos position)
-{
-	logger(DEBUG, no_error, "Parsing assembly %s", linestr);
 
-	char *line = xmalloc(strlen(linestr) + 1);
-	strcpy(line, linestr);
-
-	char *instruction = strtok(line, " \t");
-	char *argstr = strtok(NULL, "");
+	struct formation formation = parse_form(tokens->str, tokens->len);
+	if (!formation.name)
+		return 1;
 
-	const struct formation formation = parse_form(instruction);
-	const struct args args = formation.arg_handler(argstr);
+	struct operands ops;
+	if (split_operands(tokens + 1, count - 1, &ops))
+		return 1;
 
-	free(line);
+	const struct args args = formation.arg_handler(ctx, &ops);
+	/* li is only as long as the sequence its constant needs */
+	if (formation.form_handler == &form_load_pseudo &&
+	    formation.idata.opcode == LOAD_IMM)
+		formation.idata.sz = load_imm_size(args.imm);
 
-	add_instruction((struct instruction){
+	const struct instruction instruction = {
 		.formation = formation,
 		.args = args,
-		.line = linenumber,
+		.line = ctx->diagnostics.line,
 		.position = position,
-	});
-	inc_outputsize(position.section, formation.idata.sz);
+	};
+	add_instruction(ctx, instruction);
+	inc_outputsize(ctx, position.section, formation.idata.sz);
 	logger(DEBUG, no_error, "Updated position to offset (%zu)",
 	       position.offset);
 
 	return 0;
 }
 
-struct args parse_none(char *argstr)
+struct args parse_none(struct wrasm_ctx *ctx, const struct operands *ops)
 {
+	(void)ctx;
 	logger(DEBUG, no_error,
 	       "Parsing arguments for no argument instruction");
 
-	if (!argstr)
-		return empty_args;
-
-	for (char *c = argstr; *c; c++)
-		if (*c == ',')
-			logger(ERROR, error_instruction_other,
-			       "Expected zero arguments, but got at least one");
+	if (ops->count)
+		logger(ERROR, error_instruction_other,
+		       "Expected zero arguments, but got at least one");
 
 	return empty_args;
 }
 
-struct args parse_rtype(char *argstr)
+struct args parse_rtype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for rtype instruction %s",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for rtype instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
-
-	logger(DEBUG, no_error, "Parsed %s, %s, %s", first, second, third);
-
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	const struct args args = {
-		.rd = expect_reg(first),
-		.rs1 = expect_reg(second),
-		.rs2 = expect_reg(third),
-		.sym = NULL,
+		.rd = expect_reg(&ops->operands[0]),
+		.rs1 = expect_reg(&ops->operands[1]),
+		.rs2 = expect_reg(&ops->operands[2]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-	free(third);
-
 	logger(DEBUG, no_error, "Registers parsed x%d, x%d, x%d", args.rd,
 	       args.rs1, args.rs2);
 
 	return args;
 }
 
-struct args parse_itype(char *argstr)
+struct args parse_itype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for itype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for itype instruction");
 
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	const struct args args = {
-		.rd = expect_reg(first),
-		.rs1 = expect_reg(second),
-		.imm = expect_imm(third),
-		.sym = NULL,
+		.rd = expect_reg(&ops->operands[0]),
+		.rs1 = expect_reg(&ops->operands[1]),
+		.imm = expect_imm(&ops->operands[2]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-	free(third);
-
-	logger(DEBUG, no_error, "Registers parsed x%d, x%d, %d", args.rd,
+	logger(DEBUG, no_error, "Registers parsed x%d, x%d, %" PRId64, args.rd,
 	       args.rs1, args.imm);
 
 	return args;
 }
 
-struct args parse_ltype(char *argstr)
+struct args parse_ltype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for itype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for ltype instruction");
 
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	struct args args = {
-		.rd = expect_reg(first),
-		.sym = NULL,
+		.rd = expect_reg(&ops->operands[0]),
+		.sym = NO_SYMBOL,
 	};
 
-	expect_offreg(second, &args.imm, &args.rs1);
+	expect_offreg(&ops->operands[1], &args.imm, &args.rs1);
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d, %d(x%d)", args.rd,
-	       args.imm, args.rs1);
+	logger(DEBUG, no_error, "Registers parsed x%d, %" PRId64 "(x%d)",
+	       args.rd, args.imm, args.rs1);
 
 	return args;
 }
 
-struct args parse_stype(char *argstr)
+struct args parse_stype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for itype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for stype instruction");
 
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	struct args args = {
-		.rs2 = expect_reg(second),
-		.sym = NULL,
+		.rs2 = expect_reg(&ops->operands[0]),
+		.sym = NO_SYMBOL,
 	};
 
-	expect_offreg(first, &args.imm, &args.rs1);
+	expect_offreg(&ops->operands[1], &args.imm, &args.rs1);
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed %d(x%d), x%d", args.imm,
-	       args.rs1, args.rs2);
+	logger(DEBUG, no_error, "Registers parsed x%d, %" PRId64 "(x%d)",
+	       args.rs2, args.imm, args.rs1);
 
 	return args;
 }
 
-struct args parse_utype(char *argstr)
+struct args parse_utype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for utype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for utype instruction");
 
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	const struct args args = {
-		.rd = expect_reg(first),
-		.imm = expect_imm(second),
-		.sym = NULL,
+		.rd = expect_reg(&ops->operands[0]),
+		.imm = expect_imm(&ops->operands[1]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d, %d", args.rd, args.imm);
+	logger(DEBUG, no_error, "Registers parsed x%d, %" PRId64, args.rd,
+	       args.imm);
 
 	return args;
 }
 
-struct args parse_btype(char *argstr)
+struct args parse_btype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for jtype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
+	logger(DEBUG, no_error, "Parsing arguments for btype instruction");
 
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	const struct args args = {
-		.rs1 = expect_reg(first),
-		.rs2 = expect_reg(second),
-		.sym = get_or_create_symbol(third, SYMBOL_LABEL),
+		.rs1 = expect_reg(&ops->operands[0]),
+		.rs2 = expect_reg(&ops->operands[1]),
+		.sym = expect_symbol(ctx, &ops->operands[2]),
 	};
 
-	free(first);
-	free(second);
-	free(third);
-
-	logger(DEBUG, no_error, "Registers parsed x%d, x%d, %s", args.rs1,
-	       args.rs2, args.sym->name);
+	logger(DEBUG, no_error, "Registers parsed x%d, x%d, %.*s", args.rs1,
+	       args.rs2, (int)ops->operands[2].len, ops->operands[2].str);
 
 	return args;
 }
 
-struct args parse_bztype(char *argstr)
+struct args parse_bztype(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for bztype instruction %s",
-	       argstr);
+	logger(DEBUG, no_error, "Parsing arguments for bztype instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	const struct args args = {
-		.rs1 = expect_reg(first),
-		.sym = get_or_create_symbol(second, SYMBOL_LABEL),
+		.rs1 = expect_reg(&ops->operands[0]),
+		.sym = expect_symbol(ctx, &ops->operands[1]),
 	};
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d, %s", args.rs1,
-	       args.sym->name);
+	logger(DEBUG, no_error, "Registers parsed x%d, %.*s", args.rs1,
+	       (int)ops->operands[1].len, ops->operands[1].str);
 
 	return args;
 }
 
-struct args parse_pseudo(char *argstr)
+struct args parse_pseudo(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for pseudo instruction",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for pseudo instruction");
+
+	if (expect_args(ops, 2))
+		return empty_args;
+
+	const struct args args = {
+		.rd = expect_reg(&ops->operands[0]),
+		.rs1 = expect_reg(&ops->operands[1]),
+		.sym = NO_SYMBOL,
+	};
+
+	logger(DEBUG, no_error, "Registers parsed x%d, x%d", args.rd, args.rs1);
+
+	return args;
+}
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
+struct args parse_ci(struct wrasm_ctx *ctx, const struct operands *ops)
+{
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for ci instruction");
 
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
+	const uint8_t reg = expect_reg(&ops->operands[0]);
 	const struct args args = {
-		.rd = expect_reg(first),
-		.rs1 = expect_reg(second),
-		.sym = NULL,
+		.rd = reg,
+		.rs1 = reg,
+		.imm = expect_imm(&ops->operands[1]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
+	logger(DEBUG, no_error, "Registers parsed x%d, %" PRId64, args.rd,
+	       args.imm);
 
-	logger(DEBUG, no_error, "Registers parsed x%d, x%d", args.rd, args.rs1);
+	return args;
+}
+
+struct args parse_cr(struct wrasm_ctx *ctx, const struct operands *ops)
+{
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for cr instruction");
+
+	if (expect_args(ops, 2))
+		return empty_args;
+
+	const uint8_t reg = expect_reg(&ops->operands[0]);
+	const struct args args = {
+		.rd = reg,
+		.rs1 = reg,
+		.rs2 = expect_reg(&ops->operands[1]),
+		.sym = NO_SYMBOL,
+	};
+
+	logger(DEBUG, no_error, "Registers parsed x%d, x%d", args.rd, args.rs2);
 
 	return args;
 }
 
-static int parse_fence_arg(const char *arg)
+static int parse_fence_arg(const struct operand *arg)
 {
 	const char *key = "iorw";
+	const char *c = arg->str;
+	const char *end = arg->str + arg->len;
 	int iorw = 0;
-	for (const char *c = key; *c; c++) {
+	for (const char *k = key; *k; k++) {
 		iorw <<= 1;
-		if (*c != *arg)
+		if (c == end || *k != *c)
 			continue;
 		iorw |= 1;
-		arg++;
+		c++;
 	}
-	if (*arg)
+	if (c != end || arg->count != 1)
 		logger(ERROR, error_instruction_other,
-		       "expected combination of iorw but encountered '%c' character",
-		       *arg);
+		       "expected combination of iorw but got \"%.*s\"",
+		       (int)arg->len, arg->str);
 	return iorw;
 }
 
-struct args parse_fence(char *argstr)
+struct args parse_fence(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for fence instruction",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for fence instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-
-	if (!first)
+	if (!ops->count)
 		return (struct args){
 			.rd = 0x0,
 			.rs1 = 0x0,
 			.imm = 0xFF,
-			.sym = NULL,
+			.sym = NO_SYMBOL,
 		};
 
-	if (strtok(NULL, ","))
-		logger(ERROR, error_instruction_other,
-		       "Instruction has more than two arguments");
-
-	if (!second) {
-		logger(ERROR, error_instruction_other,
-		       "Expected two arguments but got one");
+	if (expect_args(ops, 2))
 		return empty_args;
-	}
-
-	const int predecessor = parse_fence_arg(first);
-	const int successor = parse_fence_arg(second);
 
-	free(first);
-	free(second);
+	const int predecessor = parse_fence_arg(&ops->operands[0]);
+	const int successor = parse_fence_arg(&ops->operands[1]);
 
 	return (struct args){
 		.rd = 0x0,
 		.rs1 = 0x0,
 		.imm = (predecessor << 4) | successor,
-		.sym = NULL,
+		.sym = NO_SYMBOL,
 	};
 }
 
-struct args parse_jal(char *argstr)
+struct args parse_jal(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for jal instruction %s",
-	       argstr);
+	logger(DEBUG, no_error, "Parsing arguments for jal instruction");
 
 	struct args args = { .rd = 1 };
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *sym = first;
-
-	if (strtok(NULL, ","))
+	if (ops->count > 2)
 		logger(ERROR, error_instruction_other,
 		       "Expected at most two arguments");
 
-	if (!first) {
+	if (!ops->count) {
 		logger(ERROR, error_invalid_instruction,
 		       "Expected at least one argument");
 		return empty_args;
 	}
 
-	if (second) {
-		args.rd = expect_reg(first);
-		free(first);
-		sym = second;
-		if (!sym)
-			logger(ERROR, error_invalid_instruction,
-			       "Expected a second argument");
+	const struct operand *sym = &ops->operands[0];
+	if (ops->count > 1) {
+		args.rd = expect_reg(&ops->operands[0]);
+		sym = &ops->operands[1];
 	}
 
-	args.sym = get_or_create_symbol(sym, SYMBOL_LABEL);
-	free(sym);
+	args.sym = expect_symbol(ctx, sym);
 
-	logger(DEBUG, no_error, "Registers parsed, x%d, %s", args.rd,
-	       args.sym->name);
+	logger(DEBUG, no_error, "Registers parsed, x%d, %.*s", args.rd,
+	       (int)sym->len, sym->str);
 
 	return args;
 }
 
-struct args parse_jalr(char *argstr)
+struct args parse_jalr(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for jalr instruction %s",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for jalr instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
-
-	if (strtok(NULL, ","))
+	if (ops->count > 3)
 		logger(ERROR, error_instruction_other,
 		       "Instruction has more than three arguments");
 
-	if (!first) {
+	if (!ops->count) {
 		logger(DEBUG, error_instruction_other,
 		       "Expected at least one argument");
 		return empty_args;
 	}
 
-	const uint8_t rd = expect_reg(first);
-	free(first);
+	const uint8_t rd = expect_reg(&ops->operands[0]);
 
-	if (!second) {
+	if (ops->count == 1) {
 		logger(DEBUG, no_error, "jalr (pseudo) arguments parsed -> x%d",
 		       rd);
 		return (struct args){
 			.rd = 0x1,
 			.rs1 = rd,
 			.imm = 0,
-			.sym = NULL,
+			.sym = NO_SYMBOL,
 		};
 	}
 
-	if (!third) {
+	if (ops->count == 2) {
 		logger(ERROR, error_instruction_other,
 		       "Expected one or three arguments but got two");
-		free(second);
 		return empty_args;
 	}
 
-	const uint8_t rs1 = expect_reg(second);
-	const uint32_t imm = expect_imm(third);
-
-	free(second);
-	free(third);
+	const uint8_t rs1 = expect_reg(&ops->operands[1]);
+	const int64_t imm = expect_imm(&ops->operands[2]);
 
-	logger(DEBUG, no_error, "jalr arguments parsed x%d x%d %d", rd, rs1,
-	       imm);
+	logger(DEBUG, no_error, "jalr arguments parsed x%d x%d %" PRId64, rd,
+	       rs1, imm);
 
 	return (struct args){
 		.rd = rd,
 		.rs1 = rs1,
 		.imm = imm,
-		.sym = NULL,
+		.sym = NO_SYMBOL,
 	};
 }
 
-struct args parse_la(char *argstr)
+struct args parse_la(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for la instruction",
-	       argstr);
+	logger(DEBUG, no_error, "Parsing arguments for la instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	const struct args args = {
-		.rd = expect_reg(first),
-		.sym = get_or_create_symbol(second, SYMBOL_LABEL),
+		.rd = expect_reg(&ops->operands[0]),
+		.sym = expect_symbol(ctx, &ops->operands[1]),
 	};
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d x%d", args.rd, args.rs1);
+	logger(DEBUG, no_error, "Registers parsed x%d %.*s", args.rd,
+	       (int)ops->operands[1].len, ops->operands[1].str);
 
 	return args;
 }
 
-struct args parse_li(char *argstr)
+struct args parse_li(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for li instruction",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for li instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	const struct args args = {
-		.rd = expect_reg(first),
-		.imm = expect_imm(second),
-		.sym = NULL,
+		.rd = expect_reg(&ops->operands[0]),
+		.imm = expect_imm(&ops->operands[1]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d x%d", args.rd, args.rs1);
+	logger(DEBUG, no_error, "Registers parsed x%d %" PRId64, args.rd,
+	       args.imm);
 
 	return args;
 }
 
-struct args parse_j(char *argstr)
+struct args parse_j(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for li instruction",
-	       argstr);
+	logger(DEBUG, no_error, "Parsing arguments for j instruction");
 
-	char *first = trim_arg(argstr);
-
-	if (expect_one_arg(first))
+	if (expect_args(ops, 1))
 		return empty_args;
 
 	const struct args args = {
-		.sym = get_or_create_symbol(first, SYMBOL_LABEL),
+		.sym = expect_symbol(ctx, &ops->operands[0]),
 	};
 
-	logger(DEBUG, no_error, "Symbol parsed %s", args.sym->name);
+	logger(DEBUG, no_error, "Symbol parsed %.*s", (int)ops->operands[0].len,
+	       ops->operands[0].str);
 
 	return args;
 }
 
-struct args parse_jr(char *argstr)
+struct args parse_jr(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments %s for li instruction",
-	       argstr);
-
-	char *first = trim_arg(argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for jr instruction");
 
-	if (expect_one_arg(first))
+	if (expect_args(ops, 1))
 		return empty_args;
 
 	const struct args args = {
-		.rs1 = expect_reg(first),
-		.sym = NULL,
+		.rs1 = expect_reg(&ops->operands[0]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-
 	logger(DEBUG, no_error, "Register parsed x%d", args.rs1);
 
 	return args;
 }
 
-struct args parse_ftso(char *argstr)
+struct args parse_ftso(struct wrasm_ctx *ctx, const struct operands *ops)
 {
+	(void)ctx;
 	logger(DEBUG, no_error,
 	       "Parsing arguments for no argument instruction");
 
-	const struct args args = {
+	if (ops->count)
+		logger(ERROR, error_instruction_other,
+		       "Expected zero arguments");
+
+	return (struct args){
 		.rd = 0x0,
 		.rs1 = 0x0,
 		.imm = 0x833,
-		.sym = NULL,
+		.sym = NO_SYMBOL,
 	};
-
-	if (!argstr)
-		return args;
-
-	for (char *c = argstr; *c; c++)
-		if (*c == ',')
-			logger(ERROR, error_instruction_other,
-			       "Expected zero arguments");
-
-	return args;
 }
 
-struct args parse_al(char *argstr)
+struct args parse_al(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for itype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for atomic load instruction");
 
-	if (expect_two_args(first, second))
+	if (expect_args(ops, 2))
 		return empty_args;
 
 	struct args args = {
-		.rd = expect_reg(first),
+		.rd = expect_reg(&ops->operands[0]),
 		.rs2 = 0,
-		.sym = NULL,
+		.sym = NO_SYMBOL,
 	};
 
-	expect_offreg(second, &args.imm, &args.rs1);
+	expect_offreg(&ops->operands[1], &args.imm, &args.rs1);
 
 	if (args.imm)
 		logger(ERROR, error_invalid_instruction,
 		       "Optional integer offset must be zero");
 
-	free(first);
-	free(second);
-
-	logger(DEBUG, no_error, "Registers parsed x%d %d(x%d)", args.rd,
-	       args.imm, args.rs1);
+	logger(DEBUG, no_error, "Registers parsed x%d %" PRId64 "(x%d)",
+	       args.rd, args.imm, args.rs1);
 
 	return args;
 }
 
-struct args parse_as(char *argstr)
+struct args parse_as(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for itype instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error,
+	       "Parsing arguments for atomic store instruction");
 
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	struct args args = {
-		.rd = expect_reg(first),
-		.rs2 = expect_reg(second),
+		.rd = expect_reg(&ops->operands[0]),
+		.rs2 = expect_reg(&ops->operands[1]),
+		.sym = NO_SYMBOL,
 	};
 
-	expect_offreg(third, &args.imm, &args.rs1);
+	expect_offreg(&ops->operands[2], &args.imm, &args.rs1);
 
 	if (args.imm)
 		logger(ERROR, error_invalid_instruction,
 		       "Optional integer offset must be zero");
 
-	free(first);
-	free(second);
-	free(third);
-
-	logger(DEBUG, no_error, "Registers parsed x%d x%d %d(x%d)", args.rd,
-	       args.rs2, args.imm, args.rs1);
+	logger(DEBUG, no_error, "Registers parsed x%d x%d %" PRId64 "(x%d)",
+	       args.rd, args.rs2, args.imm, args.rs1);
 
 	return args;
 }
 
-struct args parse_csr(char *argstr)
+struct args parse_csr(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for csr instruction %s",
-	       argstr);
-
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for csr instruction");
 
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	struct args args = {
-		.rd = expect_reg(first),
-		.imm = expect_csr(second),
-		.rs1 = expect_reg(third),
+		.rd = expect_reg(&ops->operands[0]),
+		.imm = expect_csr(&ops->operands[1]),
+		.rs1 = expect_reg(&ops->operands[2]),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-	free(third);
-
 	logger(DEBUG, no_error, "Registers parsed x%d, x%d, 0x%.03X", args.rd,
-	       args.rs1, args.imm);
+	       args.rs1, (unsigned)args.imm);
 
 	return args;
 }
 
-struct args parse_csri(char *argstr)
+struct args parse_csri(struct wrasm_ctx *ctx, const struct operands *ops)
 {
-	logger(DEBUG, no_error, "Parsing arguments for csri instruction %s",
-	       argstr);
+	(void)ctx;
+	logger(DEBUG, no_error, "Parsing arguments for csri instruction");
 
-	char *first = trim_arg(argstr);
-	char *second = trim_arg(NULL);
-	char *third = trim_arg(NULL);
-
-	if (expect_three_args(first, second, third))
+	if (expect_args(ops, 3))
 		return empty_args;
 
 	struct args args = {
-		.rd = expect_reg(first),
-		.imm = expect_csr(second),
-		.rs1 = (uint8_t)(expect_imm(third) & 0x1F),
+		.rd = expect_reg(&ops->operands[0]),
+		.imm = expect_csr(&ops->operands[1]),
+		.rs1 = (uint8_t)(expect_imm(&ops->operands[2]) & 0x1F),
+		.sym = NO_SYMBOL,
 	};
 
-	free(first);
-	free(second);
-	free(third);
-
 	logger(DEBUG, no_error, "Registers parsed x%d, 0x%X, 0x%.03X", args.rd,
-	       args.rs1, args.imm);
+	       args.rs1, (unsigned)args.imm);
 
 	return args;
 }
@@ -1,8 +1,8 @@
 
 #include "registers.h"
-#include "debug.h"
 #include "macros.h"
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -386,64 +386,123 @@ const struct {
 	{ "dscratch1", 0x7B3 },
 };
 
-/* TODO: implement w/ float extension */
-const char *float_reg_abi_map[] = { 0 };
+const char *float_reg_abi_map[] = {
+	"ft0", "ft1", "ft2",  "ft3",  "ft4", "ft5", "ft6", "ft7",
+	"fs0", "fs1", "fa0",  "fa1",  "fa2", "fa3", "fa4", "fa5",
+	"fa6", "fa7", "fs2",  "fs3",  "fs4", "fs5", "fs6", "fs7",
+	"fs8", "fs9", "fs10", "fs11", "ft8", "ft9", "ft10", "ft11",
+};
 
-size_t get_register_id(const char *reg)
+/* decodes the one or two digit register number following a register prefix */
+static inline size_t get_register_number(const char *num, size_t len)
 {
-	logger(DEBUG, no_error, "Searching for register (%s)", reg);
+	if (len < 1 || len > 2 || num[0] < '0' || num[0] > '9')
+		return (size_t)-1;
+	if (len == 1)
+		return (size_t)(num[0] - '0');
+	if (num[1] < '0' || num[1] > '9')
+		return (size_t)-1;
+	return (size_t)(num[0] - '0') * 10 + (size_t)(num[1] - '0');
+}
 
+size_t get_register_id(const char *reg, size_t len)
+{
 	/* limit the number of possible characters in the register */
-	int l = 0;
-	while (reg[l] && reg[l] != ' ')
-		l++;
-	if (l > 4)
+	if (len < 2 || len > 4)
 		return (size_t)-1;
 
-	if (*reg == 'x') {
-		size_t r = (size_t)atol(reg + 1);
-		if (r >= 32)
-			return (size_t)-1;
-		return r;
+	const size_t n = get_register_number(reg + 1, len - 1);
+	switch (reg[0]) {
+	case 'x':
+		if (n < 32)
+			return n;
+		break;
+	case 'z':
+		if (len == 4 && reg[1] == 'e' && reg[2] == 'r' && reg[3] == 'o')
+			return 0;
+		break;
+	case 'r':
+		if (len == 2 && reg[1] == 'a')
+			return 1;
+		break;
+	case 'g':
+		if (len == 2 && reg[1] == 'p')
+			return 3;
+		break;
+	case 'f':
+		/* "fp" alias of register "s0"/"x8" */
+		if (len == 2 && reg[1] == 'p')
+			return 8;
+		break;
+	case 'a':
+		if (n < 8)
+			return 10 + n;
+		break;
+	case 's':
+		if (len == 2 && reg[1] == 'p')
+			return 2;
+		if (n < 2)
+			return 8 + n;
+		if (n < 12)
+			return 16 + n;
+		break;
+	case 't':
+		if (len == 2 && reg[1] == 'p')
+			return 4;
+		if (n < 3)
+			return 5 + n;
+		if (n < 7)
+			return 25 + n;
+		break;
 	}
 
-	for (size_t i = 0; i < ARRAY_LENGTH(reg_abi_map); i++)
-		if (!strcmp(reg, reg_abi_map[i]))
-			return i;
-
-	/* Check for "fp" alias of register "s0"/"x8" */
-	if (!strcmp(reg, "fp"))
-		return 8;
-
-	logger(INFO, no_error, "unknown register (%s)", reg);
-
 	return (size_t)-1;
 }
 
-size_t get_float_register_id(const char *reg)
+size_t get_float_register_id(const char *reg, size_t len)
 {
-	if (*reg != 'f')
+	if (len < 2 || len > 5 || reg[0] != 'f')
 		return (size_t)-1;
 
-	if (reg[1] >= '0' && reg[1] <= '9')
-		return (size_t)atoi(reg + 1);
-
-	for (size_t i = 0; i < ARRAY_LENGTH(float_reg_abi_map); i++)
-		if (!strcmp(reg, float_reg_abi_map[i]))
-			return i;
+	const size_t n = get_register_number(reg + 2, len - 2);
+	switch (reg[1]) {
+	case 't':
+		if (n < 8)
+			return n;
+		if (n < 12)
+			return 20 + n;
+		break;
+	case 's':
+		if (n < 2)
+			return 8 + n;
+		if (n < 12)
+			return 16 + n;
+		break;
+	case 'a':
+		if (n < 8)
+			return 10 + n;
+		break;
+	default: {
+		const size_t r = get_register_number(reg + 1, len - 1);
+		if (r < 32)
+			return r;
+		break;
+	}
+	}
 
 	return (size_t)-1;
 }
 
-int get_immediate(const char *imm, size_t *res)
+int get_immediate(const char *imm, size_t len, size_t *res)
 {
+	const char *end = imm + len;
 	int base = 0;
 
-	if (!*imm)
+	if (!len)
 		return 1;
 
 	/* Attempt to detect base */
-	if (imm[0] == '0') {
+	if (imm[0] == '0' && len > 1) {
 		switch (imm[1]) {
 		case 'b':
 			base = 2;
@@ -461,22 +520,27 @@ int get_immediate(const char *imm, size_t *res)
 	}
 
 	char *endptr;
-	*res = (size_t)strtoll(imm, &endptr, base);
+	/* unsigned, so every 64 bit constant can be written */
+	errno = 0;
+	*res = (size_t)strtoull(imm, &endptr, base);
 
-	return endptr == imm;
+	/* anything wider than 64 bits would be clamped rather than encoded */
+	return endptr == imm || endptr != end || errno == ERANGE;
 }
 
-uint16_t get_csr(const char *csr)
+uint16_t get_csr(const char *csr, size_t len)
 {
+	if (!len)
+		return 0xFFFF;
 	if ((*csr >= '0' && *csr <= '9') || *csr == '-') {
 		char *endptr;
 		const uint16_t encoding = (uint16_t)strtoll(csr, &endptr, 0);
-		if (*endptr)
+		if (endptr != csr + len)
 			return 0xFFFF;
 		return encoding;
 	}
 	for (size_t i = 0; i < ARRAY_LENGTH(csr_map); i++)
-		if (!strcmp(csr, csr_map[i].name))
+		if (!strncmp(csr, csr_map[i].name, len) && !csr_map[i].name[len])
 			return csr_map[i].encoding;
 	return 0xFFFF;
 }
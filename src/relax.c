@@ -0,0 +1,304 @@
+#include "relax.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "bytecode.h"
+#include "context.h"
+#include "debug.h"
+#include "elf/output.h"
+#include "elf/reloc.h"
+#include "form/base.h"
+#include "form/compressed.h"
+#include "form/generic.h"
+#include "stats.h"
+#include "symbols.h"
+#include "xmalloc.h"
+
+#define GROWTHS_MIN_CAPACITY 16
+
+enum branch_kind {
+	BRANCH_NONE,
+	BRANCH_CONDITIONAL,
+	BRANCH_JUMP,
+};
+
+/* an instruction which changed size, in the order they appear in a section */
+struct growth {
+	/* the offset of the instruction before it changed */
+	size_t offset;
+	/* how much the section grew up to and including this instruction */
+	long total;
+};
+
+struct growths {
+	struct growth *data;
+	size_t size;
+	size_t capacity;
+};
+
+static enum branch_kind get_branch_kind(const struct formation *formation)
+{
+	if (formation->form_handler == &form_btype ||
+	    formation->form_handler == &form_branchifz ||
+	    formation->form_handler == &form_branchifr)
+		return BRANCH_CONDITIONAL;
+	if (formation->form_handler == &form_jtype ||
+	    (formation->form_handler == &form_jump &&
+	     formation->idata.opcode == JUMP_J))
+		return BRANCH_JUMP;
+	return BRANCH_NONE;
+}
+
+/* whether a pc relative offset fits a signed immediate of the given width */
+static inline bool offset_fits(long offset, int bits)
+{
+	return offset >= -(1L << (bits - 1)) && offset < (1L << (bits - 1));
+}
+
+/* the smallest form reaching the target which is no smaller than size */
+static size_t relaxed_size(enum branch_kind kind, size_t size, long offset)
+{
+	if (kind == BRANCH_JUMP) {
+		if (size == 2 && offset_fits(offset, 12))
+			return 2;
+		return size <= 4 && offset_fits(offset, 21) ? 4 : 8;
+	}
+
+	if (size == 2 && offset_fits(offset, 9))
+		return 2;
+	if (size <= 4 && offset_fits(offset, 13))
+		return 4;
+	/* the jal of the 8 byte form is after the inverted branch */
+	if (size <= 8 && offset_fits(offset - 4, 21))
+		return 8;
+	return 12;
+}
+
+/* the longest forms need a scratch register to hold the target address */
+static bool clobbers_t1(const struct instruction *instruction, size_t size)
+{
+	const struct formation *formation = &instruction->formation;
+	if (get_branch_kind(formation) == BRANCH_CONDITIONAL)
+		return size == 12;
+	/* j has no rd of its own, see form_jump() */
+	return size == 8 && (formation->form_handler == &form_jump ||
+			     !instruction->args.rd);
+}
+
+/* only targets whose distance is known are ever relaxed */
+static bool resolved_here(struct wrasm_ctx *ctx, const struct symbol *sym,
+			  enum sections section)
+{
+	if (sym->section != section)
+		return false;
+	set_section(ctx, section);
+	return !needs_relocation(ctx, sym);
+}
+
+static void add_growth(struct growths *growths, size_t offset, long amount)
+{
+	if (growths->size == growths->capacity) {
+		growths->capacity = growths->capacity ?
+					    2 * growths->capacity :
+					    GROWTHS_MIN_CAPACITY;
+		growths->data = xrealloc(growths->data,
+					 growths->capacity *
+						 sizeof(*growths->data));
+	}
+
+	const long total =
+		growths->size ? growths->data[growths->size - 1].total : 0;
+	growths->data[growths->size++] = (struct growth){
+		.offset = offset,
+		.total = total + amount,
+	};
+}
+
+/* how far an offset moves, which is how much grew strictly before it */
+static long get_shift(const struct growths *growths, size_t offset)
+{
+	size_t low = 0;
+	size_t high = growths->size;
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		if (growths->data[mid].offset < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low ? growths->data[low - 1].total : 0;
+}
+
+static void apply_growths(struct wrasm_ctx *ctx,
+			  const struct growths growths[SECTION_COUNT])
+{
+	for (size_t i = 0; i < ctx->instructions_size; i++) {
+		struct sectionpos *pos = &ctx->instructions[i].position;
+		pos->offset += (size_t)get_shift(&growths[pos->section],
+						 pos->offset);
+	}
+
+	for (size_t i = 0; i < ctx->dataitems_size; i++) {
+		struct sectionpos *pos = &ctx->dataitems[i].position;
+		pos->offset += (size_t)get_shift(&growths[pos->section],
+						 pos->offset);
+	}
+
+	for (size_t i = 0; i < ctx->symbols.count; i++) {
+		struct symbol *sym = get_symbol_at(ctx, i);
+		if (sym->type != SYMBOL_LABEL || sym->section == SECTION_NULL)
+			continue;
+		sym->value += get_shift(&growths[sym->section],
+					(size_t)sym->value);
+	}
+
+	/* the end of each section moves by everything grown in it */
+	for (int i = 0; i < SECTION_COUNT; i++) {
+		const size_t end = get_section_size(ctx, i);
+		inc_outputsize(ctx, i, (size_t)get_shift(&growths[i], end));
+	}
+}
+
+/* grows every branch which is out of range, returning whether any grew */
+static bool relax_pass(struct wrasm_ctx *ctx, const size_t *branches,
+		       size_t count, struct growths growths[SECTION_COUNT])
+{
+	bool grown = false;
+	for (int i = 0; i < SECTION_COUNT; i++)
+		growths[i].size = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		struct instruction *instruction =
+			&ctx->instructions[branches[i]];
+		if (instruction->args.sym == NO_SYMBOL)
+			continue;
+
+		const struct sectionpos position = instruction->position;
+		const struct symbol *sym =
+			get_symbol_at(ctx, instruction->args.sym);
+		if (!resolved_here(ctx, sym, position.section))
+			continue;
+
+		struct idata *idata = &instruction->formation.idata;
+		const size_t size = relaxed_size(
+			get_branch_kind(&instruction->formation), idata->sz,
+			sym->value - (long)position.offset);
+		if (size == idata->sz)
+			continue;
+
+		ctx->diagnostics.line = instruction->line;
+		logger(DEBUG, no_error, "Relaxing %s to %zu bytes",
+		       instruction->formation.name, size);
+		/* sizes only grow, so this is only reached once for each */
+		if (clobbers_t1(instruction, size))
+			logger(WARN, no_error,
+			       "%s to %s is out of range and overwrites t1 "
+			       "to reach it",
+			       instruction->formation.name,
+			       get_symbol_name(ctx, sym));
+		add_growth(&growths[position.section], position.offset,
+			   (long)(size - idata->sz));
+		idata->sz = size;
+		grown = true;
+	}
+	ctx->diagnostics.line = 0;
+
+	if (grown)
+		apply_growths(ctx, growths);
+	return grown;
+}
+
+void relax_branches(struct wrasm_ctx *ctx)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < ctx->instructions_size; i++)
+		if (get_branch_kind(&ctx->instructions[i].formation))
+			count++;
+	if (!count)
+		return;
+
+	size_t *branches = xmalloc(count * sizeof(*branches));
+	size_t *sizes = xmalloc(count * sizeof(*sizes));
+	count = 0;
+	for (size_t i = 0; i < ctx->instructions_size; i++) {
+		const struct formation *formation =
+			&ctx->instructions[i].formation;
+		if (!get_branch_kind(formation))
+			continue;
+		sizes[count] = formation->idata.sz;
+		branches[count++] = i;
+	}
+
+	const enum sections outputsection = ctx->outputsection;
+	struct growths growths[SECTION_COUNT] = { { NULL, 0, 0 } };
+	do
+		count_stat(&ctx->stats, STAT_RELAX_PASSES, 1);
+	while (relax_pass(ctx, branches, count, growths));
+	set_section(ctx, outputsection);
+
+	for (size_t i = 0; i < count; i++) {
+		const size_t size =
+			ctx->instructions[branches[i]].formation.idata.sz;
+		if (size > sizes[i])
+			count_stat(&ctx->stats, STAT_RELAXED, 1);
+		else if (size == 2)
+			count_stat(&ctx->stats, STAT_COMPRESSED, 1);
+	}
+
+	for (int i = 0; i < SECTION_COUNT; i++)
+		free(growths[i].data);
+	free(sizes);
+	free(branches);
+}
+
+/* branches start compressed whenever they could be, relaxation grows them */
+static bool compress_branch(struct wrasm_ctx *ctx,
+			    struct instruction *instruction)
+{
+	if (!compressible_branch(instruction) ||
+	    instruction->args.sym == NO_SYMBOL)
+		return false;
+
+	const struct symbol *sym = get_symbol_at(ctx, instruction->args.sym);
+	if (!resolved_here(ctx, sym, instruction->position.section))
+		return false;
+
+	instruction->formation.idata.sz = 2;
+	return true;
+}
+
+void compress_instructions(struct wrasm_ctx *ctx)
+{
+	const enum sections outputsection = ctx->outputsection;
+	struct growths growths[SECTION_COUNT] = { { NULL, 0, 0 } };
+	size_t compressed = 0;
+
+	for (size_t i = 0; i < ctx->instructions_size; i++) {
+		struct instruction *instruction = &ctx->instructions[i];
+		if (instruction->formation.idata.sz != 4)
+			continue;
+
+		if (get_branch_kind(&instruction->formation)) {
+			if (!compress_branch(ctx, instruction))
+				continue;
+		} else if (compress_instruction(instruction)) {
+			count_stat(&ctx->stats, STAT_COMPRESSED, 1);
+		} else {
+			continue;
+		}
+
+		add_growth(&growths[instruction->position.section],
+			   instruction->position.offset, -2);
+		compressed++;
+	}
+	set_section(ctx, outputsection);
+
+	if (compressed) {
+		ctx->rvc = true;
+		apply_growths(ctx, growths);
+	}
+
+	for (int i = 0; i < SECTION_COUNT; i++)
+		free(growths[i].data);
+}
@@ -0,0 +1,494 @@
+#if defined(__linux__)
+/* struct ucred is only declared for GNU extensions */
+#define _GNU_SOURCE
+#define HAVE_UNIX_SOCKETS
+#define HAVE_SO_PEERCRED
+#elif defined(__unix__) || defined(__APPLE__)
+/* getpeereid() is hidden when asking for plain POSIX */
+#define HAVE_UNIX_SOCKETS
+#define HAVE_GETPEEREID
+#endif
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef HAVE_UNIX_SOCKETS
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "xmalloc.h"
+
+#ifdef HAVE_UNIX_SOCKETS
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* changed whenever the layout of a request changes */
+#define REQUEST_VERSION 1
+/* stdin, stdout and stderr, then the working directory */
+#define REQUEST_STREAMS 3
+#define REQUEST_FDS (REQUEST_STREAMS + 1)
+/* far more than the longest command line the client could have been given */
+#define REQUEST_MAX_LENGTH ((uint32_t)1 << 26)
+
+/*
+ * Sent along with the client's file descriptors, and followed by `length`
+ * bytes holding each argument in turn with its terminating NUL. The server
+ * replies with the exit status of the request as an int32_t.
+ */
+struct request_header {
+	uint32_t version;
+	uint32_t argc;
+	uint32_t length;
+};
+
+union fd_message {
+	struct cmsghdr header;
+	char buf[CMSG_SPACE(REQUEST_FDS * sizeof(int))];
+};
+
+static const char *server_path = NULL;
+
+static int send_all(int fd, const void *data, size_t len)
+{
+	const char *pos = data;
+	while (len) {
+		const ssize_t sent = send(fd, pos, len, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return 1;
+		pos += sent;
+		len -= (size_t)sent;
+	}
+	return 0;
+}
+
+static int recv_all(int fd, void *data, size_t len)
+{
+	char *pos = data;
+	while (len) {
+		const ssize_t got = recv(fd, pos, len, 0);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return 1;
+		pos += got;
+		len -= (size_t)got;
+	}
+	return 0;
+}
+
+static int socket_address(struct sockaddr_un *addr, const char *path)
+{
+	const size_t len = strlen(path);
+	if (len >= sizeof(addr->sun_path))
+		return 1;
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path, path, len + 1);
+	return 0;
+}
+
+static int connect_socket(const struct sockaddr_un *addr)
+{
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Only the user running the server may connect, as requests write files with
+ * the server's permissions. The umask is process wide, but nothing else runs
+ * yet while the server is starting.
+ */
+static int listen_socket(const struct sockaddr_un *addr)
+{
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	const mode_t mask = umask(0177);
+	const int bound =
+		!bind(fd, (const struct sockaddr *)addr, sizeof(*addr));
+	umask(mask);
+	if (bound && !listen(fd, SOMAXCONN))
+		return fd;
+	const int err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+}
+
+static int send_request(int fd, int argc, char *argv[])
+{
+	struct request_header header = {
+		.version = REQUEST_VERSION,
+		.argc = (uint32_t)argc,
+		.length = 0,
+	};
+	for (int i = 0; i < argc; i++)
+		header.length += (uint32_t)strlen(argv[i]) + 1;
+
+	const int cwd = open(".", O_RDONLY);
+	if (cwd < 0)
+		return 1;
+	const int fds[REQUEST_FDS] = {
+		STDIN_FILENO,
+		STDOUT_FILENO,
+		STDERR_FILENO,
+		cwd,
+	};
+
+	union fd_message control;
+	memset(&control, 0, sizeof(control));
+	struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	ssize_t sent;
+	do
+		sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	while (sent < 0 && errno == EINTR);
+	close(cwd);
+	if (sent <= 0)
+		return 1;
+
+	/* the descriptors went with the first part, the rest is plain data */
+	if (send_all(fd, (const char *)&header + sent,
+		     sizeof(header) - (size_t)sent))
+		return 1;
+	for (int i = 0; i < argc; i++)
+		if (send_all(fd, argv[i], strlen(argv[i]) + 1))
+			return 1;
+	return 0;
+}
+
+int forward_request(const char *path, int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	if (socket_address(&addr, path)) {
+		logger(WARN, error_invalid_syntax, "Socket path %s is too long",
+		       path);
+		return -1;
+	}
+	const int fd = connect_socket(&addr);
+	if (fd < 0)
+		return -1;
+
+	/* nothing has run until the whole request is through */
+	if (send_request(fd, argc, argv)) {
+		close(fd);
+		return -1;
+	}
+
+	int32_t status;
+	const int lost = recv_all(fd, &status, sizeof(status));
+	close(fd);
+	if (lost) {
+		logger(ERROR, error_system,
+		       "Lost the connection to the server at %s", path);
+		return EXIT_FAILURE;
+	}
+	return status;
+}
+
+static void close_fds(const int *fds, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		close(fds[i]);
+}
+
+/*
+ * The server outlives its requests, so every descriptor that came with one is
+ * either kept in `fds` or closed. Returns 0 if exactly REQUEST_FDS came.
+ */
+static int take_fds(struct msghdr *msg, int fds[REQUEST_FDS])
+{
+	size_t received = 0;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg;
+	     cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		const size_t count =
+			(cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < count; i++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int),
+			       sizeof(fd));
+			if (received < REQUEST_FDS)
+				fds[received] = fd;
+			else
+				close(fd);
+			received++;
+		}
+	}
+	if (received == REQUEST_FDS && !(msg->msg_flags & MSG_CTRUNC))
+		return 0;
+	close_fds(fds, received < REQUEST_FDS ? received : REQUEST_FDS);
+	return 1;
+}
+
+/* the arguments are left in a single block, the first argument */
+static char **recv_request(int conn, int fds[REQUEST_FDS], int *argc)
+{
+	struct request_header header;
+	union fd_message control;
+	struct iovec iov = { .iov_base = &header, .iov_len = sizeof(header) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+
+	ssize_t got;
+	do
+		got = recvmsg(conn, &msg, 0);
+	while (got < 0 && errno == EINTR);
+	*argc = got ? -1 : 0;
+	if (got <= 0 || take_fds(&msg, fds))
+		return NULL;
+
+	if (recv_all(conn, (char *)&header + got,
+		     sizeof(header) - (size_t)got) ||
+	    header.version != REQUEST_VERSION || !header.argc ||
+	    header.argc > header.length || header.length > REQUEST_MAX_LENGTH) {
+		close_fds(fds, REQUEST_FDS);
+		return NULL;
+	}
+
+	char *args = xmalloc(header.length);
+	char **argv = xmalloc((header.argc + 1) * sizeof(*argv));
+	size_t count = 0;
+	if (!recv_all(conn, args, header.length) && !args[header.length - 1])
+		for (size_t pos = 0; pos < header.length;
+		     pos += strlen(args + pos) + 1)
+			if (count++ < header.argc)
+				argv[count - 1] = args + pos;
+	if (count != header.argc) {
+		free(args);
+		free(argv);
+		close_fds(fds, REQUEST_FDS);
+		return NULL;
+	}
+	argv[count] = NULL;
+	*argc = (int)count;
+	return argv;
+}
+
+/*
+ * Gives the handler the client's streams and working directory for as long as
+ * it runs, then hands the server its own back.
+ */
+static int32_t run_request(int fds[REQUEST_FDS], request_handler *handler,
+			   int argc, char *argv[])
+{
+	int saved[REQUEST_FDS];
+	for (int i = 0; i < REQUEST_STREAMS; i++)
+		saved[i] = dup(i);
+	saved[REQUEST_STREAMS] = open(".", O_RDONLY);
+	for (int i = 0; i < REQUEST_FDS; i++) {
+		if (saved[i] >= 0)
+			continue;
+		logger(WARN, error_system,
+		       "Unable to set the server's own streams aside");
+		for (int j = 0; j < REQUEST_FDS; j++)
+			if (saved[j] >= 0)
+				close(saved[j]);
+		return EXIT_FAILURE;
+	}
+
+	/* anything the server left buffered is not for the client */
+	fflush(NULL);
+	for (int i = 0; i < REQUEST_STREAMS; i++)
+		dup2(fds[i], i);
+	int32_t status = EXIT_FAILURE;
+	if (fchdir(fds[REQUEST_STREAMS]))
+		logger(WARN, error_system,
+		       "Unable to change to the client's working directory");
+	else
+		status = handler(argc, argv);
+	fflush(NULL);
+
+	for (int i = 0; i < REQUEST_STREAMS; i++) {
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	/* a client that went away must not leave its errors on the streams */
+	clearerr(stdout);
+	clearerr(stderr);
+	if (fchdir(saved[REQUEST_STREAMS]))
+		logger(WARN, error_system,
+		       "Unable to change back to the server's directory");
+	close(saved[REQUEST_STREAMS]);
+	return status;
+}
+
+/*
+ * Stopping is held off while a request runs, so that it finishes and its
+ * output is either complete or cleaned up before the server exits.
+ */
+static void hold_stop(int how)
+{
+	sigset_t stops;
+	sigemptyset(&stops);
+	sigaddset(&stops, SIGINT);
+	sigaddset(&stops, SIGTERM);
+	sigprocmask(how, &stops, NULL);
+}
+
+static void serve_connection(int conn, request_handler *handler)
+{
+	int fds[REQUEST_FDS];
+	int argc;
+	char **argv = recv_request(conn, fds, &argc);
+	/* a connection closed straight away was only checking for a server */
+	if (!argv && argc)
+		logger(WARN, error_system, "Ignoring a malformed request");
+	if (!argv)
+		return;
+
+	hold_stop(SIG_BLOCK);
+	const int32_t status = run_request(fds, handler, argc, argv);
+	close_fds(fds, REQUEST_FDS);
+	free(argv[0]);
+	free(argv);
+
+	/* the client may well have given up waiting by now */
+	send_all(conn, &status, sizeof(status));
+	hold_stop(SIG_UNBLOCK);
+}
+
+/* the socket's mode is the first check, this catches any that got past it */
+static bool same_user(int conn)
+{
+#ifdef HAVE_SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return !getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) &&
+	       cred.uid == geteuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return !getpeereid(conn, &uid, &gid) && uid == geteuid();
+#endif
+}
+
+static void stop_server(int sig)
+{
+	(void)sig;
+	unlink(server_path);
+	_exit(EXIT_SUCCESS);
+}
+
+static void set_signals(void)
+{
+	struct sigaction action = { .sa_handler = &stop_server };
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	/* a client going away fails the writes to it instead */
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int run_server(const char *path, request_handler *handler)
+{
+	struct sockaddr_un addr;
+	if (socket_address(&addr, path)) {
+		logger(ERROR, error_invalid_syntax,
+		       "Socket path %s is too long", path);
+		return EXIT_FAILURE;
+	}
+
+	int listener = listen_socket(&addr);
+	/* a socket left behind by a server that has gone can be replaced */
+	struct stat st;
+	if (listener < 0 && errno == EADDRINUSE && !lstat(path, &st) &&
+	    S_ISSOCK(st.st_mode)) {
+		const int live = connect_socket(&addr);
+		if (live >= 0) {
+			close(live);
+			logger(ERROR, error_system,
+			       "A server is already running on %s", path);
+			return EXIT_FAILURE;
+		}
+		unlink(path);
+		listener = listen_socket(&addr);
+	}
+	if (listener < 0) {
+		logger(ERROR, error_system, "Unable to listen on %s", path);
+		return EXIT_FAILURE;
+	}
+
+	server_path = path;
+	set_signals();
+	logger(INFO, no_error, "Serving requests on %s", path);
+
+	for (;;) {
+		const int conn = accept(listener, NULL, NULL);
+		if (conn < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				logger(WARN, error_system,
+				       "Unable to accept a request");
+			continue;
+		}
+		if (!same_user(conn)) {
+			logger(WARN, error_system,
+			       "Refusing a request from another user");
+			close(conn);
+			continue;
+		}
+
+		serve_connection(conn, handler);
+		close(conn);
+	}
+}
+
+#else
+
+int run_server(const char *path, request_handler *handler)
+{
+	(void)path;
+	(void)handler;
+	logger(ERROR, error_not_implemented,
+	       "Serving requests needs unix sockets, which are missing here");
+	return EXIT_FAILURE;
+}
+
+int forward_request(const char *path, int argc, char *argv[])
+{
+	(void)path;
+	(void)argc;
+	(void)argv;
+	return -1;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#include "sha256.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the first 32 bits of the fractional parts of the cube roots of primes */
+static const uint32_t round_constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+	return x >> n | x << (32 - n);
+}
+
+static inline uint32_t get_be32(const unsigned char *b)
+{
+	return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 |
+	       (uint32_t)b[2] << 8 | (uint32_t)b[3];
+}
+
+static inline void put_be32(unsigned char *b, uint32_t x)
+{
+	b[0] = (unsigned char)(x >> 24);
+	b[1] = (unsigned char)(x >> 16);
+	b[2] = (unsigned char)(x >> 8);
+	b[3] = (unsigned char)x;
+}
+
+static void compress_block(uint32_t state[8], const unsigned char *block)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++)
+		w[i] = get_be32(block + 4 * i);
+	for (int i = 16; i < 64; i++) {
+		const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^
+				    w[i - 15] >> 3;
+		const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^
+				    w[i - 2] >> 10;
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; i++) {
+		const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		const uint32_t ch = (e & f) ^ (~e & g);
+		const uint32_t t1 = h + s1 + ch + round_constants[i] + w[i];
+		const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		const uint32_t t2 = s0 + maj;
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void init_sha256(struct sha256 *sha)
+{
+	*sha = (struct sha256){
+		.state = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+			   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+		.length = 0,
+		.used = 0,
+	};
+}
+
+void update_sha256(struct sha256 *sha, const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	sha->length += len;
+
+	if (sha->used) {
+		const size_t fill = SHA256_BLOCK_SIZE - sha->used;
+		if (len < fill) {
+			memcpy(sha->block + sha->used, bytes, len);
+			sha->used += len;
+			return;
+		}
+		memcpy(sha->block + sha->used, bytes, fill);
+		compress_block(sha->state, sha->block);
+		bytes += fill;
+		len -= fill;
+		sha->used = 0;
+	}
+
+	/* whole blocks are hashed straight from the caller's data */
+	for (; len >= SHA256_BLOCK_SIZE; len -= SHA256_BLOCK_SIZE) {
+		compress_block(sha->state, bytes);
+		bytes += SHA256_BLOCK_SIZE;
+	}
+	memcpy(sha->block, bytes, len);
+	sha->used = len;
+}
+
+void finish_sha256(struct sha256 *sha, unsigned char digest[SHA256_LENGTH])
+{
+	const uint64_t bits = sha->length * 8;
+
+	/* a single set bit, then zeros up to the length in the last 8 bytes */
+	sha->block[sha->used++] = 0x80;
+	if (sha->used > SHA256_BLOCK_SIZE - 8) {
+		memset(sha->block + sha->used, 0,
+		       SHA256_BLOCK_SIZE - sha->used);
+		compress_block(sha->state, sha->block);
+		sha->used = 0;
+	}
+	memset(sha->block + sha->used, 0, SHA256_BLOCK_SIZE - 8 - sha->used);
+	put_be32(sha->block + SHA256_BLOCK_SIZE - 8, (uint32_t)(bits >> 32));
+	put_be32(sha->block + SHA256_BLOCK_SIZE - 4, (uint32_t)bits);
+	compress_block(sha->state, sha->block);
+
+	for (int i = 0; i < 8; i++)
+		put_be32(digest + 4 * i, sha->state[i]);
+}
@@ -0,0 +1,110 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_GETRUSAGE
+#endif
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef HAVE_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+#include "context.h"
+#include "elf/output.h"
+
+static const char *phase_names[PHASE_COUNT] = {
+	"parse", "relax", "layout", "encode", "tables", "write", "cleanup",
+};
+
+static const char *counter_names[STAT_COUNT] = {
+	"lines parsed",	  "instructions",   "data items",
+	"symbols",	  "symbol lookups", "symbol probes",
+	"relocations",	  "relaxed branches", "relax passes",
+	"compressed",	  "cache hits",	    "cache misses",
+};
+
+static double elapsed_ms(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec) * 1e3 +
+	       (double)(end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void start_phase(struct wrasm_ctx *ctx, enum stats_phase phase)
+{
+	struct phasetimer *timer = &ctx->timer;
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	if (timer->phase != PHASE_NONE)
+		ctx->stats.phase_times[timer->phase] +=
+			elapsed_ms(&timer->start, &now);
+	timer->phase = phase;
+	timer->start = now;
+}
+
+void record_section_sizes(struct wrasm_ctx *ctx)
+{
+	for (int i = 0; i < SECTION_COUNT; i++)
+		ctx->stats.section_sizes[i] += get_section_size(ctx, i);
+}
+
+void collect_stats(struct wrasm_ctx *ctx, struct stats *totals)
+{
+	start_phase(ctx, PHASE_NONE);
+	for (int i = 0; i < PHASE_COUNT; i++)
+		totals->phase_times[i] += ctx->stats.phase_times[i];
+	for (int i = 0; i < STAT_COUNT; i++)
+		totals->counters[i] += ctx->stats.counters[i];
+	for (int i = 0; i < SECTION_COUNT; i++)
+		totals->section_sizes[i] += ctx->stats.section_sizes[i];
+	ctx->stats = (struct stats){ .counters = { 0 } };
+}
+
+/* peak resident set size in KiB, or 0 if it can't be determined */
+static size_t peak_rss(void)
+{
+#ifdef HAVE_GETRUSAGE
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage))
+		return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss / 1024;
+#else
+	return (size_t)usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+void print_stats(FILE *out, const struct stats *stats)
+{
+	double total = 0;
+	fprintf(out, "phase times:\n");
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		fprintf(out, "  %-20s %12.3f ms\n", phase_names[i],
+			stats->phase_times[i]);
+		total += stats->phase_times[i];
+	}
+	fprintf(out, "  %-20s %12.3f ms\n", "total", total);
+
+	fprintf(out, "counters:\n");
+	for (int i = 0; i < STAT_COUNT; i++)
+		fprintf(out, "  %-20s %12zu\n", counter_names[i],
+			stats->counters[i]);
+
+	fprintf(out, "section sizes:\n");
+	for (int i = SECTION_NULL + 1; i < SECTION_COUNT; i++)
+		fprintf(out, "  %-20s %12zu bytes\n", get_section_name(i),
+			stats->section_sizes[i]);
+
+	const size_t rss = peak_rss();
+	if (rss) {
+		fprintf(out, "memory:\n");
+		fprintf(out, "  %-20s %12zu KiB\n", "peak RSS", rss);
+	}
+}
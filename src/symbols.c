@@ -1,108 +1,222 @@
-
 #include "symbols.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "context.h"
 #include "debug.h"
+#include "stats.h"
 #include "xmalloc.h"
 
-struct symbolmap symbols[] = { { .count = 0, .data = NULL } };
+#define SYMBOL_SLOTS_MIN 1024
 
-static size_t hash_str(const char *str)
+/* 32 bit FNV-1a */
+static uint32_t hash_str(const char *str, size_t len)
 {
-	size_t hash = 5381;
+	uint32_t hash = 2166136261u;
 
-	while (*str) {
-		hash = hash * 33 ^ (size_t)*str;
-		str++;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
 	}
 
-	return hash % SYMBOLMAP_ENTRIES;
+	return hash;
+}
+
+static inline int symbol_matches(const struct symboltable *symbols,
+				 const struct symbol *sym, uint32_t hash,
+				 const char *name, size_t len)
+{
+	const char *symname = symbols->strings + sym->name;
+	/* strncmp() stops at the end of a shorter name, memcmp() would not */
+	return sym->hash == hash && !strncmp(name, symname, len) &&
+	       !symname[len];
+}
+
+/*
+ * Returns the slot holding the given symbol, or the empty slot it would be
+ * inserted in. The table is never more than half full, so this terminates.
+ */
+static size_t find_slot(struct wrasm_ctx *ctx, uint32_t hash,
+			const char *name, size_t len)
+{
+	struct symboltable *symbols = &ctx->symbols;
+	const size_t mask = symbols->slot_count - 1;
+	size_t slot = hash & mask;
+	size_t probes = 1;
+	while (symbols->slots[slot]) {
+		const struct symbol *sym =
+			&symbols->data[symbols->slots[slot] - 1];
+		if (symbol_matches(symbols, sym, hash, name, len))
+			break;
+		slot = (slot + 1) & mask;
+		probes++;
+	}
+	count_stat(&ctx->stats, STAT_SYMBOL_LOOKUPS, 1);
+	count_stat(&ctx->stats, STAT_SYMBOL_PROBES, probes);
+	return slot;
 }
 
-struct symbol *get_symbol(const char *name)
+static void grow_slots(struct symboltable *symbols)
 {
-	const size_t hash = hash_str(name);
-	for (size_t i = 0; i < symbols[hash].count; i++) {
-		if (!strcmp(name, symbols[hash].data[i].name)) {
-			return &symbols[hash].data[i];
-		}
+	const size_t old_count = symbols->slot_count;
+	uint32_t *old_slots = symbols->slots;
+
+	symbols->slot_count = old_count ? old_count * 2 : SYMBOL_SLOTS_MIN;
+	symbols->slots = xcalloc(symbols->slot_count, sizeof(*symbols->slots));
+
+	/* the hash is stored with each symbol so rehashing never reads names */
+	const size_t mask = symbols->slot_count - 1;
+	for (size_t i = 0; i < old_count; i++) {
+		if (!old_slots[i])
+			continue;
+		size_t slot = symbols->data[old_slots[i] - 1].hash & mask;
+		while (symbols->slots[slot])
+			slot = (slot + 1) & mask;
+		symbols->slots[slot] = old_slots[i];
 	}
-	return NULL;
+	free(old_slots);
+}
+
+static int intern_name(struct symboltable *symbols, const char *name,
+		       size_t len, uint32_t *offset)
+{
+	/* offset 0 holds the empty string used by the null symbol */
+	const size_t start = symbols->strings_size ? symbols->strings_size : 1;
+	const size_t end = start + len + 1;
+	if (end > UINT32_MAX) {
+		logger(CRITICAL, error_internal,
+		       "Symbol string table exceeds 4GiB");
+		return 1;
+	}
+
+	if (end > symbols->strings_capacity) {
+		size_t capacity = symbols->strings_capacity ?
+					  symbols->strings_capacity :
+					  4096;
+		while (capacity < end)
+			capacity *= 2;
+		symbols->strings = xrealloc(symbols->strings, capacity);
+		symbols->strings_capacity = capacity;
+	}
+
+	symbols->strings[0] = '\0';
+	memcpy(symbols->strings + start, name, len);
+	symbols->strings[start + len] = '\0';
+	symbols->strings_size = end;
+	*offset = (uint32_t)start;
+	return 0;
 }
 
-struct symbol *get_or_create_symbol(const char *name, enum symbol_types type)
+struct symbol *get_symbol(struct wrasm_ctx *ctx, const char *name, size_t len)
 {
-	struct symbol *sym = get_symbol(name);
+	struct symboltable *symbols = &ctx->symbols;
+	if (!symbols->count)
+		return NULL;
+	const uint32_t hash = hash_str(name, len);
+	const uint32_t index = symbols->slots[find_slot(ctx, hash, name, len)];
+	return index ? &symbols->data[index - 1] : NULL;
+}
+
+struct symbol *get_or_create_symbol(struct wrasm_ctx *ctx, const char *name,
+				    size_t len, enum symbol_types type)
+{
+	struct symbol *sym = get_symbol(ctx, name, len);
 	if (sym)
 		return sym;
-	return create_symbol(name, type);
+	return create_symbol(ctx, name, len, type);
 }
 
-struct symbol *create_symbol(const char *name, enum symbol_types type)
+struct symbol *create_symbol(struct wrasm_ctx *ctx, const char *name,
+			     size_t len, enum symbol_types type)
 {
-	const size_t hash = hash_str(name);
+	struct symboltable *symbols = &ctx->symbols;
+	if ((symbols->count + 1) * 2 > symbols->slot_count)
+		grow_slots(symbols);
+
+	const uint32_t hash = hash_str(name, len);
+	const size_t slot = find_slot(ctx, hash, name, len);
+	if (symbols->slots[slot]) {
+		logger(ERROR, error_invalid_syntax,
+		       "Duplicate symbol %.*s encountered", (int)len, name);
+		return NULL;
+	}
 
-	const size_t index = symbols[hash].count;
+	uint32_t nameoffset;
+	if (intern_name(symbols, name, len, &nameoffset))
+		return NULL;
 
-	for (size_t i = 0; i < symbols[hash].count; i++) {
-		if (!strcmp(name, symbols[hash].data[i].name)) {
-			logger(ERROR, error_invalid_syntax,
-			       "Duplicate symbol %s encountered");
-			return NULL;
-		}
+	if (symbols->count == symbols->capacity) {
+		symbols->capacity =
+			symbols->capacity ? symbols->capacity * 2 : 256;
+		symbols->data =
+			xrealloc(symbols->data,
+				 symbols->capacity * sizeof(*symbols->data));
 	}
 
-	symbols[hash].count++;
-	symbols[hash].data =
-		xrealloc(symbols[hash].data,
-			 symbols[hash].count * sizeof(*symbols[hash].data));
+	struct symbol *sym = &symbols->data[symbols->count++];
+	*sym = (struct symbol){
+		.name = nameoffset,
+		.hash = hash,
+		.section = SECTION_NULL,
+		.symtab_index = 0,
+		.value = 0,
+		.binding = 0,
+		.type = type,
+	};
+	symbols->slots[slot] = (uint32_t)symbols->count;
+	count_stat(&ctx->stats, STAT_SYMBOLS, 1);
+
+	logger(DEBUG, no_error, "Created symbol named \"%.*s\"", (int)len,
+	       name);
+
+	return sym;
+}
 
-	const size_t n_sz = strlen(name) + 1;
-	char *n = xmalloc(n_sz);
-	memcpy(n, name, n_sz);
-	symbols[hash].data[index].name = n;
-	symbols[hash].data[index].name_sz = n_sz;
-	symbols[hash].data[index].type = type;
-	symbols[hash].data[index].binding = 0;
+size_t get_symbol_strings_size(const struct wrasm_ctx *ctx)
+{
+	const struct symboltable *symbols = &ctx->symbols;
+	return symbols->strings_size ? symbols->strings_size : 1;
+}
 
-	logger(DEBUG, no_error, "Created symbol named \"%s\"", n);
+const char *get_symbol_strings(const struct wrasm_ctx *ctx)
+{
+	const struct symboltable *symbols = &ctx->symbols;
+	return symbols->strings_size ? symbols->strings : "";
+}
 
-	return &symbols[hash].data[index];
+void free_symbols(struct wrasm_ctx *ctx)
+{
+	struct symboltable *symbols = &ctx->symbols;
+	free(symbols->data);
+	free(symbols->slots);
+	free(symbols->strings);
+	*symbols = (struct symboltable){ .count = 0, .data = NULL };
 }
 
-size_t calc_symtab_str_buf_size(void)
+void clear_symbols(struct wrasm_ctx *ctx)
 {
-	size_t sz = 1;
-	for (size_t hash = 0; hash < SYMBOLMAP_ENTRIES; hash++)
-		for (size_t index = 0; index < symbols[hash].count; index++)
-			sz += symbols[hash].data[index].name_sz;
-	return sz;
+	struct symboltable *symbols = &ctx->symbols;
+	if (symbols->slots)
+		memset(symbols->slots, 0,
+		       symbols->slot_count * sizeof(*symbols->slots));
+	symbols->count = 0;
+	symbols->strings_size = 0;
 }
 
-char *create_symtab_str_buf(size_t sz)
+struct symbol *get_symbol_at(struct wrasm_ctx *ctx, size_t index)
 {
-	char *buf = malloc(sz);
-	buf[0] = '\0';
-	size_t offset = 1;
-	for (size_t hash = 0; hash < SYMBOLMAP_ENTRIES; hash++) {
-		for (size_t index = 0; index < symbols[hash].count; index++) {
-			const size_t name_sz =
-				symbols[hash].data[index].name_sz;
-			memcpy(buf + offset, symbols[hash].data[index].name,
-			       name_sz);
-			offset += name_sz;
-		}
-	}
-	return buf;
+	return &ctx->symbols.data[index];
 }
 
-void free_symbols(void)
+size_t get_symbol_index(const struct wrasm_ctx *ctx, const struct symbol *sym)
 {
-	for (size_t hash = 0; hash < SYMBOLMAP_ENTRIES; hash++) {
-		for (size_t index = 0; index < symbols[hash].count; index++)
-			free(symbols[hash].data[index].name);
-		free(symbols[hash].data);
-	}
+	return (size_t)(sym - ctx->symbols.data);
+}
+
+const char *get_symbol_name(const struct wrasm_ctx *ctx,
+			    const struct symbol *sym)
+{
+	return ctx->symbols.strings + sym->name;
 }
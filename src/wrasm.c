@@ -0,0 +1,71 @@
+#include "wrasm.h"
+
+#include <stdlib.h>
+
+#include "context.h"
+#include "debug.h"
+#include "format.h"
+#include "generation.h"
+#include "input.h"
+
+static const struct wrasm_options default_options = {
+	.format = WRASM_FORMAT_ELF,
+	.source_name = NULL,
+};
+
+static int copy_format(struct wrasm_ctx *ctx, enum wrasm_format format,
+		       struct wrasm_buffer *out)
+{
+	switch (format) {
+	case WRASM_FORMAT_ELF:
+		return copy_output_format(ctx, FORMAT_ELF, &out->data,
+					  &out->size);
+	case WRASM_FORMAT_RAW:
+		return copy_output_format(ctx, FORMAT_BIN, &out->data,
+					  &out->size);
+	case WRASM_FORMAT_IHEX:
+		return copy_output_format(ctx, FORMAT_IHEX, &out->data,
+					  &out->size);
+	}
+	logger(ERROR, error_other, "Unknown output format %d", (int)format);
+	return 1;
+}
+
+int wrasm_assemble(const char *src, size_t len,
+		   const struct wrasm_options *opts, struct wrasm_buffer *out)
+{
+	if (!opts)
+		opts = &default_options;
+	*out = (struct wrasm_buffer){ .data = NULL, .size = 0 };
+
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+	ctx.diagnostics.source = opts->source_name;
+	ctx.diagnostics.keep_going = true;
+	ctx.relocatable = opts->format == WRASM_FORMAT_ELF;
+	ctx.compress = opts->compress != 0;
+	if (opts->threads > 1)
+		ctx.threads = opts->threads;
+	struct diagnostics *prev = use_diagnostics(&ctx.diagnostics);
+
+	struct input input;
+	int err = open_input_buffer(&input, src, len);
+	if (!err)
+		err = assemble_input(&ctx, &input);
+	/* errors are counted here where the executable would have exited */
+	if (!err)
+		err = get_clean_exit(ERROR);
+	if (!err)
+		err = copy_format(&ctx, opts->format, out);
+
+	free_context(&ctx);
+	use_diagnostics(prev);
+	return err;
+}
+
+void wrasm_free_buffer(struct wrasm_buffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->size = 0;
+}
@@ -1,6 +1,7 @@
 
 #include "xmalloc.h"
 
+#include <stddef.h>
 #include <stdlib.h>
 
 #include "debug.h"
@@ -34,3 +35,90 @@ void *xrealloc(void *ptr, size_t size)
 		die("xrealloc");
 	return ptr;
 }
+
+#define ARENA_BLOCK_SIZE ((size_t)1 << 20)
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+struct arenablock {
+	struct arenablock *prev;
+	size_t size;
+	size_t used;
+	_Alignas(max_align_t) unsigned char data[];
+};
+
+void *arena_alloc(struct arena *arena, size_t sz)
+{
+	sz = (sz + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	struct arenablock *block = arena->block;
+	if (!block || block->size - block->used < sz) {
+		/* oversized requests get a block to themselves */
+		const size_t size =
+			sz > ARENA_BLOCK_SIZE ? sz : ARENA_BLOCK_SIZE;
+		block = xmalloc(sizeof(*block) + size);
+		block->prev = arena->block;
+		block->size = size;
+		block->used = 0;
+		arena->block = block;
+	}
+
+	void *ptr = block->data + block->used;
+	block->used += sz;
+	return ptr;
+}
+
+struct arenacheckpoint arena_checkpoint(const struct arena *arena)
+{
+	return (struct arenacheckpoint){
+		.block = arena->block,
+		.used = arena->block ? arena->block->used : 0,
+	};
+}
+
+void arena_restore(struct arena *arena, struct arenacheckpoint checkpoint)
+{
+	while (arena->block != checkpoint.block) {
+		struct arenablock *prev = arena->block->prev;
+		free(arena->block);
+		arena->block = prev;
+	}
+	if (arena->block)
+		arena->block->used = checkpoint.used;
+}
+
+void arena_release(struct arena *arena)
+{
+	arena_restore(arena, (struct arenacheckpoint){ .block = NULL });
+}
+
+void arena_reset(struct arena *arena)
+{
+	struct arenablock *keep = NULL;
+	while (arena->block) {
+		struct arenablock *block = arena->block;
+		arena->block = block->prev;
+		if (!keep || block->size > keep->size) {
+			free(keep);
+			keep = block;
+		} else {
+			free(block);
+		}
+	}
+	if (keep) {
+		keep->prev = NULL;
+		keep->used = 0;
+	}
+	arena->block = keep;
+}
+
+void arena_adopt(struct arena *arena, struct arena *from)
+{
+	if (!from->block)
+		return;
+	struct arenablock *oldest = from->block;
+	while (oldest->prev)
+		oldest = oldest->prev;
+	oldest->prev = arena->block;
+	arena->block = from->block;
+	from->block = NULL;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+"""Throughput Benchmark for Wrasm
+
+Usage: bench.py <wrasm> <profile> <lines> [repeats]
+
+Generates a reproducible source with generate.py and assembles it with the
+given wrasm binary, reporting the best wall time of several runs along with
+the throughput in lines and bytes per second, the peak resident set size and
+the time spent in each phase as reported by `wrasm --stats`.
+
+Run every benchmark from the build directory with `meson benchmark`."""
+
+from pathlib import Path
+from re import MULTILINE, compile
+from statistics import median
+from subprocess import run
+from sys import argv, exit
+from tempfile import TemporaryDirectory
+from time import perf_counter
+
+from generate import generate, profiles
+
+phase_pattern = compile(r'^  (\w+) +([\d.]+) ms$', MULTILINE)
+
+try:
+    from resource import RUSAGE_CHILDREN, getrusage
+except ImportError:
+    getrusage = None
+
+
+def peak_rss() -> int:
+    """peak resident set size in KiB of any child so far, or 0 if unknown"""
+    if getrusage is None:
+        return 0
+    from platform import system
+    rss = getrusage(RUSAGE_CHILDREN).ru_maxrss
+    # macOS reports bytes rather than KiB
+    return rss // 1024 if system() == 'Darwin' else rss
+
+
+def assemble(wrasm: Path, source: Path, output: Path):
+    """returns the wall time and the phase timings of a single run"""
+    start = perf_counter()
+    result = run([wrasm, '--stats', source, '-o', output], check=True,
+                 capture_output=True, text=True)
+    elapsed = perf_counter() - start
+    phases = {n: float(t) for n, t in phase_pattern.findall(result.stderr)}
+    return elapsed, phases
+
+
+def bench(wrasm: Path, profile: str, lines: int, repeats: int) -> int:
+    with TemporaryDirectory() as tmp:
+        source = Path(tmp) / f'{profile}.S'
+        output = Path(tmp) / f'{profile}.o'
+        with open(source, 'w') as f:
+            for line in generate(profile, lines):
+                f.write(line + '\n')
+
+        size = source.stat().st_size
+        with open(source) as f:
+            count = sum(1 for _ in f)
+
+        # warm the page cache before timing anything
+        assemble(wrasm, source, output)
+        runs = [assemble(wrasm, source, output) for _ in range(repeats)]
+
+    times = [elapsed for elapsed, _ in runs]
+    best, phases = min(runs, key=lambda r: r[0])
+    print(f'profile:   {profile}')
+    print(f'source:    {count} lines, {size / 1e6:.2f} MB')
+    print(f'time:      {best * 1e3:.1f} ms best, '
+          f'{median(times) * 1e3:.1f} ms median of {repeats}')
+    print(f'lines/s:   {count / best:,.0f}')
+    print(f'MB/s:      {size / 1e6 / best:.2f}')
+    rss = peak_rss()
+    if rss:
+        print(f'peak RSS:  {rss / 1024:.1f} MiB')
+    for name, ms in phases.items():
+        print(f'  {name + ":":<10} {ms:10.1f} ms')
+    return 0
+
+
+def main(args: list[str]) -> int:
+    if len(args) < 3 or args[1] not in profiles:
+        print(__doc__)
+        return 1
+    repeats = int(args[3]) if len(args) > 3 else 5
+    return bench(Path(args[0]).resolve(), args[1], int(args[2]), repeats)
+
+
+if __name__ == '__main__':
+    exit(main(argv[1:]))
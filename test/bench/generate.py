@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+"""Synthetic Source Generator for Wrasm Benchmarks
+
+Usage: generate.py <profile> <lines> [seed] [output]
+
+Writes a reproducible assembly source of roughly the given number of lines to
+the output file (or stdout). The same profile, line count and seed always
+produce the same source.
+
+Profiles:
+    mix         a general mix of base, pseudo and atomic instructions
+    labels      a label on almost every line with dense branches between them
+    data        mostly string data in the data section
+    directives  frequent section switches, global symbols and small strings"""
+
+from random import Random
+from sys import argv, exit, stdout
+
+registers = [
+    'zero', 'ra', 'sp', 'gp', 'tp', 't0', 't1', 't2', 's0', 's1', 'a0', 'a1',
+    'a2', 'a3', 'a4', 'a5', 'a6', 'a7', 's2', 's3', 's4', 's5', 's6', 's7',
+    's8', 's9', 's10', 's11', 't3', 't4', 't5', 't6',
+] + [f'x{i}' for i in range(32)]
+
+rtype = ['add', 'sub', 'and', 'or', 'xor', 'sll', 'srl', 'sra', 'slt', 'sltu',
+         'addw', 'subw']
+itype = ['addi', 'xori', 'ori', 'andi', 'slti', 'sltiu', 'addiw']
+shifts = ['slli', 'srli', 'srai']
+loads = ['lb', 'lh', 'lw', 'lbu', 'lhu']
+stores = ['sb', 'sh', 'sw', 'sd']
+branches = ['beq', 'bne', 'blt', 'bge', 'bltu', 'bgeu']
+pseudo = ['mv', 'not', 'neg', 'seqz', 'snez']
+atomics = ['amoadd.w', 'amoswap.w', 'amoand.w', 'amoor.w', 'amoxor.w']
+
+words = ['lorem', 'ipsum', 'dolor', 'sit', 'amet', 'consectetur',
+         'adipiscing', 'elit', 'sed', 'do', 'eiusmod', 'tempor']
+
+
+class Generator:
+    def __init__(self, seed: int):
+        self.rng = Random(seed)
+        self.labels = 0
+
+    def reg(self) -> str:
+        return self.rng.choice(registers)
+
+    def string(self) -> str:
+        count = self.rng.randint(1, 8)
+        text = ' '.join(self.rng.choice(words) for _ in range(count))
+        return f'"{text}\\n"'
+
+    def label(self) -> str:
+        name = f'.L{self.labels}'
+        self.labels += 1
+        return name
+
+    def target(self, spread: int) -> str:
+        """a label near the current one, which may not be defined yet"""
+        lo = max(0, self.labels - spread)
+        return f'.L{self.rng.randint(lo, self.labels + spread)}'
+
+    def instruction(self, spread: int = 64) -> str:
+        r = self.rng
+        kind = r.random()
+        if kind < 0.25:
+            return f'{r.choice(rtype)} {self.reg()}, {self.reg()}, {self.reg()}'
+        if kind < 0.45:
+            imm = r.randint(-2048, 2047)
+            return f'{r.choice(itype)} {self.reg()}, {self.reg()}, {imm}'
+        if kind < 0.50:
+            return f'{r.choice(shifts)} {self.reg()}, {self.reg()}, {r.randint(0, 31)}'
+        if kind < 0.60:
+            off = r.randint(-2048, 2047)
+            return f'{r.choice(loads)} {self.reg()}, {off}({self.reg()})'
+        if kind < 0.68:
+            off = r.randint(-2048, 2047)
+            return f'{r.choice(stores)} {self.reg()}, {off}({self.reg()})'
+        if kind < 0.78:
+            return (f'{r.choice(branches)} {self.reg()}, {self.reg()}, '
+                    f'{self.target(spread)}')
+        if kind < 0.82:
+            return f'jal {self.reg()}, {self.target(spread)}'
+        if kind < 0.86:
+            return f'li {self.reg()}, {r.randint(-(1 << 31), (1 << 31) - 1)}'
+        if kind < 0.88:
+            return f'lui {self.reg()}, {r.randint(0, (1 << 20) - 1)}'
+        if kind < 0.94:
+            return f'{r.choice(pseudo)} {self.reg()}, {self.reg()}'
+        if kind < 0.97:
+            return f'{r.choice(atomics)} {self.reg()}, {self.reg()}, {self.reg()}'
+        return r.choice(['nop', 'ecall', 'fence', 'ret'])
+
+    def mix(self, lines: int):
+        yield '.globl _start'
+        yield '.section .text'
+        yield '_start:'
+        for i in range(lines):
+            if i % 16 == 0:
+                yield f'{self.label()}:'
+            yield f'    {self.instruction()}'
+        yield from self.close_labels(64)
+
+    def labels_profile(self, lines: int):
+        yield '.section .text'
+        for _ in range(lines):
+            yield f'{self.label()}: {self.instruction(spread=256)}'
+        yield from self.close_labels(256)
+
+    def data(self, lines: int):
+        yield '.section .data'
+        for _ in range(lines):
+            if self.rng.random() < 0.5:
+                yield f'{self.label()}: .asciz {self.string()}'
+            else:
+                yield f'    .ascii {self.string()}'
+
+    def directives(self, lines: int):
+        section = None
+        for _ in range(lines):
+            kind = self.rng.random()
+            if kind < 0.2:
+                section = self.rng.choice(['.text', '.data'])
+                yield f'.section {section}'
+            elif kind < 0.3:
+                yield f'.globl .L{self.labels}'
+            elif section == '.data':
+                yield f'{self.label()}: .string {self.string()}'
+            else:
+                yield f'{self.label()}: nop'
+        # any remaining global must still be defined
+        yield '.section .text'
+        yield f'{self.label()}: nop'
+
+    def close_labels(self, spread: int):
+        """define every label that may have been referenced ahead of time"""
+        for _ in range(spread + 1):
+            yield f'{self.label()}: nop'
+
+
+profiles = {
+    'mix': Generator.mix,
+    'labels': Generator.labels_profile,
+    'data': Generator.data,
+    'directives': Generator.directives,
+}
+
+
+def generate(profile: str, lines: int, seed: int = 0):
+    """yields the lines of the generated source"""
+    return profiles[profile](Generator(seed), lines)
+
+
+def main(args: list[str]) -> int:
+    if len(args) < 2 or args[0] not in profiles:
+        print(__doc__)
+        return 1
+
+    lines = int(args[1])
+    seed = int(args[2]) if len(args) > 2 else 0
+    out = open(args[3], 'w') if len(args) > 3 else stdout
+    try:
+        for line in generate(args[0], lines, seed):
+            out.write(line + '\n')
+    finally:
+        if out is not stdout:
+            out.close()
+    return 0
+
+
+if __name__ == '__main__':
+    exit(main(argv[1:]))
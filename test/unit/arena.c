@@ -0,0 +1,63 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "xmalloc.h"
+
+#define ARENA_TESTS 100000
+
+int main(void)
+{
+	set_exit_loglevel(NODEBUG);
+	int errors = 0;
+	struct arena arena = { .block = NULL };
+
+	unsigned char *first = arena_alloc(&arena, 1);
+	unsigned char *second = arena_alloc(&arena, 1);
+	*first = 1;
+	*second = 2;
+	if ((uintptr_t)second % _Alignof(max_align_t)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, arena allocation %p is misaligned",
+		       (void *)second);
+		errors++;
+	}
+	if (second <= first) {
+		logger(ERROR, error_internal,
+		       "Test Failed, arena allocations overlap");
+		errors++;
+	}
+
+	const struct arenacheckpoint checkpoint = arena_checkpoint(&arena);
+	unsigned char *before = arena_alloc(&arena, 16);
+	for (size_t i = 0; i < ARENA_TESTS; i++) {
+		unsigned char *ptr = arena_alloc(&arena, i % 100 + 1);
+		memset(ptr, 0xff, i % 100 + 1);
+	}
+	/* larger than a block, must not corrupt the current one */
+	unsigned char *large = arena_alloc(&arena, (size_t)4 << 20);
+	memset(large, 0xff, (size_t)4 << 20);
+
+	arena_restore(&arena, checkpoint);
+	unsigned char *after = arena_alloc(&arena, 16);
+	if (after != before) {
+		logger(ERROR, error_internal,
+		       "Test Failed, restoring a checkpoint did not reuse memory");
+		errors++;
+	}
+	if (*first != 1 || *second != 2) {
+		logger(ERROR, error_internal,
+		       "Test Failed, allocations before the checkpoint were overwritten");
+		errors++;
+	}
+
+	arena_release(&arena);
+	if (arena.block) {
+		logger(ERROR, error_internal,
+		       "Test Failed, released arena still holds memory");
+		errors++;
+	}
+
+	return errors != 0 || get_clean_exit(ERROR);
+}
@@ -0,0 +1,251 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_POSIX_IO
+#endif
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_POSIX_IO
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+#include "input.h"
+
+#ifdef HAVE_POSIX_IO
+
+/* one entry fits in each subdirectory, but not two */
+#define ENTRY_SIZE 1000
+#define CACHE_SIZE (16 * (ENTRY_SIZE + ENTRY_SIZE / 2))
+
+static struct cache cache = { .dir = "cache", .limit = CACHE_SIZE };
+
+static int write_file(const char *name, const char *text, size_t len)
+{
+	FILE *f = fopen(name, "wb");
+	if (!f)
+		return 1;
+	const int err = fwrite(text, 1, len, f) != len;
+	return fclose(f) || err;
+}
+
+static int same_file(const char *a, const char *b)
+{
+	FILE *fa = fopen(a, "rb");
+	FILE *fb = fopen(b, "rb");
+	int same = fa && fb;
+	while (same) {
+		const int ca = getc(fa);
+		same = ca == getc(fb);
+		if (ca == EOF)
+			break;
+	}
+	if (fa)
+		fclose(fa);
+	if (fb)
+		fclose(fb);
+	return same;
+}
+
+static int key_file(struct cache_key *key, const char *name,
+		    enum output_format format, bool compress)
+{
+	FILE *f = fopen(name, "rb");
+	if (!f)
+		return 1;
+	struct input input;
+	open_input(&input, f);
+	const int err = cache_key(key, &input, format, compress);
+	close_input(&input);
+	fclose(f);
+	return err;
+}
+
+static int check_keys(void)
+{
+	struct cache_key base, again, compressed, raw, changed;
+	int errors = 0;
+	if (write_file("a.S", "  nop\n", 6) ||
+	    key_file(&base, "a.S", FORMAT_ELF, false) ||
+	    key_file(&again, "a.S", FORMAT_ELF, false) ||
+	    key_file(&compressed, "a.S", FORMAT_ELF, true) ||
+	    key_file(&raw, "a.S", FORMAT_BIN, false) ||
+	    write_file("a.S", "  nop \n", 7) ||
+	    key_file(&changed, "a.S", FORMAT_ELF, false)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to hash a.S");
+		return 1;
+	}
+
+	if (strcmp(base.hex, again.hex)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, key changed between runs");
+		errors++;
+	}
+	if (!strcmp(base.hex, compressed.hex) || !strcmp(base.hex, raw.hex) ||
+	    !strcmp(base.hex, changed.hex)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, key ignored the options or source");
+		errors++;
+	}
+	/* only what is mapped can be hashed before it is assembled */
+	struct input input;
+	open_input_buffer(&input, "  nop\n", 6);
+	if (!cache_key(&base, &input, FORMAT_ELF, false) ||
+	    write_file("a.S", "", 0) ||
+	    !key_file(&base, "a.S", FORMAT_ELF, false)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, key made for input which was not mapped");
+		errors++;
+	}
+	remove("a.S");
+	return errors;
+}
+
+/* a source written to in place while it was assembled is not stored */
+static int check_changed(void)
+{
+	struct cache_key key;
+	FILE *f = NULL;
+	if (write_file("a.S", "  nop\n", 6) || !(f = fopen("a.S", "rb")) ||
+	    key_file(&key, "a.S", FORMAT_ELF, false)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to hash a.S");
+		if (f)
+			fclose(f);
+		return 1;
+	}
+
+	int errors = 0;
+	if (!source_unchanged(&key, f)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unchanged source seen as changed");
+		errors++;
+	}
+	if (write_file("a.S", "  ret\n", 6) || source_unchanged(&key, f)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, source changed in place went unnoticed");
+		errors++;
+	}
+	fclose(f);
+	remove("a.S");
+	return errors;
+}
+
+/* sources whose keys share a subdirectory, so that they compete for room */
+static int make_sources(struct cache_key keys[2])
+{
+	char text[32];
+	size_t found = 0;
+	for (unsigned i = 0; found < 2 && i < 4096; i++) {
+		const int len = snprintf(text, sizeof(text),
+					 "  addi a0, a0, %u\n", i);
+		char name[16];
+		snprintf(name, sizeof(name), "%zu.S", found);
+		if (write_file(name, text, (size_t)len) ||
+		    key_file(&keys[found], name, FORMAT_ELF, false))
+			return 1;
+		if (!found || keys[0].hex[0] == keys[1].hex[0])
+			found++;
+	}
+	return found != 2;
+}
+
+static int check_round_trip(const struct cache_key *key)
+{
+	char object[ENTRY_SIZE];
+	memset(object, 0x5a, sizeof(object));
+	if (write_file("0.o", object, sizeof(object))) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to write 0.o");
+		return 1;
+	}
+
+	if (!fetch_cached(&cache, key, "out.o")) {
+		logger(ERROR, error_internal,
+		       "Test Failed, hit in an empty cache");
+		return 1;
+	}
+	store_cached(&cache, key, "0.o");
+	if (fetch_cached(&cache, key, "out.o") || !same_file("0.o", "out.o")) {
+		logger(ERROR, error_internal,
+		       "Test Failed, stored object not fetched back");
+		return 1;
+	}
+	return 0;
+}
+
+/* the entry used least recently makes way for a new one */
+static int check_eviction(const struct cache_key keys[2])
+{
+	char path[96];
+	snprintf(path, sizeof(path), "cache/%c/%s", keys[0].hex[0],
+		 keys[0].hex);
+	const struct timespec old[2] = { { .tv_sec = 1 }, { .tv_sec = 1 } };
+	utimensat(AT_FDCWD, path, old, 0);
+
+	store_cached(&cache, &keys[1], "0.o");
+	int errors = 0;
+	if (!fetch_cached(&cache, &keys[0], "out.o")) {
+		logger(ERROR, error_internal,
+		       "Test Failed, least recently used entry was kept");
+		errors++;
+	}
+	if (fetch_cached(&cache, &keys[1], "out.o")) {
+		logger(ERROR, error_internal,
+		       "Test Failed, newest entry was evicted");
+		errors++;
+	}
+
+	remove(path);
+	snprintf(path, sizeof(path), "cache/%c/%s", keys[1].hex[0],
+		 keys[1].hex);
+	remove(path);
+	snprintf(path, sizeof(path), "cache/%c", keys[1].hex[0]);
+	rmdir(path);
+	return errors;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/wrasm_cache_XXXXXX";
+	if (!mkdtemp(dir) || chdir(dir)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to make a directory to work in");
+		return 1;
+	}
+
+	int errors = check_keys();
+	errors += check_changed();
+	struct cache_key keys[2];
+	if (make_sources(keys)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to find keys to share a directory");
+		errors++;
+	} else if (!(errors += check_round_trip(&keys[0]))) {
+		errors += check_eviction(keys);
+	}
+
+	remove("0.S");
+	remove("1.S");
+	remove("0.o");
+	remove("out.o");
+	rmdir("cache");
+	rmdir(dir);
+	return errors != 0;
+}
+
+#else
+
+int main(void)
+{
+	return 0;
+}
+
+#endif
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "macros.h"
@@ -17,6 +18,14 @@ struct {
 	{ "0xA3", 163 },      { "0xa3", 163 },
 	{ "0b01001010", 74 }, { "0b11110000", 240 },
 	{ "0b00110011", 51 },
+	{ "0xFFFFFFFFFFFFFFFF", (size_t)-1 },
+};
+
+/* too wide for 64 bits, so they can't be encoded as written */
+const char *rejected[] = {
+	"99999999999999999999",
+	"0x10000000000000000",
+	"-99999999999999999999",
 };
 
 int main(void)
@@ -26,7 +35,8 @@ int main(void)
 	int errors = 0;
 	for (size_t i = 0; i < ARRAY_LENGTH(tests); i++) {
 		size_t imm = 0;
-		if (get_immediate(tests[i].symbol, &imm)) {
+		if (get_immediate(tests[i].symbol, strlen(tests[i].symbol),
+				  &imm)) {
 			logger(ERROR, error_internal,
 				"Test Failed, get_immediate() failed with input %s",
 				tests[i].symbol);
@@ -38,6 +48,15 @@ int main(void)
 			errors++;
 		}
 	}
+	for (size_t i = 0; i < ARRAY_LENGTH(rejected); i++) {
+		size_t imm = 0;
+		if (!get_immediate(rejected[i], strlen(rejected[i]), &imm)) {
+			logger(ERROR, error_internal,
+			       "Test Failed, out of range %s was accepted",
+			       rejected[i]);
+			errors++;
+		}
+	}
 	if (errors)
 		logger(ERROR, error_internal, "%d tests failed", errors);
 	return errors != 0 || get_clean_exit(ERROR);
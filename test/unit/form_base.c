@@ -2,13 +2,14 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "context.h"
 #include "debug.h"
 #include "elf/output.h"
 #include "form/instructions.h"
 #include "form/generic.h"
+#include "lexer.h"
 #include "macros.h"
 #include "symbols.h"
-#include "xmalloc.h"
 
 struct case_t {
 	const char *asm;
@@ -53,37 +54,43 @@ struct case_t cases[] = {
 	{ .asm = "fence.tso", .bytecode = 0x8330000f },
 };
 
+static struct wrasm_ctx ctx;
+
 int test_case(struct case_t c)
 {
-	const size_t line_sz = strlen(c.asm) + 1;
-	char *line = xmalloc(line_sz);
-	memcpy(line, c.asm, line_sz);
-
-	char *instruction = strtok(line, " \t");
-	char *argstr = strtok(NULL, "");
+	struct tokenline line;
+	struct operands ops;
+	if (tokenize(c.asm, &line) || !line.count ||
+	    split_operands(line.tokens + 1, line.count - 1, &ops)) {
+		logger(ERROR, error_internal, "Unable to tokenize %s", c.asm);
+		return 1;
+	}
 
-	const struct formation formation = parse_form(instruction);
+	const struct token *instruction = &line.tokens[0];
+	const struct formation formation =
+		parse_form(instruction->str, instruction->len);
 	if (!formation.name) {
 		logger(ERROR, error_internal,
-		       "Unable to find formation for instruction %s in %s",
-		       instruction, c.asm);
+		       "Unable to find formation for instruction %.*s in %s",
+		       (int)instruction->len, instruction->str, c.asm);
 		return 1;
 	}
 
-	struct args args = formation.arg_handler(argstr);
+	struct args args = formation.arg_handler(&ctx, &ops);
 
-	struct bytecode result = formation.form_handler(
-		formation.name, formation.idata, args, c.p);
+	unsigned char result[sizeof(c.bytecode)];
+	const size_t size = formation.form_handler(
+		&ctx, formation.name, formation.idata, args, c.p, result);
 
-	if (result.size != sizeof(c.bytecode)) {
+	if (size != sizeof(c.bytecode)) {
 		logger(ERROR, error_internal, "invalid size generated for %s",
 		       c.asm);
 		return 1;
 	}
-	if (*(uint32_t *)result.data != c.bytecode) {
+	if (get_u32(result) != c.bytecode) {
 		logger(ERROR, error_internal,
 		       "Expected %.08x but got %.08x while generating %s",
-		       c.bytecode, *(uint32_t *)result.data, c.asm);
+		       c.bytecode, get_u32(result), c.asm);
 		return 1;
 	}
 
@@ -95,8 +102,10 @@ int main(void)
 	set_exit_loglevel(NODEBUG);
 	set_min_loglevel(DEBUG);
 
-	struct symbol *start = create_symbol("_start", SYMBOL_LABEL);
-	start->section = SECTION_NULL;
+	init_context(&ctx);
+	struct symbol *start =
+		create_symbol(&ctx, "_start", strlen("_start"), SYMBOL_LABEL);
+	start->section = SECTION_TEXT;
 	start->value = 0;
 
 	int errors = 0;
@@ -104,5 +113,6 @@ int main(void)
 	for (size_t i = 0; i < ARRAY_LENGTH(cases); i++)
 		errors += test_case(cases[i]);
 
+	free_context(&ctx);
 	return errors != 0 || get_clean_exit(ERROR);
 }
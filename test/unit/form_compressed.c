@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "context.h"
+#include "debug.h"
+#include "elf/output.h"
+#include "form/instructions.h"
+#include "form/generic.h"
+#include "lexer.h"
+#include "macros.h"
+#include "symbols.h"
+#include "wrasm.h"
+
+struct case_t {
+	const char *asm;
+	uint16_t bytecode;
+	size_t p;
+};
+
+struct case_t cases[] = {
+	{ .asm = "c.nop", .bytecode = 0x0001 },
+	{ .asm = "c.addi a0, 5", .bytecode = 0x0515 },
+	{ .asm = "c.addi a0, -32", .bytecode = 0x1501 },
+	{ .asm = "c.li a1, 31", .bytecode = 0x45fd },
+	{ .asm = "c.addiw a4, -1", .bytecode = 0x377d },
+	{ .asm = "c.addi16sp sp, -64", .bytecode = 0x7139 },
+	{ .asm = "c.addi16sp sp, 496", .bytecode = 0x617d },
+	{ .asm = "c.addi4spn a3, sp, 1020", .bytecode = 0x1ff4 },
+	{ .asm = "c.lui a0, 0x1f000", .bytecode = 0x657d },
+	{ .asm = "c.lui a0, 0xfffe0000", .bytecode = 0x7501 },
+	{ .asm = "c.slli a5, 63", .bytecode = 0x17fe },
+	{ .asm = "c.srli s0, 1", .bytecode = 0x8005 },
+	{ .asm = "c.srai s1, 33", .bytecode = 0x9485 },
+	{ .asm = "c.andi a0, -1", .bytecode = 0x997d },
+	{ .asm = "c.mv a0, a1", .bytecode = 0x852e },
+	{ .asm = "c.add a0, a1", .bytecode = 0x952e },
+	{ .asm = "c.sub s0, s1", .bytecode = 0x8c05 },
+	{ .asm = "c.xor a0, a1", .bytecode = 0x8d2d },
+	{ .asm = "c.or a2, a3", .bytecode = 0x8e55 },
+	{ .asm = "c.and a4, a5", .bytecode = 0x8f7d },
+	{ .asm = "c.subw a0, a1", .bytecode = 0x9d0d },
+	{ .asm = "c.addw a1, a0", .bytecode = 0x9da9 },
+	{ .asm = "c.lw a0, 124(a1)", .bytecode = 0x5de8 },
+	{ .asm = "c.ld a0, 248(a1)", .bytecode = 0x7de8 },
+	{ .asm = "c.sw a0, 124(a1)", .bytecode = 0xdde8 },
+	{ .asm = "c.sd a0, 248(a1)", .bytecode = 0xfde8 },
+	{ .asm = "c.lwsp a0, 252(sp)", .bytecode = 0x557e },
+	{ .asm = "c.ldsp ra, 504(sp)", .bytecode = 0x70fe },
+	{ .asm = "c.swsp a0, 252(sp)", .bytecode = 0xdfaa },
+	{ .asm = "c.sdsp ra, 504(sp)", .bytecode = 0xff86 },
+	{ .asm = "c.jr ra", .bytecode = 0x8082 },
+	{ .asm = "c.jalr a0", .bytecode = 0x9502 },
+	{ .asm = "c.ebreak", .bytecode = 0x9002 },
+	{ .asm = "c.beqz a0, _start", .bytecode = 0xd945, .p = 0x50 },
+	{ .asm = "c.bnez s1, _start", .bytecode = 0xf4dd, .p = 0x52 },
+	{ .asm = "c.j _start", .bytecode = 0xb76d, .p = 0x56 },
+};
+
+static struct wrasm_ctx ctx;
+
+int test_case(struct case_t c)
+{
+	struct tokenline line;
+	struct operands ops;
+	if (tokenize(c.asm, &line) || !line.count ||
+	    split_operands(line.tokens + 1, line.count - 1, &ops)) {
+		logger(ERROR, error_internal, "Unable to tokenize %s", c.asm);
+		return 1;
+	}
+
+	const struct token *instruction = &line.tokens[0];
+	const struct formation formation =
+		parse_form(instruction->str, instruction->len);
+	if (!formation.name) {
+		logger(ERROR, error_internal,
+		       "Unable to find formation for instruction %.*s in %s",
+		       (int)instruction->len, instruction->str, c.asm);
+		return 1;
+	}
+
+	struct args args = formation.arg_handler(&ctx, &ops);
+
+	unsigned char result[sizeof(c.bytecode)];
+	const size_t size = formation.form_handler(
+		&ctx, formation.name, formation.idata, args, c.p, result);
+
+	if (size != sizeof(c.bytecode)) {
+		logger(ERROR, error_internal, "invalid size generated for %s",
+		       c.asm);
+		return 1;
+	}
+	if (get_u16(result) != c.bytecode) {
+		logger(ERROR, error_internal,
+		       "Expected %.04x but got %.04x while generating %s",
+		       c.bytecode, get_u16(result), c.asm);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* --compress should pick the same encodings for the full instructions */
+static int test_compress(void)
+{
+	static const char src[] = "start:\n"
+				  "  addi a0, a0, 5\n"
+				  "  ld ra, sp, 504\n"
+				  "  add a0, a1, a0\n"
+				  "  bnez s1, start\n"
+				  "  ret\n"
+				  "  addi a0, a0, 64\n";
+	static const uint16_t expected[] = { 0x0515, 0x70fe, 0x952e,
+					     0xfced, 0x8082 };
+
+	const struct wrasm_options opts = {
+		.format = WRASM_FORMAT_RAW,
+		.compress = 1,
+	};
+	struct wrasm_buffer out;
+	if (wrasm_assemble(src, strlen(src), &opts, &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble with compression");
+		return 1;
+	}
+
+	int errors = 0;
+	if (out.size != 2 * ARRAY_LENGTH(expected) + 4) {
+		logger(ERROR, error_internal,
+		       "Test Failed, expected %zu bytes but got %zu",
+		       2 * ARRAY_LENGTH(expected) + 4, out.size);
+		errors++;
+	} else {
+		for (size_t i = 0; i < ARRAY_LENGTH(expected); i++) {
+			if (get_u16(out.data + 2 * i) == expected[i])
+				continue;
+			logger(ERROR, error_internal,
+			       "Expected %.04x but got %.04x at 0x%zx",
+			       expected[i], get_u16(out.data + 2 * i), 2 * i);
+			errors++;
+		}
+	}
+	wrasm_free_buffer(&out);
+	return errors;
+}
+
+/* encodings which are hints or reserved rather than instructions */
+static int test_rejected(void)
+{
+	static const char *const rejected[] = {
+		"c.slli a5, 0",
+		"c.srli s0, 0",
+		"c.srai s1, 0",
+	};
+	const struct wrasm_options opts = { .format = WRASM_FORMAT_RAW };
+	int errors = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(rejected); i++) {
+		struct wrasm_buffer out;
+		if (wrasm_assemble(rejected[i], strlen(rejected[i]), &opts,
+				   &out))
+			continue;
+		logger(ERROR, error_internal,
+		       "Test Failed, %s was assembled", rejected[i]);
+		wrasm_free_buffer(&out);
+		errors++;
+	}
+	return errors;
+}
+
+int main(void)
+{
+	set_exit_loglevel(NODEBUG);
+	set_min_loglevel(DEBUG);
+
+	init_context(&ctx);
+	struct symbol *start =
+		create_symbol(&ctx, "_start", strlen("_start"), SYMBOL_LABEL);
+	start->section = SECTION_TEXT;
+	start->value = 0;
+
+	int errors = 0;
+
+	for (size_t i = 0; i < ARRAY_LENGTH(cases); i++)
+		errors += test_case(cases[i]);
+
+	free_context(&ctx);
+
+	errors += test_compress();
+	errors += test_rejected();
+	return errors != 0 || get_clean_exit(ERROR);
+}
@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "debug.h"
 #include "macros.h"
@@ -29,6 +30,43 @@ struct {
 	{ "t2", 7 },
 	{ "t3", 28 },
 	{ "a1", 11 },
+	{ "tp", 4 },
+	{ "gp", 3 },
+	{ "t6", 31 },
+	{ "t7", (size_t)-1 },
+	{ "s11", 27 },
+	{ "s12", (size_t)-1 },
+	{ "x", (size_t)-1 },
+	{ "x3a", (size_t)-1 },
+	{ "zer", (size_t)-1 },
+	{ "zeros", (size_t)-1 },
+	{ "f0", (size_t)-1 },
+	{ "ft0", (size_t)-1 },
+};
+
+struct {
+	const char *symbol;
+	const size_t value;
+} float_tests[] = {
+	{ "f0", 0 },
+	{ "f9", 9 },
+	{ "f31", 31 },
+	{ "f32", (size_t)-1 },
+	{ "ft0", 0 },
+	{ "ft7", 7 },
+	{ "ft8", 28 },
+	{ "ft11", 31 },
+	{ "ft12", (size_t)-1 },
+	{ "fs0", 8 },
+	{ "fs1", 9 },
+	{ "fs2", 18 },
+	{ "fs11", 27 },
+	{ "fa0", 10 },
+	{ "fa7", 17 },
+	{ "fa8", (size_t)-1 },
+	{ "fp", (size_t)-1 },
+	{ "x1", (size_t)-1 },
+	{ "f", (size_t)-1 },
 };
 
 int main(void)
@@ -37,7 +75,8 @@ int main(void)
 	set_min_loglevel(DEBUG);
 	int errors = 0;
 	for (size_t i = 0; i < ARRAY_LENGTH(tests); i++) {
-		size_t imm = get_register_id(tests[i].symbol);
+		size_t imm = get_register_id(tests[i].symbol,
+					     strlen(tests[i].symbol));
 		if (imm != tests[i].value) {
 			logger(ERROR, error_internal,
 			       "Test Failed, expected \"%s\" to equal %d but was given %d",
@@ -45,6 +84,26 @@ int main(void)
 			errors++;
 		}
 	}
+	for (size_t i = 0; i < ARRAY_LENGTH(float_tests); i++) {
+		size_t imm = get_float_register_id(
+			float_tests[i].symbol, strlen(float_tests[i].symbol));
+		if (imm != float_tests[i].value) {
+			logger(ERROR, error_internal,
+			       "Test Failed, expected \"%s\" to equal %d but was given %d",
+			       float_tests[i].symbol, float_tests[i].value, imm);
+			errors++;
+		}
+	}
+	for (size_t i = 0; i < ARRAY_LENGTH(float_tests); i++) {
+		const size_t id = float_tests[i].value;
+		if (id < 32 && float_tests[i].symbol[1] > '9' &&
+		    strcmp(float_reg_abi_map[id], float_tests[i].symbol)) {
+			logger(ERROR, error_internal,
+			       "Test Failed, float register %d is named \"%s\" not \"%s\"",
+			       id, float_reg_abi_map[id], float_tests[i].symbol);
+			errors++;
+		}
+	}
 	if (errors)
 		logger(CRITICAL, error_internal, "%d tests failed", errors);
 	return errors != 0 || get_clean_exit(ERROR);
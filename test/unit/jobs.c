@@ -0,0 +1,112 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_POSIX_IO
+#endif
+
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_POSIX_IO
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+
+#ifdef HAVE_POSIX_IO
+
+/* operands which fail to parse, each assembled next to a good file */
+static const char *const malformed[] = {
+	"  j\n",
+	"  beq a0, a1, 4\n",
+	"  la a0\n",
+	"  la a0, 1\n",
+};
+
+static int write_file(const char *name, const char *text)
+{
+	FILE *f = fopen(name, "w");
+	if (!f)
+		return 1;
+	const int err = fputs(text, f) == EOF;
+	return fclose(f) || err;
+}
+
+/* the failed job leaves nothing behind, not even its temporary output */
+static size_t count_files(void)
+{
+	DIR *dir = opendir(".");
+	if (!dir)
+		return 0;
+	size_t count = 0;
+	for (struct dirent *ent; (ent = readdir(dir));)
+		count += ent->d_name[0] != '.';
+	closedir(dir);
+	return count;
+}
+
+static int check_malformed(const char *text)
+{
+	if (write_file("bad.S", text) || write_file("ok.S", "  nop\n")) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to write the sources");
+		return 1;
+	}
+
+	char outputs[][8] = { "bad.o", "ok.o" };
+	struct job jobs[] = {
+		{ .input = "bad.S", .output = outputs[0] },
+		{ .input = "ok.S", .output = outputs[1] },
+	};
+	jobs[0].format = jobs[1].format = FORMAT_ELF;
+	struct stats totals = { .counters = { 0 } };
+	const size_t failed = run_jobs(jobs, 2, 2, &totals);
+
+	int errors = 0;
+	if (failed != 1 || !jobs[0].failed || jobs[1].failed) {
+		logger(ERROR, error_internal,
+		       "Test Failed, %zu jobs failed assembling \"%s\"", failed,
+		       text);
+		errors++;
+	}
+	if (remove("ok.o") || count_files() != 2) {
+		logger(ERROR, error_internal,
+		       "Test Failed, wrong outputs left assembling \"%s\"",
+		       text);
+		errors++;
+	}
+	remove("bad.S");
+	remove("ok.S");
+	return errors;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/wrasm_jobs_XXXXXX";
+	if (!mkdtemp(dir) || chdir(dir)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to make a directory to work in");
+		return 1;
+	}
+
+	/* as with several inputs, errors fail their own job */
+	set_exit_loglevel(NODEBUG);
+	int errors = 0;
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(*malformed); i++)
+		errors += check_malformed(malformed[i]);
+
+	rmdir(dir);
+	return errors != 0;
+}
+
+#else
+
+int main(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "wrasm.h"
+#include "xmalloc.h"
+
+static const char hello[] = ".globl _start\n"
+			    ".section .text\n"
+			    "_start:\n"
+			    "  addi a0, zero, 1\n"
+			    "  la a1, greeting\n"
+			    "  ecall\n"
+			    ".section .data\n"
+			    "greeting: .asciz \"Hello\"\n";
+
+/* operands which fail to parse, for every format */
+static const char *const malformed[] = {
+	"j",
+	"beq a0, a1, 4",
+	"la a0",
+	"la a0, 1",
+	"addi a0, zero",
+	"addi a0, zero, nowhere",
+};
+
+static int check_output(const char *src, size_t len, enum wrasm_format format,
+			const void *want, size_t wantlen)
+{
+	const struct wrasm_options opts = { .format = format };
+	struct wrasm_buffer out;
+	if (wrasm_assemble(src, len, &opts, &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble \"%.*s\"", (int)len,
+		       src);
+		return 1;
+	}
+	int errors = 0;
+	if (out.size != wantlen || memcmp(out.data, want, wantlen)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, wrong output for \"%.*s\" (%zu bytes)",
+		       (int)len, src, out.size);
+		errors++;
+	}
+	wrasm_free_buffer(&out);
+	return errors;
+}
+
+/* more than 64KiB of output needs an extended linear address record */
+static int check_ihex_extended_address(void)
+{
+	static const char line[] = "addi a0, zero, 1\n";
+	const size_t lines = 0x10000 / 4 + 1;
+	char *src = xmalloc(lines * strlen(line));
+	for (size_t i = 0; i < lines; i++)
+		memcpy(src + i * strlen(line), line, strlen(line));
+
+	const struct wrasm_options opts = { .format = WRASM_FORMAT_IHEX };
+	struct wrasm_buffer out;
+	int errors = wrasm_assemble(src, lines * strlen(line), &opts, &out);
+	free(src);
+	if (errors) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble 64KiB of Intel HEX");
+		return errors;
+	}
+
+	/* 4096 full data records of 44 characters come first */
+	static const char extended[] = ":020000040001F9\n";
+	const size_t at = 0x10000 / 16 * 44;
+	if (out.size < at + strlen(extended) ||
+	    memcmp(out.data + at, extended, strlen(extended))) {
+		logger(ERROR, error_internal,
+		       "Test Failed, missing extended linear address record");
+		errors++;
+	}
+	wrasm_free_buffer(&out);
+	return errors;
+}
+
+/* fails the assembly instead of encoding whatever could be parsed */
+static int check_rejected(const char *src, enum wrasm_format format)
+{
+	const struct wrasm_options opts = { .format = format };
+	struct wrasm_buffer out;
+	if (wrasm_assemble(src, strlen(src), &opts, &out) && !out.data)
+		return 0;
+	logger(ERROR, error_internal,
+	       "Test Failed, \"%s\" assembled to format %d", src, (int)format);
+	wrasm_free_buffer(&out);
+	return 1;
+}
+
+static int check_malformed(void)
+{
+	int errors = 0;
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(*malformed); i++) {
+		errors += check_rejected(malformed[i], WRASM_FORMAT_ELF);
+		errors += check_rejected(malformed[i], WRASM_FORMAT_RAW);
+		errors += check_rejected(malformed[i], WRASM_FORMAT_IHEX);
+	}
+	return errors;
+}
+
+int main(void)
+{
+	int errors = 0;
+	struct wrasm_buffer out;
+
+	/* the source does not need to be null terminated */
+	static const char slice[] = "addi a0, zero, 1\naddi a1, zero, 2XXXX";
+	static const unsigned char slice_bytes[] = {
+		0x13, 0x05, 0x10, 0x00, 0x93, 0x05, 0x20, 0x00,
+	};
+	errors += check_output(slice, sizeof(slice) - 5, WRASM_FORMAT_RAW,
+			       slice_bytes, sizeof(slice_bytes));
+	static const char slice_hex[] = ":08000000130510009305200018\n"
+					":00000001FF\n";
+	errors += check_output(slice, sizeof(slice) - 5, WRASM_FORMAT_IHEX,
+			       slice_hex, strlen(slice_hex));
+
+	/* the auipc of la is 12 bytes before .data, which follows the ecall */
+	static const unsigned char hello_bytes[] = {
+		0x13, 0x05, 0x10, 0x00, 0x97, 0x05, 0x00, 0x00, 0x93, 0x85,
+		0xc5, 0x00, 0x73, 0x00, 0x00, 0x00, 'H',  'e',  'l',  'l',
+		'o',  0x00,
+	};
+	errors += check_output(hello, strlen(hello), WRASM_FORMAT_RAW,
+			       hello_bytes, sizeof(hello_bytes));
+
+	if (wrasm_assemble(hello, strlen(hello), NULL, &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble an ELF object");
+		return 1;
+	}
+	if (out.size < 64 || memcmp(out.data, "\177ELF", 4)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, output is not an ELF object");
+		errors++;
+	}
+	wrasm_free_buffer(&out);
+
+	errors += check_ihex_extended_address();
+
+	/* errors are returned to the caller rather than exiting */
+	static const char bad[] = "addi a0, zero, 1\nnotaninstruction a0\n";
+	if (!wrasm_assemble(bad, strlen(bad), NULL, &out) || out.data) {
+		logger(ERROR, error_internal,
+		       "Test Failed, invalid source assembled successfully");
+		errors++;
+	}
+	/* only ELF objects can leave a symbol for the linker */
+	static const char missing[] = "jal zero, nowhere\n";
+	const struct wrasm_options raw = { .format = WRASM_FORMAT_RAW };
+	if (!wrasm_assemble(missing, strlen(missing), &raw, &out) ||
+	    out.data) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unknown symbol assembled successfully");
+		errors++;
+	}
+
+	errors += check_malformed();
+	return errors;
+}
@@ -0,0 +1,119 @@
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "debug.h"
+#include "form/immediate.h"
+#include "macros.h"
+
+struct case_t {
+	int64_t value;
+	size_t steps;
+};
+
+static const struct case_t cases[] = {
+	{ 0, 1 },
+	{ 1, 1 },
+	{ -1, 1 },
+	{ 2047, 1 },
+	{ -2048, 1 },
+	{ 2048, 2 },
+	{ 0x1000, 1 },
+	{ 0x12345678, 2 },
+	{ 0x7FFFFFFF, 2 },
+	{ INT32_MIN, 1 },
+	{ (int64_t)INT32_MIN - 1, 2 },
+	{ 0xFFFFFFFF, 2 },
+	{ INT64_C(0x100000000), 2 },
+	{ INT64_C(0x0000FFFF00000000), 2 },
+	{ INT64_C(0x00FF00FF00FF00FF), 6 },
+	{ INT64_C(0x123456789ABCDEF0), 8 },
+	{ INT64_MAX, 2 },
+	{ INT64_MIN, 2 },
+};
+
+static int64_t sign_extend32(uint64_t value)
+{
+	return (int64_t)(((value & 0xFFFFFFFF) ^ 0x80000000) - 0x80000000);
+}
+
+/* runs the sequence the same way the instructions li emits would */
+static int64_t run_sequence(const struct imm_sequence *seq)
+{
+	uint64_t reg = 0;
+	for (size_t i = 0; i < seq->count; i++) {
+		const struct imm_step step = seq->steps[i];
+		switch (step.op) {
+		case IMM_LUI:
+			reg = (uint64_t)sign_extend32((uint64_t)step.imm << 12);
+			break;
+		case IMM_ADDI:
+			reg = (i ? reg : 0) + (uint64_t)(int64_t)step.imm;
+			break;
+		case IMM_ADDIW:
+			reg = (uint64_t)sign_extend32(reg + (uint64_t)step.imm);
+			break;
+		case IMM_SLLI:
+			reg <<= step.imm;
+			break;
+		case IMM_SRLI:
+			reg >>= step.imm;
+			break;
+		}
+	}
+	return (int64_t)reg;
+}
+
+static int check_value(int64_t value, size_t steps)
+{
+	struct imm_sequence seq;
+	build_imm_sequence(value, &seq);
+
+	const int64_t result = run_sequence(&seq);
+	if (result != value) {
+		logger(ERROR, error_internal,
+		       "Test Failed, li of 0x%" PRIx64 " loaded 0x%" PRIx64,
+		       (uint64_t)value, (uint64_t)result);
+		return 1;
+	}
+	if (steps && seq.count != steps) {
+		logger(ERROR, error_internal,
+		       "Test Failed, li of 0x%" PRIx64
+		       " took %zu instructions instead of %zu",
+		       (uint64_t)value, seq.count, steps);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_pattern(uint64_t pattern)
+{
+	int errors = 0;
+	for (int width = 1; width <= 64; width++) {
+		const uint64_t mask =
+			width == 64 ? UINT64_MAX : (UINT64_C(1) << width) - 1;
+		for (int shift = 0; shift + width <= 64; shift++) {
+			const uint64_t value = (pattern & mask) << shift;
+			errors += check_value((int64_t)value, 0);
+			errors += check_value((int64_t)(0 - value), 0);
+		}
+	}
+	return errors;
+}
+
+int main(void)
+{
+	set_exit_loglevel(NODEBUG);
+	set_min_loglevel(DEBUG);
+
+	int errors = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(cases); i++)
+		errors += check_value(cases[i].value, cases[i].steps);
+
+	/* every width and shift of a few bit patterns */
+	static const uint64_t patterns[] = { 0x9E3779B97F4A7C15,
+					     0xF0F0F0F0F0F0F0F0, 0x1 };
+	for (size_t i = 0; i < ARRAY_LENGTH(patterns); i++)
+		errors += check_pattern(patterns[i]);
+
+	return errors != 0 || get_clean_exit(ERROR);
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "parallel.h"
+#include "wrasm.h"
+#include "xmalloc.h"
+
+/* enough blocks for encoding to be split across every thread */
+#define BLOCKS 8192
+#define THREADS 4
+
+/*
+ * Each block loads the address of a label further back and branches to it.
+ * One block in the middle may also call a function that is never defined.
+ */
+static char *generate(size_t *len, int external)
+{
+	const size_t capacity = (size_t)BLOCKS * 128 + 64;
+	char *src = xmalloc(capacity);
+	size_t used = (size_t)snprintf(src, capacity, ".section .text\n");
+	for (size_t i = 0; i < BLOCKS; i++) {
+		const size_t back = i > 16 ? i - 16 : 0;
+		used += (size_t)snprintf(src + used, capacity - used,
+					 "l%zu:\n  la a0, l%zu\n"
+					 "  beq a0, a1, l%zu\n"
+					 "  addi a0, a0, %zu\n",
+					 i, back, back, i % 2048);
+		if (external && i == BLOCKS / 2)
+			used += (size_t)snprintf(src + used, capacity - used,
+						 "  call function\n");
+	}
+	*len = used;
+	return src;
+}
+
+static int assemble(const char *src, size_t len, enum wrasm_format format,
+		    unsigned threads, struct wrasm_buffer *out)
+{
+	const struct wrasm_options opts = {
+		.format = format,
+		.threads = threads,
+	};
+	return wrasm_assemble(src, len, &opts, out);
+}
+
+static int check_identical(enum wrasm_format format, int external)
+{
+	size_t len;
+	char *src = generate(&len, external);
+
+	struct wrasm_buffer serial, parallel;
+	int errors = 0;
+	if (assemble(src, len, format, 1, &serial)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble on one thread");
+		free(src);
+		return 1;
+	}
+	if (assemble(src, len, format, THREADS, &parallel)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble on %u threads",
+		       THREADS);
+		wrasm_free_buffer(&serial);
+		free(src);
+		return 1;
+	}
+
+	if (serial.size != parallel.size ||
+	    memcmp(serial.data, parallel.data, serial.size)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, output of format %d differs on %u threads",
+		       (int)format, THREADS);
+		errors++;
+	}
+	wrasm_free_buffer(&serial);
+	wrasm_free_buffer(&parallel);
+	free(src);
+	return errors;
+}
+
+/* an error in any range fails the whole assembly */
+static int check_error(void)
+{
+	size_t len;
+	char *src = generate(&len, 1);
+
+	struct wrasm_buffer out;
+	int errors = 0;
+	if (!assemble(src, len, WRASM_FORMAT_RAW, THREADS, &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, undefined symbol assembled to raw output");
+		wrasm_free_buffer(&out);
+		errors++;
+	}
+	free(src);
+	return errors;
+}
+
+int main(void)
+{
+	/* however few processors the tests run on */
+	set_processors(THREADS);
+
+	int errors = 0;
+	errors += check_identical(WRASM_FORMAT_ELF, 1);
+	errors += check_identical(WRASM_FORMAT_RAW, 0);
+	errors += check_identical(WRASM_FORMAT_IHEX, 0);
+	errors += check_error();
+	return errors != 0;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunks.h"
+#include "context.h"
+#include "debug.h"
+#include "input.h"
+#include "parallel.h"
+#include "wrasm.h"
+#include "xmalloc.h"
+
+/* enough source for parsing to be split across every thread */
+#define BLOCKS 16384
+#define THREADS 4
+
+/*
+ * Every block switches section, so the pieces of the input start in either.
+ * Labels are referred to before and after they are defined, and made global
+ * from further on in the source.
+ */
+static char *generate(size_t *len, const char *broken)
+{
+	const size_t capacity = (size_t)BLOCKS * 192 + 64;
+	char *src = xmalloc(capacity);
+	size_t used = 0;
+	for (size_t i = 0; i < BLOCKS; i++) {
+		const size_t ahead = (i + 64) % BLOCKS;
+		used += (size_t)snprintf(src + used, capacity - used,
+					 ".section .text\n"
+					 "t%zu:\n  la a0, d%zu\n"
+					 "  beq a0, a1, t%zu\n"
+					 ".section .data\n"
+					 "d%zu: .ascii \"%zu\"\n"
+					 ".globl t%zu\n",
+					 i, ahead, i, i, i, i / 2);
+		if (broken && i == BLOCKS - 2)
+			used += (size_t)snprintf(src + used, capacity - used,
+						 "%s\n", broken);
+	}
+	*len = used;
+	return src;
+}
+
+static int assemble(const char *src, size_t len, unsigned threads,
+		    struct wrasm_buffer *out)
+{
+	const struct wrasm_options opts = {
+		.format = WRASM_FORMAT_ELF,
+		.threads = threads,
+	};
+	return wrasm_assemble(src, len, &opts, out);
+}
+
+/* otherwise parsing in pieces would go untested */
+static int check_split(void)
+{
+	size_t len;
+	char *src = generate(&len, NULL);
+
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+	ctx.threads = THREADS;
+	struct input input;
+	open_input_buffer(&input, src, len);
+	const unsigned chunks = count_chunks(&ctx, &input);
+	close_input(&input);
+	free_context(&ctx);
+	free(src);
+
+	if (chunks == THREADS)
+		return 0;
+	logger(ERROR, error_internal,
+	       "Test Failed, source split into %u pieces rather than %u",
+	       chunks, THREADS);
+	return 1;
+}
+
+static int check_identical(void)
+{
+	size_t len;
+	char *src = generate(&len, NULL);
+
+	struct wrasm_buffer serial, parallel;
+	if (assemble(src, len, 1, &serial)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble on one thread");
+		free(src);
+		return 1;
+	}
+	if (assemble(src, len, THREADS, &parallel)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble on %u threads",
+		       THREADS);
+		wrasm_free_buffer(&serial);
+		free(src);
+		return 1;
+	}
+
+	int errors = 0;
+	if (serial.size != parallel.size ||
+	    memcmp(serial.data, parallel.data, serial.size)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, output differs when parsed on %u threads",
+		       THREADS);
+		errors++;
+	}
+	wrasm_free_buffer(&serial);
+	wrasm_free_buffer(&parallel);
+	free(src);
+	return errors;
+}
+
+/* a line that fails to parse near the end fails the whole assembly */
+static int check_error(void)
+{
+	size_t len;
+	char *src = generate(&len, "  unknown a0, a1");
+
+	struct wrasm_buffer out;
+	int errors = 0;
+	if (!assemble(src, len, THREADS, &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unknown instruction was assembled");
+		wrasm_free_buffer(&out);
+		errors++;
+	}
+	free(src);
+	return errors;
+}
+
+int main(void)
+{
+	/* however few processors the tests run on */
+	set_processors(THREADS);
+
+	int errors = 0;
+	errors += check_split();
+	errors += check_identical();
+	errors += check_error();
+	return errors != 0;
+}
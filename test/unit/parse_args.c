@@ -1,13 +1,16 @@
 
 #include "parse.h"
 
-#include <string.h>
+#include <inttypes.h>
 
+#include "context.h"
 #include "debug.h"
+#include "lexer.h"
 #include "macros.h"
-#include "xmalloc.h"
 
-typedef int test_parse(char *, struct args);
+typedef int test_parse(const struct operands *, struct args);
+
+static struct wrasm_ctx ctx;
 
 struct case_t {
 	const char *argstr;
@@ -20,20 +23,20 @@ struct case_t cases_rtype[] = {
 };
 struct case_t cases_itype[] = {
 	{ "x2, x25, 5", { .rd = 2, .rs1 = 25, .imm = 5 } },
-	{ "sp, zero, -2024", { .rd = 2, .rs1 = 0, .imm = (uint32_t)-2024 } },
+	{ "sp, zero, -2024", { .rd = 2, .rs1 = 0, .imm = -2024 } },
 };
 struct case_t cases_stype[] = {
-	{ "x6, s7, 65", { .rs1 = 6, .rs2 = 23, .imm = 65 } },
-	{ "t4, sp, 16", { .rs1 = 29, .rs2 = 2, .imm = 16 } },
+	{ "s7, 65(x6)", { .rs1 = 6, .rs2 = 23, .imm = 65 } },
+	{ "sp, -16(t4)", { .rs1 = 29, .rs2 = 2, .imm = -16 } },
 };
 struct case_t cases_utype[] = {
 	{ "x6, 40000", { .rd = 6, .imm = 40000 } },
 	{ "s0, 16", { .rd = 8, .imm = 16 } },
 };
 
-int test_rtype(char *argstr, struct args expected)
+int test_rtype(const struct operands *ops, struct args expected)
 {
-	const struct args args = parse_rtype(argstr);
+	const struct args args = parse_rtype(&ctx, ops);
 	const int rd = args.rd == expected.rd;
 	const int rs1 = args.rs1 == expected.rs1;
 	const int rs2 = args.rs2 == expected.rs2;
@@ -47,54 +50,57 @@ int test_rtype(char *argstr, struct args expected)
 	return 0;
 }
 
-int test_itype(char *argstr, struct args expected)
+int test_itype(const struct operands *ops, struct args expected)
 {
-	const struct args args = parse_itype(argstr);
+	const struct args args = parse_itype(&ctx, ops);
 	const int rd = args.rd == expected.rd;
 	const int rs1 = args.rs1 == expected.rs1;
 	const int imm = args.imm == expected.imm;
 
 	if (!rd || !rs1 || !imm) {
 		logger(ERROR, error_internal,
-		       "itype argument string incorrectly parsed as x%d, x%d, %d",
+		       "itype argument string incorrectly parsed as x%d, x%d, "
+		       "%" PRId64,
 		       args.rd, args.rs1, args.imm);
-		logger(INFO, error_internal, "expected x%d, x%d, %d",
+		logger(INFO, error_internal, "expected x%d, x%d, %" PRId64,
 		       expected.rd, expected.rs1, expected.imm);
 		return 1;
 	}
 	return 0;
 }
 
-int test_stype(char *argstr, struct args expected)
+int test_stype(const struct operands *ops, struct args expected)
 {
-	const struct args args = parse_itype(argstr);
+	const struct args args = parse_stype(&ctx, ops);
 	const int rs1 = args.rs1 == expected.rs1;
 	const int rs2 = args.rs2 == expected.rs2;
 	const int imm = args.imm == expected.imm;
 
 	if (!rs1 || !rs2 || !imm) {
 		logger(ERROR, error_internal,
-		       "stype argument string incorrectly parsed as x%d, x%d, %d",
-		       args.rd, args.rs1, args.imm);
-		logger(INFO, error_internal, "expected x%d, x%d, %d",
+		       "stype argument string incorrectly parsed as x%d, x%d, "
+		       "%" PRId64,
+		       args.rs1, args.rs2, args.imm);
+		logger(INFO, error_internal, "expected x%d, x%d, %" PRId64,
 		       expected.rs1, expected.rs2, expected.imm);
 		return 1;
 	}
 	return 0;
 }
 
-int test_utype(char *argstr, struct args expected)
+int test_utype(const struct operands *ops, struct args expected)
 {
-	const struct args args = parse_itype(argstr);
+	const struct args args = parse_utype(&ctx, ops);
 	const int rd = args.rd == expected.rd;
 	const int imm = args.imm == expected.imm;
 
 	if (!rd || !imm) {
 		logger(ERROR, error_internal,
-		       "utype argument string incorrectly parsed as x%d, %d",
+		       "utype argument string incorrectly parsed as x%d, "
+		       "%" PRId64,
 		       args.rd, args.imm);
-		logger(INFO, error_internal, "expected x%d, %d", expected.rd,
-		       expected.imm);
+		logger(INFO, error_internal, "expected x%d, %" PRId64,
+		       expected.rd, expected.imm);
 		return 1;
 	}
 	return 0;
@@ -104,12 +110,12 @@ int test_cases(struct case_t *cases, size_t count, test_parse test)
 {
 	int errors = 0;
 	for (size_t i = 0; i < count; i++) {
-		const size_t str_sz = strlen(cases[i].argstr) + 1;
-		char *argstr = xmalloc(str_sz);
-		memcpy(argstr, cases[i].argstr, str_sz);
-		if (test(argstr, cases[i].expected))
+		struct tokenline line;
+		struct operands ops;
+		if (tokenize(cases[i].argstr, &line) ||
+		    split_operands(line.tokens, line.count, &ops) ||
+		    test(&ops, cases[i].expected))
 			errors++;
-		free(argstr);
 	}
 	return errors != 0;
 }
@@ -118,11 +124,17 @@ int main(void)
 {
 	set_exit_loglevel(NODEBUG);
 	set_min_loglevel(DEBUG);
+	init_context(&ctx);
 
 	int errors = 0;
 	errors +=
 		test_cases(cases_rtype, ARRAY_LENGTH(cases_rtype), &test_rtype);
 	errors +=
 		test_cases(cases_itype, ARRAY_LENGTH(cases_itype), &test_itype);
+	errors +=
+		test_cases(cases_stype, ARRAY_LENGTH(cases_stype), &test_stype);
+	errors +=
+		test_cases(cases_utype, ARRAY_LENGTH(cases_utype), &test_utype);
+	free_context(&ctx);
 	return errors != 0 || get_clean_exit(ERROR);
 }
@@ -3,8 +3,11 @@
 
 #include "form/atomic.h"
 #include "form/base.h"
+#include "form/csr.h"
+#include "form/fencei.h"
 #include "form/instructions.h"
 #include "debug.h"
+#include "macros.h"
 
 int compare_formations(struct formation *a, struct formation *b)
 {
@@ -28,7 +31,8 @@ int compare_formations(struct formation *a, struct formation *b)
 
 int test_parser(struct formation formation)
 {
-	struct formation found = parse_form(formation.name);
+	struct formation found =
+		parse_form(formation.name, strlen(formation.name));
 	if (!found.name) {
 		logger(ERROR, error_internal,
 		       "Test Failed, parse_parser returned error code with instruction %s",
@@ -44,18 +48,33 @@ int test_parser(struct formation formation)
 	return 0;
 }
 
+int test_unknown(const char *instruction)
+{
+	if (find_formation(instruction, strlen(instruction))) {
+		logger(ERROR, error_internal,
+		       "Test Failed, found formation for unknown instruction \"%s\"",
+		       instruction);
+		return 1;
+	}
+	return 0;
+}
+
 int main(void)
 {
 	set_exit_loglevel(NODEBUG);
 	set_min_loglevel(DEBUG);
 	int errors = 0;
-	for (size_t i = 0; rv32i[i].name; i++)
-		errors += test_parser(rv32i[i]);
-	for (size_t i = 0; rv64i[i].name; i++)
-		errors += test_parser(rv32i[i]);
-	for (size_t i = 0; rv32a[i].name; i++)
-		errors += test_parser(rv32i[i]);
-	for (size_t i = 0; rv64a[i].name; i++)
-		errors += test_parser(rv32i[i]);
+	const struct formation *sets[] = {
+		rv32i, rv64i, rv32a, rv64a, zicsr, zifencei,
+	};
+	for (size_t i = 0; i < ARRAY_LENGTH(sets); i++)
+		for (size_t j = 0; sets[i][j].name; j++)
+			errors += test_parser(sets[i][j]);
+
+	const char *unknown[] = {
+		"", "a", "ad", "addx", "addiw.", "amoadd.w.aqrlx", "ADD",
+	};
+	for (size_t i = 0; i < ARRAY_LENGTH(unknown); i++)
+		errors += test_unknown(unknown[i]);
 	return errors != 0 || get_clean_exit(ERROR);
 }
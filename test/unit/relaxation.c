@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "debug.h"
+#include "generation.h"
+#include "input.h"
+#include "macros.h"
+#include "wrasm.h"
+#include "xmalloc.h"
+
+/* head, followed by the given number of nops, followed by tail */
+static char *pad(const char *head, size_t nops, const char *tail, size_t *len)
+{
+	static const char nop[] = "  nop\n";
+	const size_t headlen = strlen(head);
+	const size_t taillen = strlen(tail);
+	*len = headlen + nops * strlen(nop) + taillen;
+
+	char *src = xmalloc(*len);
+	memcpy(src, head, headlen);
+	for (size_t i = 0; i < nops; i++)
+		memcpy(src + headlen + i * strlen(nop), nop, strlen(nop));
+	memcpy(src + *len - taillen, tail, taillen);
+	return src;
+}
+
+static int assemble_padded(const char *head, size_t nops, const char *tail,
+			   struct wrasm_buffer *out)
+{
+	size_t len;
+	char *src = pad(head, nops, tail, &len);
+	const struct wrasm_options opts = { .format = WRASM_FORMAT_RAW };
+	const int err = wrasm_assemble(src, len, &opts, out);
+	free(src);
+	return err;
+}
+
+/* the warnings from assembling, rather than the output */
+static size_t count_warnings(const char *head, size_t nops, const char *tail)
+{
+	size_t len;
+	char *src = pad(head, nops, tail, &len);
+
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+	ctx.diagnostics.keep_going = true;
+	struct diagnostics *prev = use_diagnostics(&ctx.diagnostics);
+	struct input input;
+	if (!open_input_buffer(&input, src, len))
+		assemble_input(&ctx, &input);
+	const size_t warnings = ctx.diagnostics.counts[WARN];
+	free_context(&ctx);
+	use_diagnostics(prev);
+	free(src);
+	return warnings;
+}
+
+static uint32_t word_at(const struct wrasm_buffer *out, size_t offset)
+{
+	const unsigned char *b = out->data + offset;
+	return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 |
+	       (uint32_t)b[3] << 24;
+}
+
+struct expected_word {
+	size_t offset;
+	uint32_t word;
+};
+
+static int check_words(const struct wrasm_buffer *out, size_t size,
+		       const struct expected_word *expected, size_t count)
+{
+	if (out->size != size) {
+		logger(ERROR, error_internal,
+		       "Test Failed, expected %zu bytes but got %zu", size,
+		       out->size);
+		return 1;
+	}
+	int errors = 0;
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t word = word_at(out, expected[i].offset);
+		if (word == expected[i].word)
+			continue;
+		logger(ERROR, error_internal,
+		       "Test Failed, expected 0x%08X at 0x%zX but got 0x%08X",
+		       expected[i].word, expected[i].offset, word);
+		errors++;
+	}
+	return errors;
+}
+
+/* a branch just out of range becomes an inverted branch over a jal */
+static int check_near(void)
+{
+	static const struct expected_word expected[] = {
+		{ 0x0, 0x00B50263 }, /* beq a0, a1, near (in range) */
+		{ 0x4, 0x00B51463 }, /* bne a0, a1, 8 */
+		{ 0x8, 0x1340106F }, /* jal zero, far */
+		{ 0x113C, 0xEC5FE06F }, /* jal zero, start */
+	};
+	struct wrasm_buffer out;
+	if (assemble_padded("start:\n"
+			    "  beq a0, a1, near\n"
+			    "near:\n"
+			    "  beq a0, a1, far\n",
+			    1100, "far:\n  j start\n", &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble a relaxed branch");
+		return 1;
+	}
+	const int errors = check_words(&out, 0x1140, expected,
+				       ARRAY_LENGTH(expected));
+	wrasm_free_buffer(&out);
+	return errors;
+}
+
+/* beyond the range of jal, both need an auipc and jalr pair */
+static int check_far(void)
+{
+	const size_t nops = 0x100000 / 4;
+	static const struct expected_word expected[] = {
+		{ 0x0, 0x00B55663 }, /* bge a0, a1, 12 */
+		{ 0x4, 0x00100317 }, /* auipc t1, 0x100 */
+		{ 0x8, 0x01030067 }, /* jalr zero, 16(t1) */
+		{ 0xC, 0x00100097 }, /* auipc ra, 0x100 */
+		{ 0x10, 0x008080E7 }, /* jalr ra, 8(ra) */
+	};
+	struct wrasm_buffer out;
+	if (assemble_padded("  blt a0, a1, far\n"
+			    "  jal ra, far\n",
+			    nops, "far:\n", &out)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble a far branch");
+		return 1;
+	}
+	const int errors = check_words(&out, 0x14 + nops * 4, expected,
+				       ARRAY_LENGTH(expected));
+	wrasm_free_buffer(&out);
+	return errors;
+}
+
+/* code may keep a live value in t1, so overwriting it is never silent */
+static int check_t1_warning(void)
+{
+	const size_t nops = 0x100000 / 4;
+	static const char head[] = "  blt a0, a1, far\n"
+				   "  j far\n"
+				   "  jal zero, far\n"
+				   "  jal ra, far\n"
+				   "  beq a0, a1, near\n"
+				   "near:\n";
+	const size_t warnings = count_warnings(head, nops, "far:\n");
+	if (warnings != 3) {
+		logger(ERROR, error_internal,
+		       "Test Failed, %zu warnings about t1 rather than 3",
+		       warnings);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int errors = 0;
+	errors += check_near();
+	errors += check_far();
+	errors += check_t1_warning();
+	return errors;
+}
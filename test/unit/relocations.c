@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "elf/def.h"
+#include "elf/output.h"
+#include "elf/reloc.h"
+#include "macros.h"
+#include "wrasm.h"
+
+static const char source[] = ".globl shared\n"
+			     ".section .text\n"
+			     "  call extfunc\n"
+			     "  la a0, extdata\n"
+			     "  beq a0, a1, extlabel\n"
+			     "  j local\n"
+			     "  jal ra, shared\n"
+			     "  la a1, greeting\n"
+			     "local:\n"
+			     "shared:\n"
+			     "  ret\n"
+			     ".section .data\n"
+			     "greeting: .asciz \"hi\"\n";
+
+struct expected_reloc {
+	uint64_t offset;
+	enum reloc_type type;
+};
+
+/* local references within .text are resolved, everything else relocated */
+static const struct expected_reloc expected[] = {
+	{ 0x00, R_RISCV_CALL_PLT },
+	{ 0x08, R_RISCV_PCREL_HI20 },
+	{ 0x0C, R_RISCV_PCREL_LO12_I },
+	{ 0x10, R_RISCV_BRANCH },
+	{ 0x18, R_RISCV_JAL },
+	{ 0x1C, R_RISCV_PCREL_HI20 },
+	{ 0x20, R_RISCV_PCREL_LO12_I },
+};
+
+static const struct elf64sectionheader *
+section_header(const struct wrasm_buffer *elf, enum sections section)
+{
+	struct elf64header header;
+	memcpy(&header, elf->data, sizeof(header));
+	return (const struct elf64sectionheader *)(elf->data +
+						   header.shoffset) +
+	       section;
+}
+
+int main(void)
+{
+	int errors = 0;
+	struct wrasm_buffer elf;
+	if (wrasm_assemble(source, strlen(source), NULL, &elf)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to assemble relocations");
+		return 1;
+	}
+
+	const struct elf64sectionheader *rela =
+		section_header(&elf, SECTION_RELA_TEXT);
+	if (rela->size != sizeof(struct elf64rela) * ARRAY_LENGTH(expected) ||
+	    rela->info != SECTION_TEXT || rela->link != SECTION_SYMTAB) {
+		logger(ERROR, error_internal,
+		       "Test Failed, .rela.text has %zu bytes for section %u",
+		       (size_t)rela->size, (unsigned)rela->info);
+		wrasm_free_buffer(&elf);
+		return 1;
+	}
+
+	const struct elf64sectionheader *symtab =
+		section_header(&elf, SECTION_SYMTAB);
+	const size_t symbols = symtab->size / sizeof(struct elf64sym);
+	for (size_t i = 0; i < ARRAY_LENGTH(expected); i++) {
+		struct elf64rela entry;
+		memcpy(&entry, elf.data + rela->offset + i * sizeof(entry),
+		       sizeof(entry));
+		if (entry.offset != expected[i].offset ||
+		    (entry.info & 0xFFFFFFFF) != expected[i].type ||
+		    !(entry.info >> 32) || entry.info >> 32 >= symbols) {
+			logger(ERROR, error_internal,
+			       "Test Failed, relocation %zu is type %u at 0x%zx",
+			       i, (unsigned)(entry.info & 0xFFFFFFFF),
+			       (size_t)entry.offset);
+			errors++;
+		}
+	}
+
+	/* every local symbol has to come before the first global one */
+	for (size_t i = 1; i < symbols; i++) {
+		struct elf64sym sym;
+		memcpy(&sym,
+		       elf.data + symtab->offset + i * sizeof(struct elf64sym),
+		       sizeof(sym));
+		if ((sym.info == ELF_SYM_LOCAL) != (i < symtab->info)) {
+			logger(ERROR, error_internal,
+			       "Test Failed, symbol %zu is out of order", i);
+			errors++;
+		}
+	}
+
+	wrasm_free_buffer(&elf);
+	return errors;
+}
@@ -0,0 +1,194 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#define HAVE_UNIX_SOCKETS
+#endif
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNIX_SOCKETS
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "debug.h"
+
+#ifdef HAVE_UNIX_SOCKETS
+
+/* how long the server gets to start listening, in 10ms steps */
+#define START_ATTEMPTS 500
+
+/* only the server sees every request, as long as it runs them itself */
+static int served = 0;
+
+/*
+ * Writes its last argument to stdout and a file named by the one before, so
+ * that both the client's streams and its directory are checked. Given only
+ * --count, returns how many requests have been served.
+ */
+static int echo_request(int argc, char *argv[])
+{
+	served++;
+	if (argc == 2 && !strcmp(argv[1], "--count"))
+		return served;
+	if (argc < 3)
+		return EXIT_FAILURE;
+	FILE *f = fopen(argv[argc - 2], "w");
+	if (!f)
+		return EXIT_FAILURE;
+	fputs(argv[argc - 1], f);
+	fclose(f);
+	printf("%s", argv[argc - 1]);
+	return argc;
+}
+
+static int read_file(const char *name, char *buf, size_t size)
+{
+	FILE *f = fopen(name, "r");
+	if (!f)
+		return 1;
+	const size_t len = fread(buf, 1, size - 1, f);
+	buf[len] = '\0';
+	fclose(f);
+	return 0;
+}
+
+/* runs a request with stdout sent to a file in the current directory */
+static int forward_captured(const char *path, int argc, char *argv[])
+{
+	fflush(stdout);
+	const int saved = dup(STDOUT_FILENO);
+	const int fd = open("stdout", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	dup2(fd, STDOUT_FILENO);
+	close(fd);
+
+	const int status = forward_request(path, argc, argv);
+
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+	return status;
+}
+
+static int check_request(const char *path)
+{
+	char *argv[] = { "wrasm", "--connect", "written", "hello, server" };
+	const int argc = 4;
+
+	int status = -1;
+	const struct timespec step = { .tv_nsec = 10000000 };
+	for (int i = 0; i < START_ATTEMPTS && status < 0; i++) {
+		status = forward_captured(path, argc, argv);
+		if (status < 0)
+			nanosleep(&step, NULL);
+	}
+	if (status != argc) {
+		logger(ERROR, error_internal,
+		       "Test Failed, request exited with %d rather than %d",
+		       status, argc);
+		return 1;
+	}
+
+	int errors = 0;
+	char buf[64];
+	if (read_file("stdout", buf, sizeof(buf)) || strcmp(buf, argv[3])) {
+		logger(ERROR, error_internal,
+		       "Test Failed, request did not write to client's stdout");
+		errors++;
+	}
+	if (read_file("written", buf, sizeof(buf)) || strcmp(buf, argv[3])) {
+		logger(ERROR, error_internal,
+		       "Test Failed, request ran outside client's directory");
+		errors++;
+	}
+	remove("stdout");
+	remove("written");
+	return errors;
+}
+
+/* a failed request must leave the server able to take the next one */
+static int check_failed_request(const char *path)
+{
+	char *fail[] = { "wrasm" };
+	const int status = forward_request(path, 1, fail);
+	if (status != EXIT_FAILURE) {
+		logger(ERROR, error_internal,
+		       "Test Failed, bad request exited with %d", status);
+		return 1;
+	}
+	return check_request(path);
+}
+
+static int check_count(const char *path, int expected)
+{
+	char *argv[] = { "wrasm", "--count" };
+	const int status = forward_request(path, 2, argv);
+	if (status != expected) {
+		logger(ERROR, error_internal,
+		       "Test Failed, server saw %d requests rather than %d",
+		       status, expected);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_no_server(void)
+{
+	char *argv[] = { "wrasm" };
+	if (forward_request("missing.sock", 1, argv) != -1) {
+		logger(ERROR, error_internal,
+		       "Test Failed, request forwarded without a server");
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/wrasm_server_XXXXXX";
+	if (!mkdtemp(dir) || chdir(dir)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, unable to make a directory to work in");
+		return 1;
+	}
+	static const char path[] = "server.sock";
+
+	const pid_t server = fork();
+	if (!server)
+		exit(run_server(path, &echo_request));
+
+	int errors = 0;
+	errors += check_request(path);
+	errors += check_failed_request(path);
+	errors += check_count(path, 4);
+	errors += check_no_server();
+
+	/* stopping the server removes its socket */
+	kill(server, SIGTERM);
+	int status;
+	waitpid(server, &status, 0);
+	struct stat st;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) || !lstat(path, &st)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, server did not shut down cleanly");
+		errors++;
+	}
+
+	rmdir(dir);
+	return errors != 0;
+}
+
+#else
+
+int main(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "macros.h"
+#include "sha256.h"
+
+struct vector {
+	const char *text;
+	size_t repeat;
+	const char *digest;
+};
+
+/* the examples of FIPS 180-4 and its long message test */
+static const struct vector vectors[] = {
+	{ "", 1,
+	  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "abc", 1,
+	  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+	  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "a", 1000000,
+	  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+/* the text is fed in pieces of every size, so blocks are split unevenly */
+static int check_vector(const struct vector *v, size_t piece)
+{
+	const size_t len = strlen(v->text);
+	struct sha256 sha;
+	init_sha256(&sha);
+	for (size_t i = 0; i < v->repeat; i++)
+		for (size_t pos = 0; pos < len; pos += piece)
+			update_sha256(&sha, v->text + pos,
+				      len - pos < piece ? len - pos : piece);
+
+	unsigned char digest[SHA256_LENGTH];
+	finish_sha256(&sha, digest);
+	char hex[2 * SHA256_LENGTH + 1];
+	for (size_t i = 0; i < SHA256_LENGTH; i++)
+		snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+
+	if (!strcmp(hex, v->digest))
+		return 0;
+	logger(ERROR, error_internal,
+	       "Test Failed, \"%.16s\" x%zu in pieces of %zu hashed to %s",
+	       v->text, v->repeat, piece, hex);
+	return 1;
+}
+
+int main(void)
+{
+	int errors = 0;
+	for (size_t i = 0; i < ARRAY_LENGTH(vectors); i++)
+		for (size_t piece = 1; piece <= 70; piece += 23)
+			errors += check_vector(&vectors[i], piece);
+	return errors != 0;
+}
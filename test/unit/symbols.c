@@ -0,0 +1,91 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "context.h"
+#include "debug.h"
+#include "macros.h"
+#include "symbols.h"
+
+#define SYMBOL_TESTS 100000
+
+static void symbol_name(char *buf, size_t i)
+{
+	snprintf(buf, 32, ".L%zu", i);
+}
+
+int main(void)
+{
+	set_exit_loglevel(NODEBUG);
+	set_min_loglevel(WARN);
+	int errors = 0;
+	char name[32];
+	struct wrasm_ctx ctx;
+	init_context(&ctx);
+
+	for (size_t i = 0; i < SYMBOL_TESTS; i++) {
+		symbol_name(name, i);
+		struct symbol *sym =
+			create_symbol(&ctx, name, strlen(name), SYMBOL_LABEL);
+		if (!sym || get_symbol_index(&ctx, sym) != i) {
+			logger(ERROR, error_internal,
+			       "Test Failed, unable to create symbol %s", name);
+			return 1;
+		}
+		sym->value = (long)i;
+	}
+
+	if (ctx.symbols.count != SYMBOL_TESTS) {
+		logger(ERROR, error_internal,
+		       "Test Failed, expected %d symbols but found %zu",
+		       SYMBOL_TESTS, ctx.symbols.count);
+		errors++;
+	}
+
+	/* symbols must survive the table growing, and keep creation order */
+	size_t offset = 1;
+	for (size_t i = 0; i < SYMBOL_TESTS; i++) {
+		symbol_name(name, i);
+		const struct symbol *sym = get_symbol(&ctx, name, strlen(name));
+		if (!sym || sym != get_symbol_at(&ctx, i) ||
+		    sym->value != (long)i) {
+			logger(ERROR, error_internal,
+			       "Test Failed, symbol %s not found", name);
+			errors++;
+			continue;
+		}
+		if (sym->name != offset ||
+		    strcmp(get_symbol_strings(&ctx) + sym->name, name)) {
+			logger(ERROR, error_internal,
+			       "Test Failed, symbol %s has the wrong name", name);
+			errors++;
+		}
+		offset += strlen(name) + 1;
+	}
+	if (get_symbol_strings_size(&ctx) != offset ||
+	    get_symbol_strings(&ctx)[0]) {
+		logger(ERROR, error_internal,
+		       "Test Failed, malformed symbol string table");
+		errors++;
+	}
+
+	const char *missing[] = { ".L", ".L100000", "L1", ".L1 " };
+	for (size_t i = 0; i < ARRAY_LENGTH(missing); i++) {
+		if (get_symbol(&ctx, missing[i], strlen(missing[i]))) {
+			logger(ERROR, error_internal,
+			       "Test Failed, found nonexistent symbol \"%s\"",
+			       missing[i]);
+			errors++;
+		}
+	}
+
+	/* prefix of a longer name must not match */
+	if (get_symbol(&ctx, ".L12", 3) != get_symbol(&ctx, ".L1", 3)) {
+		logger(ERROR, error_internal,
+		       "Test Failed, lookup read past the name length");
+		errors++;
+	}
+
+	free_context(&ctx);
+	return errors != 0 || get_clean_exit(ERROR);
+}